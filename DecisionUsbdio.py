@@ -53,6 +53,13 @@ class DecisionUsbdio:
         return self.__send_command(str(port), 'w', 'c', str(bit))
 
 
+# Use the native module if it is built (see setup.py), it keeps the device open between calls:
+try:
+    from dcihid import DecisionUsbdio
+except ImportError:
+    pass
+
+
 def print_usage():
     """ Prints usage """
     print('{} - A Python wrapper for the DecisionUsbdio binary'.format(sys.argv[0]))
@@ -0,0 +1,366 @@
+/*
+ * File:
+ *      batch.c
+ *
+ * Description:
+ *      Batch mode of the DecisionUsbdio application. Runs a script of
+ *      commands on boards that are opened once, and prints one JSON
+ *      object per command executed.
+ *
+ *      Script commands, one per line, '#' starts a comment:
+ *          board <name> [<type> <id> [<device>]]   open and/or select a board
+ *          read <port>                             read a port
+ *          readall                                 read ports 0x00 to 0x03 at once
+ *          write <port> <byte>                     write a byte to a port
+ *          set <port> <bit>                        set a bit on a port
+ *          clear <port> <bit>                      clear a bit on a port
+ *          sleep <ms>                              sleep for <ms>
+ *          until <ms>                              sleep until <ms> after the start
+ *          loop <count>                            repeat up to 'end', 0 for ever
+ *          end                                     end of a loop
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcirt.h"
+#include "batch.h"
+
+#define MAX_COMMANDS    4096
+#define MAX_BOARDS      16
+#define MAX_NESTING     16
+#define MAX_LINE        256
+
+enum {
+    CMD_BOARD,
+    CMD_READ,
+    CMD_READALL,
+    CMD_WRITE,
+    CMD_SET,
+    CMD_CLEAR,
+    CMD_SLEEP,
+    CMD_UNTIL,
+    CMD_LOOP,
+    CMD_END
+};
+
+static const char *cmd_names[] = {
+    "board", "read", "readall", "write", "set", "clear", "sleep", "until", "loop", "end"
+};
+
+/*
+ * One parsed script line
+ */
+struct command {
+    int         op;
+    int         line;
+    char        name[32];
+    char        devname[64];
+    u_int       card_type;
+    u_int       card_id;
+    u_int32_t   arg1;
+    u_int32_t   arg2;
+    int         target;             // loop: index of its end, end: index of its loop
+    u_int32_t   remaining;          // loop: iterations left
+};
+
+struct board {
+    char        name[32];
+    u_int64_t   handle;
+    u_int       card_type;
+    u_int       card_id;
+};
+
+static int
+parse_number(const char *str, u_int32_t *value) {
+    char *end;
+
+    if (str == NULL) return -1;
+    errno = 0;
+    *value = (u_int32_t)strtoul(str, &end, 0);
+    if (errno || *end != '\0') return -1;
+    return 0;
+}
+
+/*
+ * Parses the whole script before anything is run, so a typo does not
+ * stop a relay sequence half way.
+ */
+static int
+parse_script(FILE *script, struct command *commands, int *num_commands) {
+    char line[MAX_LINE];
+    char *argv[6], *save = NULL;
+    int stack[MAX_NESTING];
+    int depth = 0, line_num = 0, argc, op;
+    struct command *cmd;
+
+    *num_commands = 0;
+    while (fgets(line, sizeof(line), script) != NULL) {
+        line_num++;
+        if (strchr(line, '#')) *strchr(line, '#') = '\0';
+
+        for (argc = 0; argc < 6; argc++) {
+            if ((argv[argc] = strtok_r(argc ? NULL : line, " \t\r\n", &save)) == NULL) break;
+        }
+        if (argc == 0) continue;
+
+        for (op = CMD_BOARD; op <= CMD_END; op++) {
+            if (strcmp(argv[0], cmd_names[op]) == 0) break;
+        }
+        if (op > CMD_END) {
+            fprintf(stderr, "line %d: unknown command '%s'\n", line_num, argv[0]);
+            return -1;
+        }
+        if (*num_commands == MAX_COMMANDS) {
+            fprintf(stderr, "line %d: too many commands\n", line_num);
+            return -1;
+        }
+
+        cmd = &commands[*num_commands];
+        memset(cmd, 0, sizeof(struct command));
+        cmd->op = op;
+        cmd->line = line_num;
+
+        switch (op) {
+            case CMD_BOARD:
+                if (argc < 2 || argc == 3 || argc > 5 || strlen(argv[1]) >= sizeof(cmd->name)) goto syntax;
+                strcpy(cmd->name, argv[1]);
+                if (argc >= 4) {
+                    if (parse_number(argv[2], &cmd->arg1) || parse_number(argv[3], &cmd->arg2)) goto syntax;
+                    cmd->card_type = cmd->arg1;
+                    cmd->card_id = cmd->arg2;
+                    if (!dcihid_assert_card_type(cmd->card_type) || !dcihid_assert_card_id(cmd->card_id)) goto syntax;
+                }
+                if (argc == 5) {
+                    if (strlen(argv[4]) >= sizeof(cmd->devname)) goto syntax;
+                    strcpy(cmd->devname, argv[4]);
+                }
+                break;
+            case CMD_READ:
+            case CMD_SLEEP:
+            case CMD_UNTIL:
+            case CMD_LOOP:
+                if (argc != 2 || parse_number(argv[1], &cmd->arg1)) goto syntax;
+                if (op == CMD_READ && cmd->arg1 > 0xFF) goto syntax;
+                if (op == CMD_LOOP) {
+                    if (depth == MAX_NESTING) goto syntax;
+                    stack[depth++] = *num_commands;
+                }
+                break;
+            case CMD_WRITE:
+            case CMD_SET:
+            case CMD_CLEAR:
+                if (argc != 3 || parse_number(argv[1], &cmd->arg1) || parse_number(argv[2], &cmd->arg2)) goto syntax;
+                if (cmd->arg1 > 0xFF || cmd->arg2 > (op == CMD_WRITE ? 0xFF : 7)) goto syntax;
+                break;
+            case CMD_READALL:
+                if (argc != 1) goto syntax;
+                break;
+            case CMD_END:
+                if (argc != 1 || depth == 0) goto syntax;
+                cmd->target = stack[--depth];
+                commands[cmd->target].target = *num_commands;
+                break;
+        }
+        (*num_commands)++;
+    }
+
+    if (depth) {
+        fprintf(stderr, "line %d: missing 'end'\n", commands[stack[depth - 1]].line);
+        return -1;
+    }
+    return 0;
+
+syntax:
+    fprintf(stderr, "line %d: invalid '%s' command\n", line_num, argv[0]);
+    return -1;
+}
+
+/*
+ * Opens a board, or finds it if it is already open
+ */
+static struct board *
+select_board(struct board *boards, int *num_boards, const char *name, const char *dev_name,
+             const u_int card_type, const u_int card_id, const int transport, const int create) {
+    char devname[64];
+    struct board *board;
+    int i;
+
+    for (i = 0; i < *num_boards; i++) {
+        if (strcmp(boards[i].name, name) == 0) return &boards[i];
+    }
+    if (!create || *num_boards == MAX_BOARDS) return NULL;
+
+    if (dev_name && dev_name[0]) {
+        snprintf(devname, sizeof(devname), "%s", dev_name);
+    } else if (transport == DCIHID_TRANSPORT_SIM) {
+        devname[0] = '\0';
+    } else if (dcihid_lookup(card_type, card_id, devname, sizeof(devname)) != 0) {
+        return NULL;
+    }
+
+    board = &boards[*num_boards];
+    if ((board->handle = dcihid_open_transport(devname, card_type, card_id, transport)) == 0) return NULL;
+    snprintf(board->name, sizeof(board->name), "%s", name);
+    board->card_type = card_type;
+    board->card_id = card_id;
+    (*num_boards)++;
+    return board;
+}
+
+/*
+ * Prints a string as a JSON string, quotes included
+ */
+static void
+print_json_string(const char *str) {
+    const unsigned char *c;
+
+    putchar('"');
+    for (c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            printf("\\%c", *c);
+        } else if (*c < 0x20 || *c == 0x7F) {
+            printf("\\u%04X", *c);
+        } else {
+            putchar(*c);
+        }
+    }
+    putchar('"');
+}
+
+int
+batch_run(FILE *script, const char *dev_name, const u_int card_type, const u_int card_id, const int transport,
+          const int timing) {
+    struct command *commands, *cmd;
+    struct board boards[MAX_BOARDS];
+    struct board *board = NULL;
+    struct dcihid_input input;
+    int num_commands, num_boards = 0, pc, i, failed = 0;
+    u_int64_t start, begin, elapsed, open_ns = 0;
+    u_int64_t executed = 0;
+    u_int8_t data = 0;
+    int32_t ret;
+
+    commands = (struct command *)malloc(sizeof(struct command) * MAX_COMMANDS);
+    if (commands == NULL) return 1;
+    if (parse_script(script, commands, &num_commands) != 0) {
+        free(commands);
+        return 1;
+    }
+
+    start = dcirt_now_ns();
+
+    // The board given on the command line is selected first:
+    if (card_type != 0xFF && card_id != 0xFF) {
+        begin = dcirt_now_ns();
+        board = select_board(boards, &num_boards, "default", dev_name, card_type, card_id, transport, 1);
+        open_ns += dcirt_now_ns() - begin;
+        if (board == NULL) {
+            fprintf(stderr, "There is no Decision-Computer DCI HID USB device (CardID, CardNO) = (%d, %d) plugged\n", card_type, card_id);
+            free(commands);
+            return 1;
+        }
+    }
+
+    for (pc = 0; pc < num_commands; pc++) {
+        cmd = &commands[pc];
+
+        // Flow control, not reported:
+        if (cmd->op == CMD_LOOP) {
+            cmd->remaining = cmd->arg1;
+            continue;
+        }
+        if (cmd->op == CMD_END) {
+            struct command *loop = &commands[cmd->target];
+            if (loop->arg1 == 0 || --loop->remaining > 0) pc = cmd->target;
+            continue;
+        }
+
+        begin = dcirt_now_ns();
+        ret = 0;
+        switch (cmd->op) {
+            case CMD_BOARD:
+                board = select_board(boards, &num_boards, cmd->name, cmd->devname, cmd->card_type, cmd->card_id,
+                                     transport, cmd->card_type || cmd->card_id || cmd->devname[0]);
+                ret = (board == NULL) ? -1 : 0;
+                open_ns += dcirt_now_ns() - begin;
+                break;
+            case CMD_SLEEP:
+                dcirt_sleep_until(begin + (u_int64_t)cmd->arg1 * 1000000ULL);
+                break;
+            case CMD_UNTIL:
+                dcirt_sleep_until(start + (u_int64_t)cmd->arg1 * 1000000ULL);
+                break;
+            default:
+                if (board == NULL) {
+                    ret = -1;
+                    break;
+                }
+                switch (cmd->op) {
+                    case CMD_READ:
+                        ret = dcihid_read(board->handle, cmd->arg1, &data);
+                        break;
+                    case CMD_READALL:
+                        ret = dcihid_read_all(board->handle, &input);
+                        break;
+                    case CMD_WRITE:
+                        data = cmd->arg2;
+                        ret = dcihid_write(board->handle, cmd->arg1, data);
+                        break;
+                    case CMD_SET:
+                        ret = dcihid_set_bits(board->handle, cmd->arg1, 1 << cmd->arg2, &data);
+                        break;
+                    case CMD_CLEAR:
+                        ret = dcihid_clear_bits(board->handle, cmd->arg1, 1 << cmd->arg2, &data);
+                        break;
+                }
+                break;
+        }
+        elapsed = dcirt_now_ns() - begin;
+        executed++;
+        if (ret != 0) failed++;
+
+        // Report:
+        printf("{\"line\":%d,\"cmd\":\"%s\"", cmd->line, cmd_names[cmd->op]);
+        if (board && cmd->op != CMD_SLEEP && cmd->op != CMD_UNTIL) {
+            printf(",\"board\":");
+            print_json_string(cmd->op == CMD_BOARD ? cmd->name : board->name);
+            printf(",\"type\":%u,\"id\":%u", board->card_type, board->card_id);
+        }
+        if (ret == 0) {
+            switch (cmd->op) {
+                case CMD_READ:
+                case CMD_WRITE:
+                case CMD_SET:
+                case CMD_CLEAR:
+                    printf(",\"port\":%u,\"value\":%u", cmd->arg1, data);
+                    break;
+                case CMD_READALL:
+                    printf(",\"ports\":[");
+                    for (i = 0; i < DCIHID_INPUT_PORTS; i++) printf("%s%u", i ? "," : "", input.port[i]);
+                    printf("],\"adc_index\":%u,\"adc_result\":%u", input.adc_index, input.adc_result);
+                    break;
+            }
+        }
+        printf(",\"status\":\"%s\"", ret == 0 ? "ok" : "error");
+        if (timing) printf(",\"us\":%.1f", elapsed / 1e3);
+        printf("}\n");
+    }
+
+    if (timing) {
+        printf("{\"summary\":true,\"commands\":%llu,\"errors\":%d,\"boards\":%d,\"open_us\":%.1f,\"total_us\":%.1f}\n",
+               (unsigned long long)executed, failed, num_boards, open_ns / 1e3, (dcirt_now_ns() - start) / 1e3);
+    }
+
+    for (i = 0; i < num_boards; i++) dcihid_close(boards[i].handle);
+    free(commands);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+int         batch_run(FILE *script, const char *dev_name, const u_int card_type, const u_int card_id, const int transport,
+                      const int timing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
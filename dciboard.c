@@ -0,0 +1,145 @@
+/*
+ * File:
+ *      dciboard.c
+ *
+ * Description:
+ *      Board descriptors of the DCI USB HID devices from Decision-Computer,
+ *      expanded from the tables of dciboard.h. Lookups by card type and
+ *      port go through an index built on first use.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dciboard.h"
+
+
+/*
+ * tables
+ */
+#define DCIBOARD_CARD_ENTRY(type, adc, description) \
+    { type, adc, description },
+#define DCIBOARD_PORT_ENTRY(type, addr, access, width, inverted, channel, first, description) \
+    { type, addr, access, width, inverted, channel, first, description },
+
+static const struct dciboard_card dciboard_card_table[] = {
+    DCIBOARD_CARDS(DCIBOARD_CARD_ENTRY)
+};
+#define DCIBOARD_NUM_CARDS  (sizeof(dciboard_card_table) / sizeof(dciboard_card_table[0]))
+
+static const struct dciboard_port dciboard_port_table[] = {
+    DCIBOARD_PORTS(DCIBOARD_PORT_ENTRY)
+};
+#define DCIBOARD_NUM_PORTS  (sizeof(dciboard_port_table) / sizeof(dciboard_port_table[0]))
+
+static const char *dciboard_channel_names[] = { NULL, "IN", "OUT", "DIO", "P0D", "P1D" };
+#define DCIBOARD_NUM_CHANNELS (sizeof(dciboard_channel_names) / sizeof(dciboard_channel_names[0]))
+
+/* Position + 1 in the tables, 0 if absent */
+static u_int8_t             dciboard_card_index[DCIBOARD_TYPE_MAX + 1];
+static u_int8_t             dciboard_port_index[DCIBOARD_TYPE_MAX + 1][256];
+static pthread_once_t       dciboard_once = PTHREAD_ONCE_INIT;
+
+
+/*
+ * functions
+ */
+
+static void
+dciboard_build_index(void) {
+    u_int                       i;
+
+    for (i = 0; i < DCIBOARD_NUM_CARDS; i++) {
+        dciboard_card_index[dciboard_card_table[i].card_type] = i + 1;
+    }
+    for (i = 0; i < DCIBOARD_NUM_PORTS; i++) {
+        dciboard_port_index[dciboard_port_table[i].card_type][dciboard_port_table[i].addr] = i + 1;
+    }
+}
+
+const struct dciboard_card *
+dciboard_card(const u_int card_type) {
+    if (card_type > DCIBOARD_TYPE_MAX) return NULL;
+    pthread_once(&dciboard_once, dciboard_build_index);
+    if (dciboard_card_index[card_type] == 0) return NULL;
+    return &dciboard_card_table[dciboard_card_index[card_type] - 1];
+}
+
+const struct dciboard_port *
+dciboard_port(const u_int card_type, const u_int addr) {
+    if (card_type > DCIBOARD_TYPE_MAX || addr > 0xFF) return NULL;
+    pthread_once(&dciboard_once, dciboard_build_index);
+    if (dciboard_port_index[card_type][addr] == 0) return NULL;
+    return &dciboard_port_table[dciboard_port_index[card_type][addr] - 1];
+}
+
+/*
+ * All ports, grouped by card type in the order of dciboard_card()
+ */
+const struct dciboard_port *
+dciboard_ports(u_int32_t *count) {
+    *count = DCIBOARD_NUM_PORTS;
+    return dciboard_port_table;
+}
+
+/*
+ * DCIBOARD_READ/WRITE/CONFIG flags of a port, 0 if the card has no such port
+ */
+u_int
+dciboard_access(const u_int card_type, const u_int addr) {
+    const struct dciboard_port  *port = dciboard_port(card_type, addr);
+
+    return port ? port->access : 0;
+}
+
+/*
+ * Port and bit of a named channel, as OUT17 = (DCIBOARD_CH_OUT, 17)
+ */
+int32_t
+dciboard_channel(const u_int card_type, const u_int channel, const u_int number, u_int8_t *addr, u_int8_t *bit) {
+    const struct dciboard_port  *port;
+    u_int                       i;
+
+    for (i = 0; i < DCIBOARD_NUM_PORTS; i++) {
+        port = &dciboard_port_table[i];
+        if (port->card_type != card_type || port->channel != channel) continue;
+        if (number < port->first || number >= (u_int)port->first + port->width) continue;
+        if (addr) *addr = port->addr;
+        if (bit) *bit = number - port->first;
+        return 0;
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+/*
+ * Splits a channel name as OUT17 into (DCIBOARD_CH_OUT, 17)
+ */
+int32_t
+dciboard_parse_channel(const char *name, u_int *channel, u_int *number) {
+    const char                  *digits;
+    char                        *end;
+    size_t                      len;
+    u_int                       i;
+
+    for (i = 1; i < DCIBOARD_NUM_CHANNELS; i++) {
+        len = strlen(dciboard_channel_names[i]);
+        if (strncasecmp(name, dciboard_channel_names[i], len) != 0) continue;
+        digits = name + len;
+        if (*digits < '0' || *digits > '9') continue;
+        *number = strtoul(digits, &end, 10);
+        if (*end != '\0') break;
+        *channel = i;
+        return 0;
+    }
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,149 @@
+#ifndef _DCIBOARD_H_
+#define _DCIBOARD_H_
+
+#include <sys/types.h>
+
+#include "dcihid.h"
+
+/*
+ * Board descriptors. What every card type offers is listed once in the
+ * tables below, and expanded into the C tables of dciboard.c, the
+ * constexpr tables of dciboard.hpp and the help of DecisionUsbdio.
+ */
+
+/*
+ * port access
+ */
+#define DCIBOARD_READ       0x01    // Listed for -r
+#define DCIBOARD_WRITE      0x02    // Listed for -w
+#define DCIBOARD_CONFIG     0x04    // Jumpers and defaults, not driven from outside
+
+/*
+ * channel names, OUT17 is channel 17 of DCIBOARD_CH_OUT
+ */
+#define DCIBOARD_CH_NONE    0
+#define DCIBOARD_CH_IN      1       // INnn
+#define DCIBOARD_CH_OUT     2       // OUTnn
+#define DCIBOARD_CH_DIO     3       // DIOn
+#define DCIBOARD_CH_P0D     4       // P0Dnn
+#define DCIBOARD_CH_P1D     5       // P1Dnn
+
+#define DCIBOARD_TYPE_MAX   0x10    // Highest card type
+
+/*
+ * X(card_type, adc, description)
+ */
+#define DCIBOARD_CARDS(X) \
+    X(USB_16PIO,    0, "USB 16 Channel Photo Input / 16 Channel Photo Output") \
+    X(USB_LABKIT,   1, "USB LABKIT") \
+    X(USB_16PR,     0, "USB 16 Channel Photo Input / 16 Channel Relay Output") \
+    X(USB_STARTER,  1, "USB STARTER") \
+    X(USB_8PR,      0, "USB 8 Channel Photo Input / 8 Channel Relay Output") \
+    X(USB_4PR,      0, "USB 4 Channel Photo Input / 4 Channel Relay Output") \
+    X(USB_8PI,      0, "USB 8 Channel Photo Input") \
+    X(USB_8RO,      0, "USB 8 Channel Relay Output") \
+    X(USB_16PI,     0, "USB 16 Channel Photo Input") \
+    X(USB_16RO,     0, "USB 16 Channel Relay Output") \
+    X(USB_32PI,     0, "USB 32 Channel Photo Input") \
+    X(USB_32RO,     0, "USB 32 Channel Relay Output") \
+    X(USB_IND,      0, "USB Industry") \
+    X(USB_M_4IO,    0, "USB Mini 4 I/O")
+
+/*
+ * X(card_type, addr, access, width, inverted, channel, first, description)
+ *      width       channels on the port, from bit 0
+ *      inverted    the input report carries the complement of the port
+ *      first       channel of bit 0
+ */
+#define DCIBOARD_PORTS(X) \
+    X(USB_16PIO,    0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_16PIO,    0x01, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   8,  "IN15 to IN08") \
+    X(USB_16PIO,    0x02, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_16PIO,    0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  8,  "OUT15 to OUT08") \
+    X(USB_LABKIT,   0x02, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_P0D,  0,  "P0D07 to P0D00") \
+    X(USB_LABKIT,   0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_P1D,  0,  "P1D07 to P1D00") \
+    X(USB_16PR,     0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_16PR,     0x01, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   8,  "IN15 to IN08") \
+    X(USB_16PR,     0x02, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_16PR,     0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  8,  "OUT15 to OUT08") \
+    X(USB_STARTER,  0x02, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_P0D,  0,  "P0D07 to P0D00") \
+    X(USB_STARTER,  0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_P1D,  0,  "P1D07 to P1D00") \
+    X(USB_8PR,      0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_8PR,      0x01, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_8PR,      0x02, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_DIO,  0,  "DIO7 to DIO0") \
+    X(USB_8PR,      0x03, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_DIO,  8,  "DIO15 to DIO8") \
+    X(USB_8PR,      0x10, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "JP9/JP10 Settings") \
+    X(USB_4PR,      0x00, DCIBOARD_READ,                    4, 1, DCIBOARD_CH_IN,   0,  "IN03 to IN00") \
+    X(USB_4PR,      0x02, DCIBOARD_WRITE,                   4, 1, DCIBOARD_CH_OUT,  0,  "OUT03 to OUT00") \
+    X(USB_8PI,      0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_8RO,      0x02, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_16PI,     0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_16PI,     0x01, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   8,  "IN15 to IN08") \
+    X(USB_16RO,     0x02, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_16RO,     0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  8,  "OUT15 to OUT08") \
+    X(USB_32PI,     0x00, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   0,  "IN07 to IN00") \
+    X(USB_32PI,     0x01, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   8,  "IN15 to IN08") \
+    X(USB_32PI,     0x02, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   16, "IN23 to IN16") \
+    X(USB_32PI,     0x03, DCIBOARD_READ,                    8, 1, DCIBOARD_CH_IN,   24, "IN31 to IN24") \
+    X(USB_32RO,     0x00, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  0,  "OUT07 to OUT00") \
+    X(USB_32RO,     0x01, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  8,  "OUT15 to OUT08") \
+    X(USB_32RO,     0x02, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  16, "OUT23 to OUT16") \
+    X(USB_32RO,     0x03, DCIBOARD_WRITE,                   8, 1, DCIBOARD_CH_OUT,  24, "OUT31 to OUT24") \
+    X(USB_IND,      0x00, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 0") \
+    X(USB_IND,      0x01, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 1") \
+    X(USB_IND,      0x02, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 2") \
+    X(USB_IND,      0x03, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 3") \
+    X(USB_IND,      0x04, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 4") \
+    X(USB_IND,      0x05, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 5") \
+    X(USB_IND,      0x06, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 6") \
+    X(USB_IND,      0x07, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "Port 7") \
+    X(USB_IND,      0x08, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "DIO") \
+    X(USB_IND,      0x0D, DCIBOARD_READ | DCIBOARD_WRITE,   8, 1, DCIBOARD_CH_NONE, 0,  "IOCONFIG") \
+    X(USB_IND,      0x10, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 0 default value") \
+    X(USB_IND,      0x11, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 1 default value") \
+    X(USB_IND,      0x12, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 2 default value") \
+    X(USB_IND,      0x13, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 3 default value") \
+    X(USB_IND,      0x14, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 4 default value") \
+    X(USB_IND,      0x15, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 5 default value") \
+    X(USB_IND,      0x16, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 6 default value") \
+    X(USB_IND,      0x17, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port 7 default value") \
+    X(USB_IND,      0x18, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Port DIO default value") \
+    X(USB_IND,      0x19, DCIBOARD_READ | DCIBOARD_CONFIG,  8, 1, DCIBOARD_CH_NONE, 0,  "Input/output default setting") \
+    X(USB_M_4IO,    0x00, DCIBOARD_READ,                    4, 1, DCIBOARD_CH_IN,   0,  "IN03 to IN00") \
+    X(USB_M_4IO,    0x02, DCIBOARD_WRITE,                   4, 1, DCIBOARD_CH_OUT,  0,  "OUT03 to OUT00")
+
+struct dciboard_card {
+    u_int8_t    card_type;
+    u_int8_t    adc;                        // Usages 6 to 8 of the input report carry the ADC
+    const char  *description;
+};
+
+struct dciboard_port {
+    u_int8_t    card_type;
+    u_int8_t    addr;
+    u_int8_t    access;                     // DCIBOARD_READ, DCIBOARD_WRITE, DCIBOARD_CONFIG
+    u_int8_t    width;
+    u_int8_t    inverted;
+    u_int8_t    channel;                    // DCIBOARD_CH_*
+    u_int8_t    first;
+    const char  *description;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+const struct dciboard_card *dciboard_card(const u_int card_type);
+const struct dciboard_port *dciboard_port(const u_int card_type, const u_int addr);
+const struct dciboard_port *dciboard_ports(u_int32_t *count);
+u_int       dciboard_access(const u_int card_type, const u_int addr);
+int32_t     dciboard_channel(const u_int card_type, const u_int channel, const u_int number, u_int8_t *addr, u_int8_t *bit);
+int32_t     dciboard_parse_channel(const char *name, u_int *channel, u_int *number);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
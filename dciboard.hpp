@@ -0,0 +1,261 @@
+#ifndef _DCIBOARD_HPP_
+#define _DCIBOARD_HPP_
+
+/*
+ * Typed C++ API over dcihid.h, header only, C++14 or later.
+ *
+ *      dci::Board<USB_32RO> relays(0);
+ *      relays.write<0x02>(0x0F);               // Port checked at compile time
+ *      relays.set_output<17>(true);            // OUT17, port 0x02 bit 1
+ *      relays.write32<0>(0x0000FFFF);          // OUT00 to OUT31, one report per port
+ *
+ * Ports and channels come from the tables of dciboard.h: a port the card
+ * does not have, or can not write, does not compile. Calls return 0 or
+ * -1 like the C library.
+ */
+
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dciboard.h"
+
+namespace dci {
+
+#define DCIBOARD_HPP_CARD(type, adc, description)   { type, adc, description },
+#define DCIBOARD_HPP_PORT(type, addr, access, width, inverted, channel, first, description) \
+    { type, addr, access, width, inverted, channel, first, description },
+
+constexpr struct dciboard_card cards[] = { DCIBOARD_CARDS(DCIBOARD_HPP_CARD) };
+constexpr struct dciboard_port ports[] = { DCIBOARD_PORTS(DCIBOARD_HPP_PORT) };
+constexpr unsigned num_cards = sizeof(cards) / sizeof(cards[0]);
+constexpr unsigned num_ports = sizeof(ports) / sizeof(ports[0]);
+
+#undef DCIBOARD_HPP_CARD
+#undef DCIBOARD_HPP_PORT
+
+constexpr bool
+card_exists(const unsigned type) {
+    for (unsigned i = 0; i < num_cards; i++) {
+        if (cards[i].card_type == type) return true;
+    }
+    return false;
+}
+
+constexpr unsigned
+port_access(const unsigned type, const unsigned addr) {
+    for (unsigned i = 0; i < num_ports; i++) {
+        if (ports[i].card_type == type && ports[i].addr == addr) return ports[i].access;
+    }
+    return 0;
+}
+
+/* Index in ports[] of the port carrying a channel, -1 if none */
+constexpr int
+channel_port(const unsigned type, const unsigned channel, const unsigned number) {
+    for (unsigned i = 0; i < num_ports; i++) {
+        if (ports[i].card_type == type && ports[i].channel == channel &&
+            number >= ports[i].first && number < (unsigned)ports[i].first + ports[i].width) return i;
+    }
+    return -1;
+}
+
+/* Port carrying a channel, the first port if none, checked by the callers */
+constexpr const struct dciboard_port &
+channel_entry(const unsigned type, const unsigned channel, const unsigned number) {
+    return ports[channel_port(type, channel, number) < 0 ? 0 : channel_port(type, channel, number)];
+}
+
+/* Every channel from first on is on a port with the given access */
+constexpr bool
+channels_have(const unsigned type, const unsigned channel, const unsigned first, const unsigned bits, const unsigned access) {
+    for (unsigned n = first; n < first + bits; n++) {
+        int i = channel_port(type, channel, n);
+        if (i < 0 || (ports[i].access & access) != access) return false;
+    }
+    return true;
+}
+
+/* Every channel from first on comes with the input report of dcihid_read_all() */
+constexpr bool
+channels_in_report(const unsigned type, const unsigned channel, const unsigned first, const unsigned bits) {
+    for (unsigned n = first; n < first + bits; n++) {
+        int i = channel_port(type, channel, n);
+        if (i < 0 || ports[i].addr >= DCIHID_INPUT_PORTS) return false;
+    }
+    return true;
+}
+
+template <unsigned Type>
+class Board {
+    static_assert(card_exists(Type), "unknown card type");
+
+public:
+    explicit Board(const u_int card_id, const char *dev_name = nullptr, const int transport = DCIHID_TRANSPORT_HIDDEV) {
+        char devname[64] = "";
+
+        if (dev_name) {
+            handle_ = dcihid_open_transport(dev_name, Type, card_id, transport);
+        } else if (transport == DCIHID_TRANSPORT_SIM || dcihid_lookup(Type, card_id, devname, sizeof(devname)) == 0) {
+            handle_ = dcihid_open_transport(devname, Type, card_id, transport);
+        }
+    }
+
+    ~Board() {
+        if (handle_) dcihid_close(handle_);
+    }
+
+    Board(const Board &) = delete;
+    Board &operator=(const Board &) = delete;
+
+    Board(Board &&other) noexcept : handle_(other.handle_) {
+        other.handle_ = 0;
+    }
+
+    explicit operator bool() const {
+        return handle_ != 0;
+    }
+
+    u_int64_t handle() const {
+        return handle_;
+    }
+
+    /*
+     * ports, outputs can be read back
+     */
+    template <unsigned Addr>
+    int32_t read(u_int8_t &value) {
+        static_assert(port_access(Type, Addr) != 0, "the card has no such port");
+        return dcihid_read(handle_, Addr, &value);
+    }
+
+    template <unsigned Addr>
+    int32_t write(const u_int8_t value) {
+        static_assert(port_access(Type, Addr) & DCIBOARD_WRITE, "the port is not writable on this card");
+        return dcihid_write(handle_, Addr, value);
+    }
+
+    /*
+     * named channels, as OUT17 = set<DCIBOARD_CH_OUT, 17>
+     */
+    template <unsigned Channel, unsigned Number>
+    int32_t set(const bool on) {
+        static_assert(channels_have(Type, Channel, Number, 1, DCIBOARD_WRITE), "the card has no such writable channel");
+        constexpr const struct dciboard_port &port = channel_entry(Type, Channel, Number);
+        constexpr u_int8_t mask = 1 << (Number - port.first);
+        return dcihid_write_masked(handle_, port.addr, mask, on ? mask : 0, nullptr);
+    }
+
+    template <unsigned Channel, unsigned Number>
+    int32_t get(bool &on) {
+        static_assert(channels_have(Type, Channel, Number, 1, 0), "the card has no such channel");
+        constexpr const struct dciboard_port &port = channel_entry(Type, Channel, Number);
+        u_int8_t value;
+
+        if (dcihid_read(handle_, port.addr, &value) != 0) return -1;
+        on = (value >> (Number - port.first)) & 1;
+        return 0;
+    }
+
+    template <unsigned Number>
+    int32_t set_output(const bool on) {
+        return set<DCIBOARD_CH_OUT, Number>(on);
+    }
+
+    template <unsigned Number>
+    int32_t get_input(bool &on) {
+        return get<DCIBOARD_CH_IN, Number>(on);
+    }
+
+    /*
+     * words of consecutive channels. Writes send one report per port,
+     * ports written in part keep their other bits. Reads take a single
+     * input report when all the ports are in it.
+     */
+    template <unsigned Channel, unsigned First, unsigned Bits>
+    int32_t write_word(const u_int32_t value) {
+        static_assert(Bits > 0 && Bits <= 32, "words are 1 to 32 channels");
+        static_assert(channels_have(Type, Channel, First, Bits, DCIBOARD_WRITE), "the card has no such writable channels");
+        struct dcihid_write_op ops[32];
+        u_int32_t count = 0, i;
+
+        for (i = 0; i < num_ports; i++) {
+            const struct dciboard_port &port = ports[i];
+            unsigned lo, hi;
+            u_int8_t mask, bits;
+
+            if (port.card_type != Type || port.channel != Channel) continue;
+            lo = port.first > First ? port.first : First;
+            hi = port.first + port.width < First + Bits ? port.first + port.width : First + Bits;
+            if (lo >= hi) continue;
+            mask = ((1U << (hi - lo)) - 1) << (lo - port.first);
+            bits = ((value >> (lo - First)) << (lo - port.first)) & mask;
+            if (mask == (u_int8_t)((1U << port.width) - 1)) {
+                ops[count].addr = port.addr;
+                ops[count].data = bits;
+                count++;
+            } else if (dcihid_write_masked(handle_, port.addr, mask, bits, nullptr) != 0) {
+                return -1;
+            }
+        }
+        return count ? dcihid_write_multi(handle_, ops, count) : 0;
+    }
+
+    template <unsigned Channel, unsigned First, unsigned Bits>
+    int32_t read_word(u_int32_t &value) {
+        static_assert(Bits > 0 && Bits <= 32, "words are 1 to 32 channels");
+        static_assert(channels_have(Type, Channel, First, Bits, 0), "the card has no such channels");
+        struct dcihid_input input;
+        u_int32_t i;
+        u_int8_t data;
+
+        if (channels_in_report(Type, Channel, First, Bits) && dcihid_read_all(handle_, &input) != 0) return -1;
+        value = 0;
+        for (i = 0; i < num_ports; i++) {
+            const struct dciboard_port &port = ports[i];
+            unsigned lo, hi;
+
+            if (port.card_type != Type || port.channel != Channel) continue;
+            lo = port.first > First ? port.first : First;
+            hi = port.first + port.width < First + Bits ? port.first + port.width : First + Bits;
+            if (lo >= hi) continue;
+            if (channels_in_report(Type, Channel, First, Bits)) {
+                data = input.port[port.addr];
+            } else if (dcihid_read(handle_, port.addr, &data) != 0) {
+                return -1;
+            }
+            value |= (u_int32_t)((data >> (lo - port.first)) & ((1U << (hi - lo)) - 1)) << (lo - First);
+        }
+        return 0;
+    }
+
+    template <unsigned First>
+    int32_t write16(const u_int16_t value) {
+        return write_word<DCIBOARD_CH_OUT, First, 16>(value);
+    }
+
+    template <unsigned First>
+    int32_t write32(const u_int32_t value) {
+        return write_word<DCIBOARD_CH_OUT, First, 32>(value);
+    }
+
+    template <unsigned First>
+    int32_t read16(u_int16_t &value) {
+        u_int32_t word;
+
+        if (read_word<DCIBOARD_CH_IN, First, 16>(word) != 0) return -1;
+        value = (u_int16_t)word;
+        return 0;
+    }
+
+    template <unsigned First>
+    int32_t read32(u_int32_t &value) {
+        return read_word<DCIBOARD_CH_IN, First, 32>(value);
+    }
+
+private:
+    u_int64_t handle_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * File:
+ *      dciboard_check.cpp
+ *
+ * Description:
+ *      Build check of dciboard.hpp, run by 'make check'. Drives a simulated
+ *      USB 32RO through the typed calls on the sim transport and compares
+ *      the outputs the board received. Built with -DDCIBOARD_CHECK_FAIL it
+ *      writes an input port of a USB LABKIT and must not compile.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcisim.h"
+#include "dciboard.hpp"
+
+#define CHECK_CARD_ID   0
+
+static int
+check_output(const int sim, const u_int8_t addr, const u_int8_t expected)
+{
+    u_int8_t    value;
+
+    if (dcisim_get_output(sim, addr, &value) != 0 || value != expected) {
+        fprintf(stderr, "dciboard_check: port 0x%02X is 0x%02X, expected 0x%02X\n", addr, value, expected);
+        return -1;
+    }
+    return 0;
+}
+
+int
+main(void)
+{
+    char        devname[64];
+    int         sim, ret = 0;
+    u_int8_t    value = 0;
+
+    sim = dcisim_create(USB_32RO, CHECK_CARD_ID, devname, sizeof(devname));
+    if (sim < 0) {
+        perror("dciboard_check: dcisim_create");
+        return 1;
+    }
+
+    dci::Board<USB_32RO> relays(CHECK_CARD_ID, nullptr, DCIHID_TRANSPORT_SIM);
+    if (!relays) {
+        fprintf(stderr, "dciboard_check: can not open the simulated USB 32RO\n");
+        return 1;
+    }
+
+    if (relays.write<0x02>(0x0F) != 0 || check_output(sim, 0x02, 0x0F) != 0) ret = 1;
+    if (relays.read<0x02>(value) != 0 || value != 0x0F) {
+        fprintf(stderr, "dciboard_check: port 0x02 reads back 0x%02X, expected 0x0F\n", value);
+        ret = 1;
+    }
+    if (relays.set_output<20>(true) != 0 || check_output(sim, 0x02, 0x1F) != 0) ret = 1;
+    if (relays.write32<0>(0x0000FFFF) != 0 ||
+        check_output(sim, 0x00, 0xFF) != 0 || check_output(sim, 0x01, 0xFF) != 0 ||
+        check_output(sim, 0x02, 0x00) != 0 || check_output(sim, 0x03, 0x00) != 0) ret = 1;
+
+#ifdef DCIBOARD_CHECK_FAIL
+    /* Port 0x02 of the LABKIT is an input, the write must not compile */
+    dci::Board<USB_LABKIT> labkit(CHECK_CARD_ID, nullptr, DCIHID_TRANSPORT_SIM);
+    labkit.write<0x02>(0xA5);
+#endif
+
+    printf("check=dciboard transport=sim consistent=%s\n", ret == 0 ? "yes" : "no");
+    return ret;
+}
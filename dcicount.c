@@ -0,0 +1,289 @@
+/*
+ * File:
+ *      dcicount.c
+ *
+ * Description:
+ *      Software edge counters for the input channels of DCI USB HID
+ *      devices from Decision-Computer. A thread reads the input report
+ *      at a fixed rate on absolute deadlines, debounces every channel
+ *      and counts its rising and falling edges.
+ *
+ *      The 32 channels are debounced at once, one bit per channel: the
+ *      samples every channel has spent away from its debounced level are
+ *      kept as a bit-sliced counter, plane k holding bit k of the count
+ *      of all channels, so a sample costs a few word operations whatever
+ *      the number of channels. Only the channels with an edge are then
+ *      walked to update their 64-bit counters.
+ *
+ *      Counters are read under a mutex from the values of the last
+ *      sample, without a USB transfer.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcicount.h"
+#include "dcirt.h"
+
+
+/*
+ * configuration
+ */
+#define DCICOUNT_PLANES         16      // Bits of the debounce counters, DCICOUNT_DEBOUNCE_MAX = 2^16 - 1
+#define DCICOUNT_PERIOD_SHIFT   3       // Frequency smoothing, each period weighs 1/8
+
+
+/*
+ * type declarations
+ */
+struct dcicount_counter {
+    u_int64_t                   dcihid_handle;
+    u_int32_t                   rate;
+    pthread_t                   thread;
+    atomic_int                  stop;
+
+    /* Debounce state, only used by the sampling thread */
+    u_int32_t                   window[DCICOUNT_PLANES];        // Debounce window of every channel, bit-sliced
+    u_int32_t                   count[DCICOUNT_PLANES];         // Samples away from the debounced level, bit-sliced
+    int                         primed;
+
+    /* Counters, under lock */
+    pthread_mutex_t             lock;
+    u_int64_t                   timestamp;
+    u_int32_t                   state;
+    u_int64_t                   rising[DCICOUNT_CHANNELS];
+    u_int64_t                   falling[DCICOUNT_CHANNELS];
+    u_int64_t                   last_rise[DCICOUNT_CHANNELS];   // Time of the last rising edge, in ns
+    u_int64_t                   period[DCICOUNT_CHANNELS];      // Smoothed time between rising edges, in ns
+    u_int64_t                   samples;
+    u_int64_t                   missed;
+    u_int64_t                   errors;
+};
+typedef struct dcicount_counter *dcicount_counter_t;
+
+
+/*
+ * functions
+ */
+
+/*
+ * Runs one sample through the debouncer, returns the channels whose
+ * debounced level changed
+ */
+static u_int32_t
+dcicount_debounce(dcicount_counter_t counter, const u_int32_t raw) {
+    u_int32_t                   diff = raw ^ counter->state;
+    u_int32_t                   carry = diff, equal = ~0U, reached, bit;
+    int                         k;
+
+    for (k = 0; k < DCICOUNT_PLANES; k++) {
+        /* Count up the channels away from their level, clear the others */
+        bit = counter->count[k] & diff;
+        counter->count[k] = bit ^ carry;
+        carry &= bit;
+        equal &= ~(counter->count[k] ^ counter->window[k]);
+    }
+    reached = diff & equal;
+
+    for (k = 0; k < DCICOUNT_PLANES; k++) counter->count[k] &= ~reached;
+    return reached;
+}
+
+/*
+ * Counts the edges of the channels in changed, under lock
+ */
+static void
+dcicount_edges(dcicount_counter_t counter, u_int32_t changed, const u_int64_t now) {
+    u_int32_t                   rising = changed & ~counter->state;
+    u_int32_t                   falling = changed & counter->state;
+    u_int64_t                   delta;
+    int                         n;
+
+    counter->state ^= changed;
+    while (falling) {
+        n = __builtin_ctz(falling);
+        falling &= falling - 1;
+        counter->falling[n]++;
+    }
+    while (rising) {
+        n = __builtin_ctz(rising);
+        rising &= rising - 1;
+        if (counter->rising[n]++) {
+            delta = now - counter->last_rise[n];
+            if (counter->period[n]) {
+                counter->period[n] += ((int64_t)delta - (int64_t)counter->period[n]) >> DCICOUNT_PERIOD_SHIFT;
+            } else {
+                counter->period[n] = delta;
+            }
+        }
+        counter->last_rise[n] = now;
+    }
+}
+
+static void *
+dcicount_run(void *arg) {
+    dcicount_counter_t          counter = (dcicount_counter_t)arg;
+    struct dcihid_input         input;
+    u_int64_t                   period = NSEC_PER_SEC / counter->rate;
+    u_int64_t                   next, now_ns, late;
+    u_int32_t                   raw, changed;
+
+    next = dcirt_now_ns();
+
+    while (!atomic_load_explicit(&counter->stop, memory_order_relaxed)) {
+        dcirt_sleep_until(next);
+
+        if (dcihid_read_all(counter->dcihid_handle, &input) != 0) {
+            pthread_mutex_lock(&counter->lock);
+            counter->errors++;
+            pthread_mutex_unlock(&counter->lock);
+        } else {
+            now_ns = dcirt_now_ns();
+            raw = input.port[0] | (input.port[1] << 8) | (input.port[2] << 16) | ((u_int32_t)input.port[3] << 24);
+
+            pthread_mutex_lock(&counter->lock);
+            if (!counter->primed) {
+                /* The first sample sets the levels, it is not an edge */
+                counter->state = raw;
+                counter->primed = 1;
+            } else if ((changed = dcicount_debounce(counter, raw))) {
+                dcicount_edges(counter, changed, now_ns);
+            }
+            counter->timestamp = now_ns;
+            counter->samples++;
+            pthread_mutex_unlock(&counter->lock);
+        }
+
+        if ((late = dcirt_next_period(&next, period))) {
+            pthread_mutex_lock(&counter->lock);
+            counter->missed += late;
+            pthread_mutex_unlock(&counter->lock);
+        }
+    }
+    return NULL;
+}
+
+u_int64_t
+dcicount_start(const u_int64_t dcihid_handle, const struct dcicount_config *config) {
+    dcicount_counter_t          counter;
+    u_int64_t                   window;
+    int                         n, k;
+
+    if (config->rate == 0 || config->rate > NSEC_PER_SEC) {
+        fprintf(stderr, "dcicount: invalid rate\n");
+        return 0;
+    }
+
+    counter = (dcicount_counter_t)calloc(1, sizeof(struct dcicount_counter));
+    if (counter == NULL) return 0;
+    counter->dcihid_handle = dcihid_handle;
+    counter->rate = config->rate;
+    atomic_init(&counter->stop, 0);
+    pthread_mutex_init(&counter->lock, NULL);
+
+    /* A level is taken after ceil(debounce * rate) samples, at least one */
+    for (n = 0; n < DCICOUNT_CHANNELS; n++) {
+        window = ((u_int64_t)config->debounce_us[n] * config->rate + 999999) / 1000000;
+        if (window < 1) window = 1;
+        if (window > DCICOUNT_DEBOUNCE_MAX) {
+            fprintf(stderr, "dcicount: debounce of channel %d longer than %u samples\n", n, DCICOUNT_DEBOUNCE_MAX);
+            goto error;
+        }
+        for (k = 0; k < DCICOUNT_PLANES; k++) {
+            if (window & (1 << k)) counter->window[k] |= 1U << n;
+        }
+    }
+
+    if (pthread_create(&counter->thread, NULL, dcicount_run, counter) != 0) goto error;
+    return (u_int64_t)counter;
+
+error:
+    pthread_mutex_destroy(&counter->lock);
+    free(counter);
+    return 0;
+}
+
+/*
+ * Rising edges per second. A channel that stopped toggling decays from
+ * the time since its last rising edge instead of keeping its last rate.
+ */
+static double
+dcicount_frequency(const dcicount_counter_t counter, const int n) {
+    u_int64_t                   period = counter->period[n];
+    u_int64_t                   since = counter->timestamp - counter->last_rise[n];
+
+    if (counter->rising[n] < 2 || period == 0) return 0.0;
+    return (double)NSEC_PER_SEC / (since > period ? since : period);
+}
+
+int32_t
+dcicount_read(const u_int64_t counter_handle, struct dcicount_counters *counters) {
+    dcicount_counter_t          counter = (dcicount_counter_t)counter_handle;
+    int                         n;
+
+    pthread_mutex_lock(&counter->lock);
+    counters->timestamp = counter->timestamp;
+    counters->state = counter->state;
+    memcpy(counters->rising, counter->rising, sizeof(counters->rising));
+    memcpy(counters->falling, counter->falling, sizeof(counters->falling));
+    for (n = 0; n < DCICOUNT_CHANNELS; n++) counters->frequency[n] = dcicount_frequency(counter, n);
+    counters->samples = counter->samples;
+    counters->missed = counter->missed;
+    counters->errors = counter->errors;
+    pthread_mutex_unlock(&counter->lock);
+
+    return 0;
+}
+
+int32_t
+dcicount_channel(const u_int64_t counter_handle, const u_int32_t channel, u_int64_t *rising, u_int64_t *falling,
+                 double *frequency) {
+    dcicount_counter_t          counter = (dcicount_counter_t)counter_handle;
+
+    if (channel >= DCICOUNT_CHANNELS) return -1;
+    pthread_mutex_lock(&counter->lock);
+    if (rising) *rising = counter->rising[channel];
+    if (falling) *falling = counter->falling[channel];
+    if (frequency) *frequency = dcicount_frequency(counter, channel);
+    pthread_mutex_unlock(&counter->lock);
+
+    return 0;
+}
+
+int32_t
+dcicount_reset(const u_int64_t counter_handle) {
+    dcicount_counter_t          counter = (dcicount_counter_t)counter_handle;
+
+    pthread_mutex_lock(&counter->lock);
+    memset(counter->rising, 0, sizeof(counter->rising));
+    memset(counter->falling, 0, sizeof(counter->falling));
+    memset(counter->period, 0, sizeof(counter->period));
+    counter->samples = 0;
+    counter->missed = 0;
+    counter->errors = 0;
+    pthread_mutex_unlock(&counter->lock);
+
+    return 0;
+}
+
+int32_t
+dcicount_stop(const u_int64_t counter_handle) {
+    dcicount_counter_t          counter = (dcicount_counter_t)counter_handle;
+
+    atomic_store(&counter->stop, 1);
+    pthread_join(counter->thread, NULL);
+    pthread_mutex_destroy(&counter->lock);
+    free(counter);
+
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _DCICOUNT_H_
+#define _DCICOUNT_H_
+
+#include <sys/types.h>
+
+/*
+ * channel n is bit n % 8 of input port n / 8, ports 0x00 to 0x03
+ */
+#define DCICOUNT_CHANNELS       32
+#define DCICOUNT_DEBOUNCE_MAX   65535       // Longest debounce window, in samples
+
+/*
+ * counter configuration
+ */
+struct dcicount_config {
+    u_int32_t   rate;                               // Samples per second
+    u_int32_t   debounce_us[DCICOUNT_CHANNELS];     // Time an input has to hold a new level, 0 to count every change
+};
+
+/*
+ * counters, as returned by dcicount_read()
+ */
+struct dcicount_counters {
+    u_int64_t   timestamp;                          // CLOCK_MONOTONIC time of the last sample, in ns
+    u_int32_t   state;                              // Debounced level of every channel
+    u_int64_t   rising[DCICOUNT_CHANNELS];          // Debounced rising edges
+    u_int64_t   falling[DCICOUNT_CHANNELS];         // Debounced falling edges
+    double      frequency[DCICOUNT_CHANNELS];       // Rising edges per second, 0 until two were seen
+    u_int64_t   samples;                            // Samples taken
+    u_int64_t   missed;                             // Deadlines missed, sample periods skipped
+    u_int64_t   errors;                             // Failed reads
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+u_int64_t   dcicount_start(const u_int64_t dcihid_handle, const struct dcicount_config *config);
+int32_t     dcicount_read(const u_int64_t counter_handle, struct dcicount_counters *counters);
+int32_t     dcicount_channel(const u_int64_t counter_handle, const u_int32_t channel, u_int64_t *rising, u_int64_t *falling,
+                             double *frequency);
+int32_t     dcicount_reset(const u_int64_t counter_handle);
+int32_t     dcicount_stop(const u_int64_t counter_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,9 +21,22 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <linux/hiddev.h>
+#include <linux/hidraw.h>
 #include <errno.h>
+#include <limits.h>
+#include <glob.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 
 #include "dcihid.h"
+#include "dciboard.h"
+#include "dcisim.h"
 
 
 /*
@@ -61,14 +74,102 @@ enum {
 #define DCIHID_16PR_VID     0x10C4
 #define DCIHID_16PR_PID     0x81B9
 
+/*
+ * device index
+ */
+#define DCIHID_INDEX_FILE   "/run/dcihid.index"
+#define DCIHID_INDEX_ENV    "DCIHID_INDEX"
+#define DCIHID_NODES_MAX    64
+
+/*
+ * output shadow
+ */
+#define DCIHID_PORTS_MAX    256
+#define DCIHID_SHADOW_MAGIC 0x44435332  // "DCS2", with the output report
+#define DCIHID_SHADOW_FILE  "/dev/shm/dcihid-%02X-%u.shadow"
+
+/*
+ * write coalescing
+ */
+#define NSEC_PER_SEC        1000000000ULL
+
+/*
+ * input watching
+ */
+#define DCIHID_WATCH_EVENTS 64
+
+/*
+ * hotplug, boards are recovered on the kernel uevents of their nodes
+ */
+#define DCIHID_HOTPLUG_BUFFER       8192    // Largest uevent
+#define DCIHID_HOTPLUG_NODES        16      // Nodes added and not claimed yet
+#define DCIHID_HOTPLUG_RETRY_MS     10      // Wait before trying a node that was not accessible again
+#define DCIHID_HOTPLUG_GIVEUP_MS    5000    // Nodes still not accessible after this are dropped
+
+/*
+ * handle pool
+ */
+#define DCIHID_POOL_MAX     64
+
+/*
+ * hidraw transport, reports are prefixed by their ID on GINPUT and write()
+ */
+#define DCIHID_HIDRAW_REPORT_MAX    64
+#define DCIHID_HIDRAW_SYSFS         "/sys/dev/char/%u:%u/device"
+
 
 /*
  * type declarations
  */
+
+/*
+ * Last value written to every output port, either private to the handle
+ * or mapped from a shared memory file so several processes agree on it.
+ */
+struct dcihid_shadow {
+    u_int32_t                   magic;
+    u_int32_t                   busnum;
+    u_int32_t                   devnum;
+    pthread_mutex_t             lock;
+    u_int8_t                    valid[DCIHID_PORTS_MAX / 8];
+    u_int8_t                    value[DCIHID_PORTS_MAX];
+    int32_t                     report[DCIHID_REPORT_OUTPUT_MAX];   // Output usages besides address and data, as read at open
+};
+
+/*
+ * Writes held back per port while coalescing, sent at the end of the
+ * window or on dcihid_flush(). Under the lock of the handle.
+ */
+struct dcihid_coalesce {
+    u_int64_t                   window_ns;                      // 0 to send on dcihid_flush() only
+    u_int8_t                    pending[DCIHID_PORTS_MAX / 8];
+    u_int8_t                    value[DCIHID_PORTS_MAX];
+    u_int64_t                   deadline;                       // End of the window opened by the first pending write
+    pthread_t                   thread;
+    pthread_cond_t              cond;
+    int                         stop;
+    struct dcihid_coalesce_stats stats;
+};
+
+/*
+ * How reports reach the board, see dcihid_open_transport()
+ */
+struct dcihid_dev;
+struct dcihid_transport {
+    int                         id;
+    int                         open_flags;
+    int                         (*identify)(const int fd, struct hiddev_devinfo *device_info);
+    int32_t                     (*send)(struct dcihid_dev *dcihid_dev, const u_int32_t addr, const u_int8_t data);
+    int32_t                     (*receive)(struct dcihid_dev *dcihid_dev, const u_int32_t first, const u_int32_t count, int32_t *values);
+};
+
 struct dcihid_dev {
     char                        devname[64];
     char                        prodname[256];
     int                         fd;
+    const struct dcihid_transport *transport;
+    int                         sim;                            // Simulated board, DCIHID_TRANSPORT_SIM only
+    pthread_mutex_t             lock;
     struct hiddev_devinfo       device_info;
     struct hiddev_report_info   report_info_input;
     struct hiddev_field_info    field_info_input;
@@ -76,16 +177,399 @@ struct dcihid_dev {
     struct hiddev_report_info   report_info_output;
     struct hiddev_field_info    field_info_output;    
     unsigned                    usage_code_output;
+    int32_t                     output_values[DCIHID_REPORT_OUTPUT_MAX];
+    unsigned                    output_num_values;
+    int                         output_multi;
+    u_int                       card_type;
+    u_int                       card_id;
+    struct dcihid_shadow        *shadow;
+    struct dcihid_shadow        shadow_local;
+    int                         shadow_shared;
+    struct dcihid_coalesce      *coalesce;                      // NULL when writes are sent at once
+    int                         removed;                        // Unplugged, transfers fail with ENODEV
+    u_int32_t                   generation;                     // Reopens by the hotplug monitor
+#ifdef _DCIHID_STATS_
+    struct dcihid_stats         stats;
+#endif
 };
 typedef struct dcihid_dev *dcihid_dev_t;
 #define DCIHID_DEV_SZ       (sizeof(struct dcihid_dev))
 #define DCIHID_DEV_NULL     ((dcihid_dev_t)0)
+
+/*
+ * One pooled board: the open handle while referenced, and the resolved
+ * descriptor metadata, kept after the last close to skip enumeration.
+ */
+struct dcihid_pool_entry {
+    int                         used;
+    u_int                       card_type;
+    u_int                       card_id;
+    u_int32_t                   refcount;
+    dcihid_dev_t                dcihid_dev;
+    struct dcihid_dev           cached;
+};
+
+/*
+ * One board watched for input changes
+ */
+struct dcihid_watch_board {
+    dcihid_dev_t                dcihid_dev;
+    u_int8_t                    port[DCIHID_INPUT_PORTS];
+    int                         registered;                     // fd in the epoll set
+    u_int32_t                   generation;                     // Of the fd registered
+    struct dcihid_watch_board   *next;
+};
+
+struct dcihid_watch {
+    int                         epfd;
+    struct dcihid_watch_board   *boards;
+};
+typedef struct dcihid_watch *dcihid_watch_t;
+
+/*
+ * One board kept open across replugs
+ */
+struct dcihid_hotplug_board {
+    dcihid_dev_t                dcihid_dev;
+    char                        node[PATH_MAX];                 // Node the board was found on, symlinks resolved
+    u_int64_t                   removed_ns;                     // Time of the removal, 0 while plugged
+    struct dcihid_hotplug_board *next;
+};
+
+/* Node added by the kernel, until a removed board is found on it */
+struct dcihid_hotplug_node {
+    char                        path[PATH_MAX];
+    int                         transport;                      // DCIHID_TRANSPORT_HIDDEV or DCIHID_TRANSPORT_HIDRAW
+    u_int64_t                   added_ns;
+};
+
+struct dcihid_hotplug {
+    int                         epfd;
+    int                         nlfd;                           // NETLINK_KOBJECT_UEVENT, -1 if not available
+    int                         simfd;                          // dcisim_plug_fd()
+    struct dcihid_hotplug_board *boards;
+    u_int32_t                   num_removed;
+    struct dcihid_hotplug_node  nodes[DCIHID_HOTPLUG_NODES];
+    u_int32_t                   num_nodes;
+    struct dcihid_hotplug_stats stats;
+};
+typedef struct dcihid_hotplug *dcihid_hotplug_t;
+
+static struct dcihid_pool_entry dcihid_pool[DCIHID_POOL_MAX];
+static struct dcihid_pool_stats dcihid_pool_stats;
+static pthread_mutex_t          dcihid_pool_lock = PTHREAD_MUTEX_INITIALIZER;
  
 
 /*
  * functions
  */
+
+static u_int64_t
+dcihid_elapsed_ns(const struct timespec *start) {
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000000ULL + end.tv_nsec - start->tv_nsec;
+}
+
+static void
+dcihid_stat_add(struct dcihid_stat *stat, const u_int64_t ns, const int failed) {
+    int                         bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+
+    stat->count++;
+    if (failed) stat->errors++;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns) stat->max_ns = ns;
+    stat->hist[bucket < DCIHID_STAT_BUCKETS ? bucket : DCIHID_STAT_BUCKETS - 1]++;
+}
+
+#ifdef _DCIHID_STATS_
+static void
+dcihid_stat_syscall(dcihid_dev_t dcihid_dev, const int stat, const struct timespec *start, const int failed) {
+    int                         saved_errno = errno;
+
+    dcihid_stat_add(&dcihid_dev->stats.op[stat], dcihid_elapsed_ns(start), failed);
+    if (failed) dcihid_dev->stats.errnos[saved_errno < DCIHID_STAT_ERRNOS ? saved_errno : 0]++;
+    errno = saved_errno;
+}
+
+/*
+ * ioctl() counted and timed in the handle statistics
+ */
+static int
+dcihid_ioctl_timed(dcihid_dev_t dcihid_dev, const int stat, const unsigned long request, void *arg) {
+    struct timespec             start;
+    int                         ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = ioctl(dcihid_dev->fd, request, arg);
+    dcihid_stat_syscall(dcihid_dev, stat, &start, ret == -1);
+    return ret;
+}
+
+/*
+ * write() counted and timed in the handle statistics
+ */
+static ssize_t
+dcihid_write_timed(dcihid_dev_t dcihid_dev, const int stat, const void *buf, const size_t len) {
+    struct timespec             start;
+    ssize_t                     ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = write(dcihid_dev->fd, buf, len);
+    dcihid_stat_syscall(dcihid_dev, stat, &start, ret == -1);
+    return ret;
+}
+#define DCIHID_IOCTL(dev, stat, request, arg)   dcihid_ioctl_timed(dev, stat, request, arg)
+#define DCIHID_WRITE(dev, stat, buf, len)       dcihid_write_timed(dev, stat, buf, len)
+#define DCIHID_OPEN_START(start)                clock_gettime(CLOCK_MONOTONIC, start)
+#define DCIHID_OPEN_TIMED(dev, start)           dcihid_stat_add(&(dev)->stats.op[DCIHID_STAT_OPEN], dcihid_elapsed_ns(start), 0)
+#else
+#define DCIHID_IOCTL(dev, stat, request, arg)   ioctl((dev)->fd, request, arg)
+#define DCIHID_WRITE(dev, stat, buf, len)       write((dev)->fd, buf, len)
+#define DCIHID_OPEN_START(start)                (void)(start)
+#define DCIHID_OPEN_TIMED(dev, start)
+#endif
+
+/*
+ * Reads the card type and ID from the first input report without walking
+ * the report descriptors, HIDIOCINITREPORT must have been done on fd.
+ */
+static int
+dcihid_card_of(const int fd, u_int *card_type, u_int *card_id) {
+    struct hiddev_report_info   report_info;
+    struct hiddev_usage_ref     usage_ref;
+
+    memset(&report_info, 0, sizeof(report_info));
+    report_info.report_type = HID_REPORT_TYPE_INPUT;
+    report_info.report_id = eReport_ID;
+    if (ioctl(fd, HIDIOCGREPORT, &report_info) == -1) return -1;
+
+    memset(&usage_ref, 0, sizeof(usage_ref));
+    usage_ref.report_type = HID_REPORT_TYPE_INPUT;
+    usage_ref.report_id = eReport_ID;
+    usage_ref.field_index = 0;
+    usage_ref.usage_index = eCard_ID;
+    if (ioctl(fd, HIDIOCGUSAGE, &usage_ref) == -1) return -1;
+    *card_type = usage_ref.value;
+
+    usage_ref.usage_index = eCard_Num;
+    if (ioctl(fd, HIDIOCGUSAGE, &usage_ref) == -1) return -1;
+    *card_id = usage_ref.value;
+
+    return 0;
+}
+
+/*
+ * Checks that fd is a Decision-Computer board, fills in its device info
+ */
+static int
+dcihid_is_dci(const int fd, struct hiddev_devinfo *device_info) {
+    if (-1 == ioctl(fd, HIDIOCGDEVINFO, device_info)) {
+        fprintf(stderr, "ioctl: HIDIOCGDEVINFO: %s\n", strerror(errno));
+        return 0;
+    }
+
+    /* Check vendor ID and product ID: */
+    if (device_info->vendor != (short)DCIHID_16PR_VID && device_info->product != (short)DCIHID_16PR_PID) {
+        return 0;
+    }
+    return 1;
+}
  
+/*
+ * USB bus and device number of a hidraw node, from the USB device its HID
+ * interface belongs to. Left at 0 when sysfs does not tell.
+ */
+static void
+dcihid_hidraw_usbnum(const int fd, struct hiddev_devinfo *device_info) {
+    static const char           *names[2] = { "busnum", "devnum" };
+    __u32                       *nums[2] = { &device_info->busnum, &device_info->devnum };
+    char                        path[PATH_MAX];
+    struct stat                 st;
+    FILE                        *fp;
+    int                         i;
+
+    if (fstat(fd, &st) == -1 || !S_ISCHR(st.st_mode)) return;
+    for (i = 0; i < 2; i++) {
+        snprintf(path, sizeof(path), DCIHID_HIDRAW_SYSFS "/../../%s", major(st.st_rdev), minor(st.st_rdev), names[i]);
+        if ((fp = fopen(path, "r")) == NULL) continue;
+        if (fscanf(fp, "%u", nums[i]) != 1) *nums[i] = 0;
+        fclose(fp);
+    }
+}
+
+/*
+ * Same as dcihid_is_dci() for a hidraw node
+ */
+static int
+dcihid_hidraw_is_dci(const int fd, struct hiddev_devinfo *device_info) {
+    struct hidraw_devinfo       raw_info;
+
+    if (-1 == ioctl(fd, HIDIOCGRAWINFO, &raw_info)) {
+        fprintf(stderr, "ioctl: HIDIOCGRAWINFO: %s\n", strerror(errno));
+        return 0;
+    }
+    memset(device_info, 0, sizeof(struct hiddev_devinfo));
+    device_info->bustype = raw_info.bustype;
+    device_info->vendor = raw_info.vendor;
+    device_info->product = raw_info.product;
+    dcihid_hidraw_usbnum(fd, device_info);
+
+    /* Check vendor ID and product ID: */
+    if (device_info->vendor != (short)DCIHID_16PR_VID && device_info->product != (short)DCIHID_16PR_PID) {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Gets the current input report with a single HIDIOCGINPUT, returns its
+ * length without the report ID in buf[0].
+ */
+static int
+dcihid_hidraw_input(dcihid_dev_t dcihid_dev, u_int8_t *buf) {
+    int                         len;
+
+    buf[0] = eReport_ID;
+    len = DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_GREPORT, HIDIOCGINPUT(DCIHID_HIDRAW_REPORT_MAX + 1), buf);
+    if (len == -1) {
+        fprintf(stderr, "HIDIOCGINPUT: %s\n", strerror(errno));
+        return -1;
+    }
+    return len > 0 ? len - 1 : 0;
+}
+
+static int32_t
+dcihid_hidraw_receive(dcihid_dev_t dcihid_dev, const u_int32_t first, const u_int32_t count, int32_t *values) {
+    u_int8_t                    buf[DCIHID_HIDRAW_REPORT_MAX + 1];
+    u_int32_t                   yalv;
+    int                         len;
+
+    if ((len = dcihid_hidraw_input(dcihid_dev, buf)) == -1) return -1;
+    if (first + count > (u_int32_t)len) {
+        fprintf(stderr, "Input report of %d bytes can not be handled\n", len);
+        return -1;
+    }
+    for (yalv = 0; yalv < count; yalv++) values[yalv] = buf[1 + first + yalv];
+
+    return 0;
+}
+
+/*
+ * Sends the whole output report (address, data, chip select, control)
+ * with a single write().
+ */
+static int32_t
+dcihid_hidraw_send(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
+    u_int8_t                    buf[DCIHID_REPORT_OUTPUT_MAX + 1];
+    unsigned                    yalv;
+
+    buf[0] = eReport_ID;
+    for (yalv = 0; yalv < DCIHID_REPORT_OUTPUT_MAX; yalv++) buf[1 + yalv] = dcihid_dev->shadow->report[yalv] & 0xFF;
+    buf[1 + eDIO_address] = addr & 0xFF;
+    buf[1 + eDIO_data]    = data;
+    if (DCIHID_WRITE(dcihid_dev, DCIHID_STAT_SREPORT, buf, sizeof(buf)) != sizeof(buf)) {
+        fprintf(stderr, "hidraw write: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Simulated boards have no node to reopen, nor transfers to count as
+ * syscalls. They are counted in the statistics as GREPORT and SREPORT.
+ */
+static int
+dcihid_sim_is_dci(const int fd, struct hiddev_devinfo *device_info) {
+    return 0;
+}
+
+static int32_t
+dcihid_sim_receive(dcihid_dev_t dcihid_dev, const u_int32_t first, const u_int32_t count, int32_t *values) {
+    int32_t                     report[DCISIM_INPUT_USAGES];
+    int                         ret;
+#ifdef _DCIHID_STATS_
+    struct timespec             start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+    if (first + count > DCISIM_INPUT_USAGES) {
+        errno = EINVAL;
+        return -1;
+    }
+    ret = dcisim_get_report(dcihid_dev->sim, report, DCISIM_INPUT_USAGES);
+#ifdef _DCIHID_STATS_
+    dcihid_stat_syscall(dcihid_dev, DCIHID_STAT_GREPORT, &start, ret == -1);
+#endif
+    if (ret == -1) return -1;
+    memcpy(values, &report[first], count * sizeof(int32_t));
+
+    return 0;
+}
+
+static int32_t
+dcihid_sim_send(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
+    int32_t                     values[DCIHID_REPORT_OUTPUT_MAX];
+    int                         ret;
+#ifdef _DCIHID_STATS_
+    struct timespec             start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+    memcpy(values, dcihid_dev->shadow->report, sizeof(values));
+    values[eDIO_address] = addr;
+    values[eDIO_data] = data;
+    ret = dcisim_set_report(dcihid_dev->sim, values, DCIHID_REPORT_OUTPUT_MAX);
+#ifdef _DCIHID_STATS_
+    dcihid_stat_syscall(dcihid_dev, DCIHID_STAT_SREPORT, &start, ret == -1);
+#endif
+
+    return ret;
+}
+
+/*
+ * Private shadow of a new handle, starting from the output report read at open
+ */
+static void
+dcihid_shadow_init(dcihid_dev_t dcihid_dev) {
+    memset(&dcihid_dev->shadow_local, 0, sizeof(struct dcihid_shadow));
+    memcpy(dcihid_dev->shadow_local.report, dcihid_dev->output_values, sizeof(dcihid_dev->output_values));
+    dcihid_dev->shadow = &dcihid_dev->shadow_local;
+    dcihid_dev->shadow_shared = 0;
+}
+
+/*
+ * Locks the shadow against other processes sharing it
+ */
+static void
+dcihid_shadow_lock(dcihid_dev_t dcihid_dev) {
+    if (!dcihid_dev->shadow_shared) return;
+    if (pthread_mutex_lock(&dcihid_dev->shadow->lock) == EOWNERDEAD) {
+        /* The owner died in the middle of an update, trust nothing */
+        memset(dcihid_dev->shadow->valid, 0, sizeof(dcihid_dev->shadow->valid));
+        pthread_mutex_consistent(&dcihid_dev->shadow->lock);
+    }
+}
+
+static void
+dcihid_shadow_unlock(dcihid_dev_t dcihid_dev) {
+    if (dcihid_dev->shadow_shared) pthread_mutex_unlock(&dcihid_dev->shadow->lock);
+}
+
+static int32_t dcihid_hiddev_send(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data);
+static int32_t dcihid_hiddev_receive(dcihid_dev_t dcihid_dev, const u_int32_t first, const u_int32_t count, int32_t *values);
+
+/*
+ * Indexed by DCIHID_TRANSPORT_*
+ */
+static const struct dcihid_transport dcihid_transports[] = {
+    { DCIHID_TRANSPORT_HIDDEV, O_RDONLY, dcihid_is_dci,        dcihid_hiddev_send, dcihid_hiddev_receive },
+    { DCIHID_TRANSPORT_HIDRAW, O_RDWR,   dcihid_hidraw_is_dci, dcihid_hidraw_send, dcihid_hidraw_receive },
+    { DCIHID_TRANSPORT_SIM,    0,        dcihid_sim_is_dci,    dcihid_sim_send,    dcihid_sim_receive }
+};
+
 u_int64_t 
 dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     dcihid_dev_t                dcihid_dev;
@@ -97,11 +581,15 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     struct hiddev_field_info    field_info, field_info_input, field_info_output;
     struct hiddev_usage_ref     usage_ref;
     unsigned                    usage_code_input, usage_code_output;
+    int32_t                     output_values[DCIHID_REPORT_OUTPUT_MAX];
     unsigned int                yalv;
     int                         report_type;
+    u_int                       found_type, found_id;
+    struct timespec             start;
 
     /* ioctl() requires a file descriptor, so we check if we got one, and then open it */
     strcpy(devname, dev_name);
+    DCIHID_OPEN_START(&start);
 
     if ((fd = open(devname, O_RDONLY)) < 0) {
         perror("dcihid open");
@@ -109,10 +597,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     }
 
     /* Take out some device information */
-    if (-1 == ioctl(fd, HIDIOCGDEVINFO, &device_info)) {
-        fprintf(stderr, "ioctl: HIDIOCGDEVINFO: %s\n", strerror(errno));
-        return (u_int64_t)DCIHID_DEV_NULL;
-    }
+    if (!dcihid_is_dci(fd, &device_info)) goto error;
 
 #ifdef _DCIHID_DEBUG_
     printf("Device info:\n");
@@ -120,15 +605,10 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     printf("  vendor=0x%04hx product=0x%04hx version=0x%04hx num_applications=%u\n", device_info.vendor, device_info.product, device_info.version, device_info.num_applications);
 #endif
 
-    /* Check vendor ID and product ID: */
-    if (device_info.vendor != (short)DCIHID_16PR_VID && device_info.product != (short)DCIHID_16PR_PID) {
-        return (u_int64_t)DCIHID_DEV_NULL;
-    }
-
     /* Get product name */
     if (-1 == ioctl(fd, HIDIOCGNAME(sizeof(devname)), &prodname)) {
         fprintf(stderr, "ioctl: HIDIOCGNAME: %s\n", strerror(errno));
-        return (u_int64_t)DCIHID_DEV_NULL;
+        goto error;
     }
     
 #ifdef _DCIHID_DEBUG_
@@ -138,8 +618,15 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     /* Initialise the internal report structures */
     if (-1 == ioctl(fd, HIDIOCINITREPORT)) {
         fprintf(stderr, "HIDIOCINITREPORT: %s\n", strerror(errno));
-        return (u_int64_t)DCIHID_DEV_NULL;
+        goto error;
+    }
+
+    /* Reject other cards before walking the descriptors */
+    if (dcihid_card_of(fd, &found_type, &found_id) == -1) {
+        fprintf(stderr, "HIDIOCGUSAGE: %s\n", strerror(errno));
+        goto error;
     }
+    if (found_type != card_type || found_id != card_id) goto error;
 
     /* Get report info */
     for (report_type = HID_REPORT_TYPE_MIN; report_type <= HID_REPORT_TYPE_MAX; report_type++) {
@@ -149,7 +636,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
         while (ioctl(fd, HIDIOCGREPORTINFO, &report_info) >= 0) {
             if (report_info.report_id != eReport_ID) {
                 fprintf(stderr, "Invalid report ID, %d, can not be handled\n", report_info.report_id);
-                return (u_int64_t)DCIHID_DEV_NULL;
+                goto error;
             }
             
             switch (report_info.report_type) {
@@ -158,7 +645,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
                     break;
                 default:
                     fprintf(stderr, "Invalid report type, %d, can not be handled\n", report_info.report_type);  
-                    return (u_int64_t)DCIHID_DEV_NULL;
+                    goto error;
                     break;
             }
 
@@ -168,7 +655,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
 
             if (report_info.num_fields != 1) {
                 fprintf(stderr, "Invalid report with %d fields, can not be handled\n", report_info.num_fields);
-                return (u_int64_t)DCIHID_DEV_NULL;
+                goto error;
             }
                 
             memset(&field_info, 0, sizeof(struct hiddev_field_info));
@@ -195,7 +682,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     memcpy(&report_info, &report_info_input, sizeof(struct hiddev_report_info));
     if (ioctl(fd, HIDIOCGREPORT, &report_info) == -1) {
         fprintf(stderr, "HIDIOCGREPORT: %s\n", strerror(errno));
-        return -1;
+        goto error;
     }
     memcpy(&field_info, &field_info_input, sizeof(field_info_input));
 
@@ -212,13 +699,11 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     usage_ref.usage_index = 0;
     if (ioctl(fd, HIDIOCGUCODE, &usage_ref) == -1) {
         fprintf(stderr, "HIDIOCGUCODE: %s\n", strerror(errno));
-        return (u_int64_t)DCIHID_DEV_NULL;
+        goto error;
     }
     usage_code_input = usage_ref.usage_code;
     
     /* To get usages */
-    u_int8_t matched = 1;
-
     memset(&usage_ref, 0, sizeof(usage_ref));
     for (yalv = 0; yalv < field_info.maxusage; yalv++) {
         usage_ref.report_type = field_info.report_type;
@@ -227,21 +712,10 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
         usage_ref.usage_index = yalv;
         if (ioctl(fd, HIDIOCGUSAGE, &usage_ref) == -1) {
             fprintf(stderr, "HIDIOCGUSAGE: %s\n", strerror(errno));
-            return (u_int64_t)DCIHID_DEV_NULL;
+            goto error;
         }
 
-        if (yalv >= DCIHID_REPORT_INPUT_MAX) continue;
-
-        switch (yalv) {
-        case eCard_ID:
-            if (usage_ref.value != card_type) matched = 0;
-            break;
-        case eCard_Num:
-            if (usage_ref.value != card_id) matched = 0;
-            break;
-        }
     }
-    if (!matched) return (u_int64_t)DCIHID_DEV_NULL;
     
     /* HID_REPORT_TYPE_OUTPUT */
     memcpy(&report_info, &report_info_output, sizeof(struct hiddev_report_info));
@@ -260,7 +734,7 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     usage_ref.usage_index = 0;
     if (ioctl(fd, HIDIOCGUCODE, &usage_ref) == -1) {
         fprintf(stderr, "HIDIOCGUCODE: %s\n", strerror(errno));
-        return (u_int64_t)DCIHID_DEV_NULL;
+        goto error;
     }
     usage_code_output = usage_ref.usage_code;
 
@@ -273,17 +747,19 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
         usage_ref.usage_index = yalv;
         if (ioctl(fd, HIDIOCGUSAGE, &usage_ref) == -1) {
             fprintf(stderr, "HIDIOCGUSAGE: %s\n", strerror(errno));
-            return (u_int64_t)DCIHID_DEV_NULL;
+            goto error;
         }
         
         if (yalv >=  DCIHID_REPORT_OUTPUT_MAX) continue;    
+        output_values[yalv] = usage_ref.value;
     }
     
     dcihid_dev = (dcihid_dev_t)malloc(sizeof(struct dcihid_dev));
-    if (dcihid_dev == DCIHID_DEV_NULL) return (u_int64_t)DCIHID_DEV_NULL;
+    if (dcihid_dev == DCIHID_DEV_NULL) goto error;
     
     strcpy(dcihid_dev->devname, devname);
     dcihid_dev->fd = fd;
+    dcihid_dev->transport = &dcihid_transports[DCIHID_TRANSPORT_HIDDEV];
     strcpy(dcihid_dev->prodname, prodname);
     memcpy(&dcihid_dev->device_info, &device_info, sizeof(struct hiddev_devinfo));
     memcpy(&dcihid_dev->report_info_input, &report_info_input, sizeof(struct hiddev_report_info));
@@ -292,26 +768,190 @@ dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id) {
     memcpy(&dcihid_dev->report_info_output, &report_info_output, sizeof(struct hiddev_report_info));
     memcpy(&dcihid_dev->field_info_output, &field_info_output, sizeof(struct hiddev_field_info));
     dcihid_dev->usage_code_output = usage_code_output;
+    memcpy(dcihid_dev->output_values, output_values, sizeof(output_values));
+    dcihid_dev->output_num_values = field_info_output.maxusage < DCIHID_REPORT_OUTPUT_MAX ? field_info_output.maxusage : DCIHID_REPORT_OUTPUT_MAX;
+    dcihid_dev->output_multi = (dcihid_dev->output_num_values > eDIO_data);
+    dcihid_dev->card_type = card_type;
+    dcihid_dev->card_id = card_id;
+    dcihid_shadow_init(dcihid_dev);
+    dcihid_dev->coalesce = NULL;
+    dcihid_dev->removed = 0;
+    dcihid_dev->generation = 0;
+    pthread_mutex_init(&dcihid_dev->lock, NULL);
+#ifdef _DCIHID_STATS_
+    memset(&dcihid_dev->stats, 0, sizeof(struct dcihid_stats));
+#endif
+    DCIHID_OPEN_TIMED(dcihid_dev, &start);
     
     return (u_int64_t)dcihid_dev;
+
+error:
+    close(fd);
+    return (u_int64_t)DCIHID_DEV_NULL;
 }
 
 int32_t
 dcihid_close(u_int64_t const dcihid_handle) {
     dcihid_dev_t dcihid_dev = (dcihid_dev_t)dcihid_handle;
-    close(dcihid_dev->fd);
+    if (dcihid_dev->coalesce) dcihid_coalesce_disable(dcihid_handle);
+    if (dcihid_dev->shadow_shared) munmap(dcihid_dev->shadow, sizeof(struct dcihid_shadow));
+    if (dcihid_dev->fd >= 0) close(dcihid_dev->fd);
+    pthread_mutex_destroy(&dcihid_dev->lock);
     free(dcihid_dev);
     return 0;
 }
 
-int32_t
-dcihid_write(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t data) {
-    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
-    int                         fd = dcihid_dev->fd;
+/*
+ * hidraw node of the same board as a hiddev node, so that hiddev paths and
+ * dcihid_lookup() can be used with the hidraw transport too.
+ */
+static void
+dcihid_hidraw_node(const char *dev_name, char *devname, const size_t len) {
+    char                        pattern[PATH_MAX];
+    struct stat                 st;
+    glob_t                      nodes;
+
+    snprintf(devname, len, "%s", dev_name);
+    if (stat(dev_name, &st) == -1 || !S_ISCHR(st.st_mode)) return;
+    snprintf(pattern, sizeof(pattern), DCIHID_HIDRAW_SYSFS "/*/hidraw/hidraw*", major(st.st_rdev), minor(st.st_rdev));
+    memset(&nodes, 0, sizeof(nodes));
+    if (glob(pattern, 0, NULL, &nodes) == 0) {
+        snprintf(devname, len, "/dev/%s", strrchr(nodes.gl_pathv[0], '/') + 1);
+    }
+    globfree(&nodes);
+}
+
+/*
+ * Opens a board on /dev/hidrawN. There are no descriptors to walk: one
+ * input report tells the card, its type and ID, and the report size.
+ */
+static u_int64_t
+dcihid_open_hidraw(const char *dev_name, const u_int card_type, const u_int card_id) {
+    dcihid_dev_t                dcihid_dev;
+    u_int8_t                    buf[DCIHID_HIDRAW_REPORT_MAX + 1];
+    struct timespec             start;
+    int                         len;
+
+    DCIHID_OPEN_START(&start);
+
+    dcihid_dev = (dcihid_dev_t)calloc(1, sizeof(struct dcihid_dev));
+    if (dcihid_dev == DCIHID_DEV_NULL) return (u_int64_t)DCIHID_DEV_NULL;
+    dcihid_dev->transport = &dcihid_transports[DCIHID_TRANSPORT_HIDRAW];
+    dcihid_hidraw_node(dev_name, dcihid_dev->devname, sizeof(dcihid_dev->devname));
+
+    if ((dcihid_dev->fd = open(dcihid_dev->devname, dcihid_dev->transport->open_flags)) < 0) {
+        perror("dcihid open");
+        free(dcihid_dev);
+        return (u_int64_t)DCIHID_DEV_NULL;
+    }
+
+    if (!dcihid_hidraw_is_dci(dcihid_dev->fd, &dcihid_dev->device_info)) goto error;
+    if (-1 == ioctl(dcihid_dev->fd, HIDIOCGRAWNAME(sizeof(dcihid_dev->prodname)), dcihid_dev->prodname)) {
+        fprintf(stderr, "ioctl: HIDIOCGRAWNAME: %s\n", strerror(errno));
+        goto error;
+    }
+
+    if ((len = dcihid_hidraw_input(dcihid_dev, buf)) == -1) goto error;
+    if (len <= eCard_Num || buf[1 + eCard_ID] != card_type || buf[1 + eCard_Num] != card_id) goto error;
+
+    dcihid_dev->report_info_input.report_type = HID_REPORT_TYPE_INPUT;
+    dcihid_dev->field_info_input.report_type = HID_REPORT_TYPE_INPUT;
+    dcihid_dev->field_info_input.maxusage = len;
+    dcihid_dev->report_info_output.report_type = HID_REPORT_TYPE_OUTPUT;
+    dcihid_dev->field_info_output.report_type = HID_REPORT_TYPE_OUTPUT;
+    dcihid_dev->field_info_output.maxusage = DCIHID_REPORT_OUTPUT_MAX;
+    dcihid_dev->output_num_values = DCIHID_REPORT_OUTPUT_MAX;
+    dcihid_dev->card_type = card_type;
+    dcihid_dev->card_id = card_id;
+    dcihid_shadow_init(dcihid_dev);
+    pthread_mutex_init(&dcihid_dev->lock, NULL);
+#ifdef _DCIHID_STATS_
+    memset(&dcihid_dev->stats, 0, sizeof(struct dcihid_stats));
+#endif
+    DCIHID_OPEN_TIMED(dcihid_dev, &start);
+
+    return (u_int64_t)dcihid_dev;
+
+error:
+    close(dcihid_dev->fd);
+    free(dcihid_dev);
+    return (u_int64_t)DCIHID_DEV_NULL;
+}
+
+/*
+ * Opens a simulated board by name, or by type and ID. A board that does
+ * not exist yet is created when no name is given.
+ */
+static u_int64_t
+dcihid_open_sim(const char *dev_name, const u_int card_type, const u_int card_id) {
+    dcihid_dev_t                dcihid_dev;
+    int32_t                     values[DCISIM_INPUT_USAGES];
+    struct timespec             start;
+    int                         sim;
+
+    DCIHID_OPEN_START(&start);
+
+    if (dev_name && dev_name[0]) {
+        sim = dcisim_find(dev_name);
+    } else if ((sim = dcisim_find_card(card_type, card_id)) < 0) {
+        sim = dcisim_create(card_type, card_id, NULL, 0);
+    }
+    if (sim < 0 || dcisim_get_report(sim, values, DCISIM_INPUT_USAGES) != 0) return (u_int64_t)DCIHID_DEV_NULL;
+    if ((u_int)values[eCard_ID] != card_type || (u_int)values[eCard_Num] != card_id) return (u_int64_t)DCIHID_DEV_NULL;
+
+    dcihid_dev = (dcihid_dev_t)calloc(1, sizeof(struct dcihid_dev));
+    if (dcihid_dev == DCIHID_DEV_NULL) return (u_int64_t)DCIHID_DEV_NULL;
+    dcihid_dev->transport = &dcihid_transports[DCIHID_TRANSPORT_SIM];
+    dcihid_dev->sim = sim;
+    dcihid_dev->fd = -1;
+    snprintf(dcihid_dev->devname, sizeof(dcihid_dev->devname), DCISIM_PATH, sim);
+    snprintf(dcihid_dev->prodname, sizeof(dcihid_dev->prodname), "Decision-Computer DCI USB HID (simulated)");
+    dcihid_dev->device_info.vendor = (short)DCISIM_VID;
+    dcihid_dev->device_info.product = (short)DCISIM_PID;
+    dcihid_dev->device_info.devnum = sim + 1;
+    dcihid_dev->report_info_input.report_type = HID_REPORT_TYPE_INPUT;
+    dcihid_dev->field_info_input.report_type = HID_REPORT_TYPE_INPUT;
+    dcihid_dev->field_info_input.maxusage = DCISIM_INPUT_USAGES;
+    dcihid_dev->report_info_output.report_type = HID_REPORT_TYPE_OUTPUT;
+    dcihid_dev->field_info_output.report_type = HID_REPORT_TYPE_OUTPUT;
+    dcihid_dev->field_info_output.maxusage = DCIHID_REPORT_OUTPUT_MAX;
+    dcihid_dev->output_num_values = DCIHID_REPORT_OUTPUT_MAX;
+    dcihid_dev->card_type = card_type;
+    dcihid_dev->card_id = card_id;
+    dcihid_shadow_init(dcihid_dev);
+    pthread_mutex_init(&dcihid_dev->lock, NULL);
+    DCIHID_OPEN_TIMED(dcihid_dev, &start);
+
+    return (u_int64_t)dcihid_dev;
+}
+
+u_int64_t
+dcihid_open_transport(const char *dev_name, const u_int card_type, const u_int card_id, const int transport) {
+    switch (transport) {
+        case DCIHID_TRANSPORT_HIDDEV:
+            return dcihid_open(dev_name, card_type, card_id);
+        case DCIHID_TRANSPORT_HIDRAW:
+            return dcihid_open_hidraw(dev_name, card_type, card_id);
+        case DCIHID_TRANSPORT_SIM:
+            return dcihid_open_sim(dev_name, card_type, card_id);
+    }
+    fprintf(stderr, "Unknown transport %d\n", transport);
+    return (u_int64_t)DCIHID_DEV_NULL;
+}
+
+int
+dcihid_get_transport(const u_int64_t dcihid_handle) {
+    return ((dcihid_dev_t)dcihid_handle)->transport->id;
+}
+
+/*
+ * Sends one output report through HIDIOCSUSAGE per value, used when the
+ * kernel does not accept HIDIOCSUSAGES for the output field.
+ */
+static int32_t
+dcihid_write_usage(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
     struct hiddev_field_info    *field_info = &dcihid_dev->field_info_output;
-    struct hiddev_report_info   report_info;
     struct hiddev_usage_ref     usage_ref;
-    unsigned                    usage_code_output = dcihid_dev->usage_code_output;
 
     /* 
      * To actually send a value to the device, perform a SUSAGE first,
@@ -329,92 +969,1699 @@ dcihid_write(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t
     usage_ref.report_type = field_info->report_type;
     usage_ref.report_id   = field_info->report_id;
     usage_ref.field_index = 0;
-    usage_ref.usage_code  = usage_code_output;
-    if (ioctl(fd, HIDIOCSUSAGE, &usage_ref) == -1) {
+    usage_ref.usage_code  = dcihid_dev->usage_code_output;
+    if (DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_SUSAGE, HIDIOCSUSAGE, &usage_ref) == -1) {
         fprintf(stderr, "HIDIOCSUSAGE: %s\n", strerror(errno));
         return -1;
     }
 
-    memset(&usage_ref, 0, sizeof(usage_ref));
     usage_ref.usage_index = eDIO_data;
     usage_ref.value       = (u_int32_t)data;
-    usage_ref.report_type = field_info->report_type;
-    usage_ref.report_id   = field_info->report_id;
-    usage_ref.field_index = 0;
-    usage_ref.usage_code  = usage_code_output;
-    if (ioctl(fd, HIDIOCSUSAGE, &usage_ref) == -1) {
+    if (DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_SUSAGE, HIDIOCSUSAGE, &usage_ref) == -1) {
         fprintf(stderr, "HIDIOCSUSAGE: %s\n", strerror(errno));
         return -1;
     }
 
-    report_info.report_type = HID_REPORT_TYPE_OUTPUT;
-    report_info.report_id = 0x00;
-    report_info.num_fields = 1;
-    if (ioctl(fd, HIDIOCSREPORT, &report_info) == -1) {
-        fprintf(stderr, "HIDIOCSREPORT: %s\n", strerror(errno));
-        return -1;
-    }
+    return 0;
+}
+
+/*
+ * Fills the whole output report (address, data, chip select, control)
+ * with a single HIDIOCSUSAGES and sends it with HIDIOCSREPORT.
+ */
+static int32_t
+dcihid_hiddev_send(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
+    struct hiddev_field_info        *field_info = &dcihid_dev->field_info_output;
+    struct hiddev_report_info       report_info;
+    struct hiddev_usage_ref_multi   usage_multi;
+    int32_t                         ret = -1;
+
+    if (dcihid_dev->output_multi) {
+        memset(&usage_multi.uref, 0, sizeof(usage_multi.uref));
+        usage_multi.uref.report_type = field_info->report_type;
+        usage_multi.uref.report_id   = field_info->report_id;
+        usage_multi.uref.field_index = 0;
+        usage_multi.uref.usage_index = eDIO_address;
+        usage_multi.uref.usage_code  = dcihid_dev->usage_code_output;
+        usage_multi.num_values       = dcihid_dev->output_num_values;
+        memcpy(usage_multi.values, dcihid_dev->shadow->report, dcihid_dev->output_num_values * sizeof(int32_t));
+        usage_multi.values[eDIO_address] = addr;
+        usage_multi.values[eDIO_data]    = (u_int32_t)data;
+        ret = DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_SUSAGE, HIDIOCSUSAGES, &usage_multi);
+        if (ret == -1) {
+            if (errno != EINVAL && errno != ENOTTY && errno != EOPNOTSUPP) {
+                /* The board may be gone or the call interrupted, keep HIDIOCSUSAGES for the next report */
+                fprintf(stderr, "HIDIOCSUSAGES: %s\n", strerror(errno));
+                return -1;
+            }
+            /* Not supported for this field, do not try again on this handle */
+            dcihid_dev->output_multi = 0;
+        }
+    }
+    if (ret == -1 && dcihid_write_usage(dcihid_dev, addr, data) == -1) {
+        return -1;
+    }
+
+    report_info.report_type = HID_REPORT_TYPE_OUTPUT;
+    report_info.report_id = 0x00;
+    report_info.num_fields = 1;
+    if (DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_SREPORT, HIDIOCSREPORT, &report_info) == -1) {
+        fprintf(stderr, "HIDIOCSREPORT: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * An unplugged board fails every transfer without reaching the node,
+ * until the hotplug monitor reopens it. Under lock.
+ */
+static int
+dcihid_gone(dcihid_dev_t dcihid_dev) {
+    if (!dcihid_dev->removed) return 0;
+    errno = ENODEV;
+    return 1;
+}
+
+/*
+ * Sends one output report and remembers the value written. Under the
+ * lock of the handle and of its shadow.
+ */
+static int32_t
+dcihid_write_report(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
+    if (dcihid_gone(dcihid_dev) || dcihid_dev->transport->send(dcihid_dev, addr, data) == -1) return -1;
+
+    if (addr < DCIHID_PORTS_MAX) {
+        dcihid_dev->shadow->value[addr] = data;
+        dcihid_dev->shadow->valid[addr / 8] |= (1 << (addr % 8));
+    }
  
     return 0;
 }
 
+static int
+dcihid_coalesce_is_pending(const struct dcihid_coalesce *coalesce, const u_int32_t addr) {
+    return coalesce->pending[addr / 8] & (1 << (addr % 8));
+}
+
+/*
+ * Sends the pending writes in port order, under the lock of the handle
+ * and of its shadow. Every port is tried, returns -1 if one failed.
+ */
+static int32_t
+dcihid_coalesce_flush_locked(dcihid_dev_t dcihid_dev) {
+    struct dcihid_coalesce      *coalesce = dcihid_dev->coalesce;
+    int32_t                     ret = 0;
+    u_int32_t                   addr;
+
+    if (coalesce->stats.pending == 0) return 0;
+    for (addr = 0; addr < DCIHID_PORTS_MAX; addr++) {
+        if (!dcihid_coalesce_is_pending(coalesce, addr)) continue;
+        coalesce->pending[addr / 8] &= ~(1 << (addr % 8));
+        if (dcihid_write_report(dcihid_dev, addr, coalesce->value[addr]) == 0) {
+            coalesce->stats.sent++;
+        } else {
+            coalesce->stats.errors++;
+            ret = -1;
+        }
+    }
+    coalesce->stats.pending = 0;
+    return ret;
+}
+
+/*
+ * Writes one port, or holds the value back while coalescing. Under the
+ * lock of the handle and of its shadow.
+ */
+static int32_t
+dcihid_write_port(dcihid_dev_t dcihid_dev, const u_int32_t addr, const u_int8_t data) {
+    struct dcihid_coalesce      *coalesce = dcihid_dev->coalesce;
+    struct timespec             now;
+
+    if (coalesce == NULL || addr >= DCIHID_PORTS_MAX) return dcihid_write_report(dcihid_dev, addr, data);
+
+    coalesce->stats.submitted++;
+    coalesce->value[addr] = data;
+    if (dcihid_coalesce_is_pending(coalesce, addr)) return 0;
+    coalesce->pending[addr / 8] |= (1 << (addr % 8));
+
+    /* The first pending write opens the window */
+    if (coalesce->stats.pending++ == 0 && coalesce->window_ns) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        coalesce->deadline = now.tv_sec * NSEC_PER_SEC + now.tv_nsec + coalesce->window_ns;
+        pthread_cond_signal(&coalesce->cond);
+    }
+    return 0;
+}
+
+/*
+ * Sends a pending write before the port is read back, under the lock of
+ * the handle and of its shadow
+ */
+static int32_t
+dcihid_coalesce_before_read(dcihid_dev_t dcihid_dev, const u_int32_t first, const u_int32_t count) {
+    struct dcihid_coalesce      *coalesce = dcihid_dev->coalesce;
+    u_int32_t                   addr;
+
+    if (coalesce == NULL || coalesce->stats.pending == 0) return 0;
+    for (addr = first; addr < first + count && addr < DCIHID_PORTS_MAX; addr++) {
+        if (dcihid_coalesce_is_pending(coalesce, addr)) {
+            coalesce->stats.flushes++;
+            return dcihid_coalesce_flush_locked(dcihid_dev);
+        }
+    }
+    return 0;
+}
+
+/*
+ * Refuses ports the card does not have, and writes to ports it can not
+ * write. Outputs can be read back, set/clear rely on it.
+ */
+static int
+dcihid_check_port(dcihid_dev_t dcihid_dev, const u_int32_t addr, const int write) {
+    u_int                       access = dciboard_access(dcihid_dev->card_type, addr);
+
+    if (access == 0 || (write && !(access & DCIBOARD_WRITE))) {
+        fprintf(stderr, "Port 0x%02X is not %s on card type 0x%02X\n", addr, access ? "writable" : "available",
+                dcihid_dev->card_type);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
 int32_t
-dcihid_read(const u_int64_t dcihid_handle, const u_int32_t addr, u_int8_t *data) {
+dcihid_write(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t data) {
     dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
-    int                         fd = dcihid_dev->fd;
-    struct hiddev_report_info   report_info;
-    struct hiddev_field_info    field_info;
-    struct hiddev_usage_ref     usage_ref;
-    unsigned                    usage_code_input = dcihid_dev->usage_code_input;
-    
+    int32_t                     ret;
+
+    if (dcihid_check_port(dcihid_dev, addr, 1) != 0) return -1;
+
+    /* Address, data and SREPORT of one thread can not interleave with another */
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    ret = dcihid_write_port(dcihid_dev, addr, data);
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+int32_t
+dcihid_write_multi(const u_int64_t dcihid_handle, const struct dcihid_write_op *ops, const u_int32_t count) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    u_int32_t                   i;
+    int32_t                     ret = 0;
+
+    for (i = 0; i < count; i++) {
+        if (dcihid_check_port(dcihid_dev, ops[i].addr, 1) != 0) return -1;
+    }
+
+    /* Sent back to back, stops at the first failing report */
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    for (i = 0; i < count && ret == 0; i++) {
+        ret = dcihid_write_port(dcihid_dev, ops[i].addr, ops[i].data);
+    }
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+
+    return ret;
+}
+
+/*
+ * Gets one input report with HIDIOCGREPORT, and count of its usages from
+ * first on with HIDIOCGUSAGE or HIDIOCGUSAGES.
+ */
+static int32_t
+dcihid_hiddev_receive(dcihid_dev_t dcihid_dev, const u_int32_t first, const u_int32_t count, int32_t *values) {
+    struct hiddev_report_info       report_info;
+    struct hiddev_field_info        *field_info = &dcihid_dev->field_info_input;
+    struct hiddev_usage_ref_multi   usage_multi;
+    unsigned                        yalv;
+
     /* HID_REPORT_TYPE_INPUT */
     memcpy(&report_info, &dcihid_dev->report_info_input, sizeof(struct hiddev_report_info));
-    memcpy(&field_info, &dcihid_dev->field_info_input, sizeof(struct hiddev_field_info));
 
-    /* To get one report */
-    if (ioctl(fd, HIDIOCGREPORT, &report_info) == -1) {
+    /* To get one report, all values below are taken from this single transfer */
+    if (DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_GREPORT, HIDIOCGREPORT, &report_info) == -1) {
         fprintf(stderr, "HIDIOCGREPORT: %s\n", strerror(errno));
         return -1;
     }
 
-    memset(&usage_ref, 0, sizeof(usage_ref));
-    usage_ref.report_type = field_info.report_type;
-    usage_ref.report_id = field_info.report_id;
-    usage_ref.field_index = 0;
-    usage_ref.usage_index = eport1 + addr;
-    usage_ref.usage_code  = usage_code_input;
-    if (ioctl(fd, HIDIOCGUSAGE, &usage_ref) == -1) {
-        fprintf(stderr, "HIDIOCGUSAGE: %s\n", strerror(errno));
+    memset(&usage_multi.uref, 0, sizeof(usage_multi.uref));
+    usage_multi.uref.report_type = field_info->report_type;
+    usage_multi.uref.report_id   = field_info->report_id;
+    usage_multi.uref.field_index = 0;
+    usage_multi.uref.usage_index = first;
+    usage_multi.uref.usage_code  = dcihid_dev->usage_code_input;
+    usage_multi.num_values       = count;
+
+    /* To get all usages at once, older kernels fall back to one GUSAGE per value */
+    if (count == 1 || DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_GUSAGE, HIDIOCGUSAGES, &usage_multi) == -1) {
+        struct hiddev_usage_ref usage_ref;
+
+        memcpy(&usage_ref, &usage_multi.uref, sizeof(usage_ref));
+        for (yalv = 0; yalv < count; yalv++) {
+            usage_ref.usage_index = first + yalv;
+            if (DCIHID_IOCTL(dcihid_dev, DCIHID_STAT_GUSAGE, HIDIOCGUSAGE, &usage_ref) == -1) {
+                fprintf(stderr, "HIDIOCGUSAGE: %s\n", strerror(errno));
+                return -1;
+            }
+            usage_multi.values[yalv] = usage_ref.value;
+        }
+    }
+    memcpy(values, usage_multi.values, count * sizeof(int32_t));
+
+    return 0;
+}
+
+static int32_t
+dcihid_read_report(dcihid_dev_t dcihid_dev, const u_int32_t addr, u_int8_t *data) {
+    int32_t                     value;
+
+    if (dcihid_gone(dcihid_dev) || dcihid_dev->transport->receive(dcihid_dev, eport1 + addr, 1, &value) == -1) return -1;
+    *data = ~value & 0xFF;
+
+    return 0;
+}
+
+int32_t
+dcihid_read(const u_int64_t dcihid_handle, const u_int32_t addr, u_int8_t *data) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret;
+
+    if (dcihid_check_port(dcihid_dev, addr, 0) != 0) return -1;
+
+    /* GREPORT and GUSAGE of one thread can not interleave with another */
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    ret = dcihid_coalesce_before_read(dcihid_dev, addr, 1);
+    dcihid_shadow_unlock(dcihid_dev);
+    if (ret == 0) ret = dcihid_read_report(dcihid_dev, addr, data);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+/*
+ * Reads the channel and the result of the last ADC conversion, from the
+ * ADC usages of one input report
+ */
+int32_t
+dcihid_read_adc(const u_int64_t dcihid_handle, u_int8_t *channel, u_int16_t *result) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     values[eupper_adc_result - eadc_index + 1];
+    int32_t                     ret;
+
+    if (!dcihid_card_has_adc(dcihid_dev->card_type) || dcihid_dev->field_info_input.maxusage <= eupper_adc_result) {
+        fprintf(stderr, "Card type 0x%02X has no ADC\n", dcihid_dev->card_type);
+        errno = ENOTSUP;
         return -1;
     }
-    *data = ~usage_ref.value & 0xFF;
 
+    pthread_mutex_lock(&dcihid_dev->lock);
+    ret = dcihid_gone(dcihid_dev) ? -1 : dcihid_dev->transport->receive(dcihid_dev, eadc_index, eupper_adc_result - eadc_index + 1, values);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    if (ret == -1) return -1;
+
+    if (channel) *channel = values[0] & 0xFF;
+    if (result) *result = (values[elower_adc_result - eadc_index] & 0xFF) | ((values[eupper_adc_result - eadc_index] & 0xFF) << 8);
     return 0;
 }
 
-u_int
-dcihid_assert_card_type(const u_int card_type) {
-    switch (card_type) {
-        case USB_16PIO:
-        case USB_LABKIT:
-        case USB_16PR:
-        case USB_STARTER:
-        case USB_8PR:
-        case USB_4PR:
-        case USB_8PI:
-        case USB_8RO:
-        case USB_16PI:
-        case USB_16RO:
-        case USB_32PI:
-        case USB_32RO:
-        case USB_IND:
-        case USB_M_4IO:
-            return 1;
-            break;
+int32_t
+dcihid_get_stats(const u_int64_t dcihid_handle, struct dcihid_stats *stats) {
+#ifdef _DCIHID_STATS_
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    memcpy(stats, &dcihid_dev->stats, sizeof(struct dcihid_stats));
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return 0;
+#else
+    memset(stats, 0, sizeof(struct dcihid_stats));
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int32_t
+dcihid_reset_stats(const u_int64_t dcihid_handle) {
+#ifdef _DCIHID_STATS_
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    memset(&dcihid_dev->stats, 0, sizeof(struct dcihid_stats));
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return 0;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+u_int64_t
+dcihid_stat_percentile(const struct dcihid_stat *stat, const double fraction) {
+    u_int64_t                   seen = 0, rank = (u_int64_t)(stat->count * fraction);
+    u_int64_t                   upper;
+    int                         i;
+
+    /* Upper bound of the bucket holding the rank, never above the maximum */
+    for (i = 0; i < DCIHID_STAT_BUCKETS; i++) {
+        seen += stat->hist[i];
+        if (seen > rank) {
+            upper = i ? (1ULL << i) - 1 : 0;
+            return upper < stat->max_ns ? upper : stat->max_ns;
+        }
+    }
+    return stat->max_ns;
+}
+
+static int32_t
+dcihid_resync_locked(dcihid_dev_t dcihid_dev, const u_int32_t addr) {
+    u_int8_t                    data;
+
+    if (dcihid_coalesce_before_read(dcihid_dev, addr, 1) != 0) return -1;
+    if (dcihid_read_report(dcihid_dev, addr, &data) != 0) return -1;
+    dcihid_dev->shadow->value[addr] = data;
+    dcihid_dev->shadow->valid[addr / 8] |= (1 << (addr % 8));
+    return 0;
+}
+
+int32_t
+dcihid_resync(const u_int64_t dcihid_handle, const u_int32_t addr) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret;
+
+    if (addr >= DCIHID_PORTS_MAX || dcihid_check_port(dcihid_dev, addr, 0) != 0) return -1;
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    ret = dcihid_resync_locked(dcihid_dev, addr);
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+/*
+ * Applies a bit operation to the last value written, and writes the result
+ */
+static int32_t
+dcihid_modify_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t set, const u_int8_t clear,
+                   const u_int8_t toggle, u_int8_t *data) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_shadow        *shadow;
+    u_int8_t                    value;
+    int32_t                     ret = -1;
+
+    if (addr >= DCIHID_PORTS_MAX || dcihid_check_port(dcihid_dev, addr, 1) != 0) return -1;
+    pthread_mutex_lock(&dcihid_dev->lock);
+    /* dcihid_shadow_attach() switches the shadow under dev->lock */
+    shadow = dcihid_dev->shadow;
+    dcihid_shadow_lock(dcihid_dev);
+
+    /* Only the first access to a port has to read it back, a pending write is the newest value */
+    if (dcihid_dev->coalesce && dcihid_coalesce_is_pending(dcihid_dev->coalesce, addr)) {
+        value = dcihid_dev->coalesce->value[addr];
+    } else if (!(shadow->valid[addr / 8] & (1 << (addr % 8))) && dcihid_resync_locked(dcihid_dev, addr) != 0) {
+        goto done;
+    } else {
+        value = shadow->value[addr];
+    }
+
+    value = ((value | set) & ~clear) ^ toggle;
+    if (dcihid_write_port(dcihid_dev, addr, value) != 0) goto done;
+    if (data) *data = value;
+    ret = 0;
+
+done:
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+int32_t
+dcihid_set_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data) {
+    return dcihid_modify_bits(dcihid_handle, addr, mask, 0, 0, data);
+}
+
+int32_t
+dcihid_clear_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data) {
+    return dcihid_modify_bits(dcihid_handle, addr, 0, mask, 0, data);
+}
+
+int32_t
+dcihid_toggle_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data) {
+    return dcihid_modify_bits(dcihid_handle, addr, 0, 0, mask, data);
+}
+
+int32_t
+dcihid_write_masked(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, const u_int8_t value,
+                    u_int8_t *data) {
+    return dcihid_modify_bits(dcihid_handle, addr, value & mask, ~value & mask, 0, data);
+}
+
+int32_t
+dcihid_shadow_attach(const u_int64_t dcihid_handle, const char *path) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_shadow        *shadow;
+    pthread_mutexattr_t         attr;
+    char                        shadow_name[PATH_MAX];
+    struct stat                 st;
+    int                         fd;
+
+    if (dcihid_dev->shadow_shared) return 0;
+    if (path == NULL) {
+        snprintf(shadow_name, sizeof(shadow_name), DCIHID_SHADOW_FILE, dcihid_dev->card_type, dcihid_dev->card_id);
+        path = shadow_name;
+    }
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+        perror("dcihid shadow open");
+        return -1;
+    }
+
+    /* Only one process sets up the file */
+    flock(fd, LOCK_EX);
+    if (fstat(fd, &st) == -1 || (st.st_size < (off_t)sizeof(struct dcihid_shadow) && ftruncate(fd, sizeof(struct dcihid_shadow)) == -1)) {
+        perror("dcihid shadow");
+        goto error;
+    }
+    shadow = (struct dcihid_shadow *)mmap(NULL, sizeof(struct dcihid_shadow), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shadow == MAP_FAILED) {
+        perror("dcihid shadow mmap");
+        goto error;
+    }
+    if (shadow->magic != DCIHID_SHADOW_MAGIC) {
+        memset(shadow, 0, sizeof(struct dcihid_shadow));
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&shadow->lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        shadow->magic = DCIHID_SHADOW_MAGIC;
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    /*
+     * Writes lock and unlock the shadow they found under dev->lock, switch
+     * it under the same lock. Another thread may have attached meanwhile.
+     */
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if (dcihid_dev->shadow_shared) {
+        pthread_mutex_unlock(&dcihid_dev->lock);
+        munmap(shadow, sizeof(struct dcihid_shadow));
+        return 0;
+    }
+    dcihid_dev->shadow = shadow;
+    dcihid_dev->shadow_shared = 1;
+
+    /* A replugged board starts from its default outputs, forget the old values */
+    dcihid_shadow_lock(dcihid_dev);
+    if (shadow->busnum != dcihid_dev->device_info.busnum || shadow->devnum != dcihid_dev->device_info.devnum) {
+        memset(shadow->valid, 0, sizeof(shadow->valid));
+        memcpy(shadow->report, dcihid_dev->output_values, sizeof(shadow->report));
+        shadow->busnum = dcihid_dev->device_info.busnum;
+        shadow->devnum = dcihid_dev->device_info.devnum;
+    }
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return 0;
+
+error:
+    flock(fd, LOCK_UN);
+    close(fd);
+    return -1;
+}
+
+static int32_t
+dcihid_read_input(dcihid_dev_t dcihid_dev, struct dcihid_input *input) {
+    struct hiddev_field_info        *field_info = &dcihid_dev->field_info_input;
+    int32_t                         values[DCIHID_REPORT_INPUT_MAX];
+    unsigned                        num_values;
+    unsigned                        yalv;
+
+    num_values = field_info->maxusage;
+    if (num_values > DCIHID_REPORT_INPUT_MAX) num_values = DCIHID_REPORT_INPUT_MAX;
+    if (num_values <= eport4) {
+        fprintf(stderr, "Input report with %u usages can not be handled\n", num_values);
+        return -1;
+    }
+
+    if (dcihid_gone(dcihid_dev) || dcihid_dev->transport->receive(dcihid_dev, 0, num_values, values) == -1) return -1;
+
+    memset(input, 0, sizeof(struct dcihid_input));
+    input->card_type = values[eCard_ID] & 0xFF;
+    input->card_id   = values[eCard_Num] & 0xFF;
+    for (yalv = 0; yalv < DCIHID_INPUT_PORTS; yalv++) {
+        /* Inputs are reported inverted, same as dcihid_read() */
+        input->port[yalv] = ~values[eport1 + yalv] & 0xFF;
+    }
+    if (num_values > eupper_adc_result) {
+        input->adc_index  = values[eadc_index] & 0xFF;
+        input->adc_result = (values[elower_adc_result] & 0xFF) |
+                            ((values[eupper_adc_result] & 0xFF) << 8);
+    }
+
+    return 0;
+}
+
+int32_t
+dcihid_read_all(const u_int64_t dcihid_handle, struct dcihid_input *input) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    ret = dcihid_coalesce_before_read(dcihid_dev, 0, DCIHID_INPUT_PORTS);
+    dcihid_shadow_unlock(dcihid_dev);
+    if (ret == 0) ret = dcihid_read_input(dcihid_dev, input);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+/*
+ * Sends the pending writes when their window ends
+ */
+static void *
+dcihid_coalesce_run(void *arg) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)arg;
+    struct dcihid_coalesce      *coalesce = dcihid_dev->coalesce;
+    struct timespec             deadline, now;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    while (!coalesce->stop) {
+        if (coalesce->stats.pending == 0) {
+            pthread_cond_wait(&coalesce->cond, &dcihid_dev->lock);
+            continue;
+        }
+        deadline.tv_sec = coalesce->deadline / NSEC_PER_SEC;
+        deadline.tv_nsec = coalesce->deadline % NSEC_PER_SEC;
+        pthread_cond_timedwait(&coalesce->cond, &dcihid_dev->lock, &deadline);
+
+        /* Woken by a flush or the stop, or the window is over */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (coalesce->stats.pending && (u_int64_t)(now.tv_sec * NSEC_PER_SEC + now.tv_nsec) >= coalesce->deadline) {
+            coalesce->stats.windows++;
+            dcihid_shadow_lock(dcihid_dev);
+            dcihid_coalesce_flush_locked(dcihid_dev);
+            dcihid_shadow_unlock(dcihid_dev);
+        }
+    }
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return NULL;
+}
+
+int32_t
+dcihid_coalesce_enable(const u_int64_t dcihid_handle, const u_int32_t window_us) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_coalesce      *coalesce;
+    pthread_condattr_t          attr;
+
+    /* Already on, start over with the new window */
+    if (dcihid_dev->coalesce && dcihid_coalesce_disable(dcihid_handle) != 0) return -1;
+
+    coalesce = (struct dcihid_coalesce *)calloc(1, sizeof(struct dcihid_coalesce));
+    if (coalesce == NULL) return -1;
+    coalesce->window_ns = (u_int64_t)window_us * 1000;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&coalesce->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_dev->coalesce = coalesce;
+    pthread_mutex_unlock(&dcihid_dev->lock);
+
+    /* Without a window, writes only go out on dcihid_flush() */
+    if (window_us && pthread_create(&coalesce->thread, NULL, dcihid_coalesce_run, dcihid_dev) != 0) {
+        perror("dcihid coalesce: pthread_create");
+        pthread_mutex_lock(&dcihid_dev->lock);
+        dcihid_dev->coalesce = NULL;
+        pthread_mutex_unlock(&dcihid_dev->lock);
+        pthread_cond_destroy(&coalesce->cond);
+        free(coalesce);
+        return -1;
     }
     return 0;
 }
 
+/*
+ * Sends the pending writes, and goes back to writing at once
+ */
+int32_t
+dcihid_coalesce_disable(const u_int64_t dcihid_handle) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_coalesce      *coalesce = dcihid_dev->coalesce;
+    int32_t                     ret;
+
+    if (coalesce == NULL) return 0;
+    pthread_mutex_lock(&dcihid_dev->lock);
+    coalesce->stop = 1;
+    pthread_cond_signal(&coalesce->cond);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    if (coalesce->window_ns) pthread_join(coalesce->thread, NULL);
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    dcihid_shadow_lock(dcihid_dev);
+    ret = dcihid_coalesce_flush_locked(dcihid_dev);
+    dcihid_shadow_unlock(dcihid_dev);
+    dcihid_dev->coalesce = NULL;
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    pthread_cond_destroy(&coalesce->cond);
+    free(coalesce);
+    return ret;
+}
+
+/*
+ * Sends the pending writes now. Writes made before the flush reach the
+ * board before any made after it, the ordering barrier of coalescing.
+ */
+int32_t
+dcihid_flush(const u_int64_t dcihid_handle) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret = 0;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if (dcihid_dev->coalesce) {
+        dcihid_dev->coalesce->stats.flushes++;
+        dcihid_shadow_lock(dcihid_dev);
+        ret = dcihid_coalesce_flush_locked(dcihid_dev);
+        dcihid_shadow_unlock(dcihid_dev);
+    }
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+int32_t
+dcihid_coalesce_get_stats(const u_int64_t dcihid_handle, struct dcihid_coalesce_stats *stats) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret = 0;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if (dcihid_dev->coalesce) {
+        memcpy(stats, &dcihid_dev->coalesce->stats, sizeof(struct dcihid_coalesce_stats));
+    } else {
+        memset(stats, 0, sizeof(struct dcihid_coalesce_stats));
+        errno = ENOTSUP;
+        ret = -1;
+    }
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+/*
+ * Reopens a board from cached metadata, only if HIDIOCGDEVINFO (or
+ * HIDIOCGRAWINFO) still reports the same USB device.
+ */
+static dcihid_dev_t
+dcihid_pool_reopen(const struct dcihid_pool_entry *entry) {
+    dcihid_dev_t                dcihid_dev;
+    struct hiddev_devinfo       device_info;
+    int                         fd;
+    struct timespec             start;
+
+    DCIHID_OPEN_START(&start);
+
+    if ((fd = open(entry->cached.devname, entry->cached.transport->open_flags)) < 0) return DCIHID_DEV_NULL;
+    if (!entry->cached.transport->identify(fd, &device_info) ||
+        device_info.busnum != entry->cached.device_info.busnum ||
+        device_info.devnum != entry->cached.device_info.devnum ||
+        device_info.vendor != entry->cached.device_info.vendor ||
+        device_info.product != entry->cached.device_info.product) {
+        close(fd);
+        return DCIHID_DEV_NULL;
+    }
+
+    dcihid_dev = (dcihid_dev_t)malloc(sizeof(struct dcihid_dev));
+    if (dcihid_dev == DCIHID_DEV_NULL) {
+        close(fd);
+        return DCIHID_DEV_NULL;
+    }
+    memcpy(dcihid_dev, &entry->cached, sizeof(struct dcihid_dev));
+    dcihid_dev->fd = fd;
+    dcihid_shadow_init(dcihid_dev);
+    pthread_mutex_init(&dcihid_dev->lock, NULL);
+#ifdef _DCIHID_STATS_
+    memset(&dcihid_dev->stats, 0, sizeof(struct dcihid_stats));
+#endif
+    DCIHID_OPEN_TIMED(dcihid_dev, &start);
+    return dcihid_dev;
+}
+
+u_int64_t
+dcihid_pool_open(const char *dev_name, const u_int card_type, const u_int card_id) {
+    struct dcihid_pool_entry    *entry = NULL, *unused = NULL;
+    struct timespec             start;
+    char                        devname[64];
+    dcihid_dev_t                dcihid_dev = DCIHID_DEV_NULL;
+    int                         i;
+
+    pthread_mutex_lock(&dcihid_pool_lock);
+    dcihid_pool_stats.opens++;
+
+    /* Keyed by (type, ID), and by path when one is given */
+    for (i = 0; i < DCIHID_POOL_MAX; i++) {
+        if (!dcihid_pool[i].used) {
+            if (unused == NULL) unused = &dcihid_pool[i];
+            continue;
+        }
+        if (dcihid_pool[i].card_type != card_type || dcihid_pool[i].card_id != card_id) continue;
+        if (dev_name && dev_name[0] && strcmp(dcihid_pool[i].cached.devname, dev_name) != 0) continue;
+        entry = &dcihid_pool[i];
+        break;
+    }
+
+    if (entry && entry->refcount) {
+        entry->refcount++;
+        dcihid_pool_stats.hits++;
+        dcihid_dev = entry->dcihid_dev;
+        goto done;
+    }
+
+    if (entry) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        dcihid_dev = dcihid_pool_reopen(entry);
+        if (dcihid_dev != DCIHID_DEV_NULL) {
+            dcihid_pool_stats.fast_opens++;
+            dcihid_pool_stats.fast_open_ns += dcihid_elapsed_ns(&start);
+            entry->refcount = 1;
+            entry->dcihid_dev = dcihid_dev;
+            goto done;
+        }
+        /* The board changed, forget it */
+        entry->used = 0;
+        unused = entry;
+    }
+
+    if (unused == NULL) goto done;
+    if (dev_name && dev_name[0]) {
+        if (strlen(dev_name) >= sizeof(devname)) goto done;
+        strcpy(devname, dev_name);
+    } else if (dcihid_lookup(card_type, card_id, devname, sizeof(devname)) != 0) {
+        goto done;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    dcihid_dev = (dcihid_dev_t)dcihid_open(devname, card_type, card_id);
+    if (dcihid_dev == DCIHID_DEV_NULL) goto done;
+    dcihid_pool_stats.full_opens++;
+    dcihid_pool_stats.full_open_ns += dcihid_elapsed_ns(&start);
+
+    unused->used = 1;
+    unused->card_type = card_type;
+    unused->card_id = card_id;
+    unused->refcount = 1;
+    unused->dcihid_dev = dcihid_dev;
+    memcpy(&unused->cached, dcihid_dev, sizeof(struct dcihid_dev));
+    unused->cached.fd = -1;
+
+done:
+    pthread_mutex_unlock(&dcihid_pool_lock);
+    return (u_int64_t)dcihid_dev;
+}
+
+int32_t
+dcihid_pool_close(const u_int64_t dcihid_handle) {
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    int32_t                     ret = -1;
+    int                         i;
+
+    pthread_mutex_lock(&dcihid_pool_lock);
+    for (i = 0; i < DCIHID_POOL_MAX; i++) {
+        if (!dcihid_pool[i].used || !dcihid_pool[i].refcount || dcihid_pool[i].dcihid_dev != dcihid_dev) continue;
+        if (--dcihid_pool[i].refcount == 0) {
+            dcihid_close(dcihid_handle);
+            dcihid_pool[i].dcihid_dev = DCIHID_DEV_NULL;
+        }
+        ret = 0;
+        break;
+    }
+    pthread_mutex_unlock(&dcihid_pool_lock);
+    return ret;
+}
+
+void
+dcihid_pool_flush(void) {
+    int i;
+
+    pthread_mutex_lock(&dcihid_pool_lock);
+    for (i = 0; i < DCIHID_POOL_MAX; i++) {
+        if (dcihid_pool[i].used && !dcihid_pool[i].refcount) dcihid_pool[i].used = 0;
+    }
+    pthread_mutex_unlock(&dcihid_pool_lock);
+}
+
+void
+dcihid_pool_get_stats(struct dcihid_pool_stats *stats) {
+    int i;
+
+    pthread_mutex_lock(&dcihid_pool_lock);
+    memcpy(stats, &dcihid_pool_stats, sizeof(struct dcihid_pool_stats));
+    stats->entries = 0;
+    stats->referenced = 0;
+    for (i = 0; i < DCIHID_POOL_MAX; i++) {
+        if (!dcihid_pool[i].used) continue;
+        stats->entries++;
+        if (dcihid_pool[i].refcount) stats->referenced++;
+    }
+    pthread_mutex_unlock(&dcihid_pool_lock);
+}
+
+u_int64_t
+dcihid_watch_create(void) {
+    dcihid_watch_t              watch;
+
+    watch = (dcihid_watch_t)calloc(1, sizeof(struct dcihid_watch));
+    if (watch == NULL) return 0;
+    if ((watch->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("epoll_create1");
+        free(watch);
+        return 0;
+    }
+    return (u_int64_t)watch;
+}
+
+/*
+ * Puts the node of a board in the epoll set of the watch, again after
+ * the hotplug monitor reopened it
+ */
+static int32_t
+dcihid_watch_register(dcihid_watch_t watch, struct dcihid_watch_board *board) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev;
+    struct epoll_event          event;
+    int                         flags = HIDDEV_FLAG_UREF, ret = -1;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if (dcihid_gone(dcihid_dev)) goto done;
+
+    /* Deliver struct hiddev_usage_ref records on read(), hidraw delivers whole reports */
+    if (dcihid_dev->transport->id == DCIHID_TRANSPORT_HIDDEV && ioctl(dcihid_dev->fd, HIDIOCSFLAG, &flags) == -1) {
+        fprintf(stderr, "HIDIOCSFLAG: %s\n", strerror(errno));
+        goto done;
+    }
+    if ((flags = fcntl(dcihid_dev->fd, F_GETFL)) == -1 || fcntl(dcihid_dev->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl");
+        goto done;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = board;
+    if (epoll_ctl(watch->epfd, EPOLL_CTL_ADD, dcihid_dev->fd, &event) == -1) {
+        perror("epoll_ctl");
+        goto done;
+    }
+    board->registered = 1;
+    board->generation = dcihid_dev->generation;
+    ret = 0;
+
+done:
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    return ret;
+}
+
+int32_t
+dcihid_watch_add(const u_int64_t watch_handle, const u_int64_t dcihid_handle) {
+    dcihid_watch_t              watch = (dcihid_watch_t)watch_handle;
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_watch_board   *board;
+    struct dcihid_input         input;
+
+    if (dcihid_dev->transport->id == DCIHID_TRANSPORT_SIM) {
+        fprintf(stderr, "Simulated boards can not be watched\n");
+        return -1;
+    }
+
+    /* Start from the current values, so only changes are reported */
+    if (dcihid_read_all(dcihid_handle, &input) != 0) return -1;
+
+    board = (struct dcihid_watch_board *)calloc(1, sizeof(struct dcihid_watch_board));
+    if (board == NULL) return -1;
+    board->dcihid_dev = dcihid_dev;
+    memcpy(board->port, input.port, sizeof(board->port));
+    if (dcihid_watch_register(watch, board) != 0) {
+        free(board);
+        return -1;
+    }
+    board->next = watch->boards;
+    watch->boards = board;
+    return 0;
+}
+
+/*
+ * Reports one input port value seen while watching, if it changed
+ */
+static int32_t
+dcihid_watch_port(struct dcihid_watch_board *board, const u_int8_t addr, const u_int8_t value, dcihid_event_cb callback, void *arg) {
+    struct dcihid_event         event;
+
+    /* Every usage comes with every report, only changes are events */
+    if (value == board->port[addr]) return 0;
+
+    event.dcihid_handle = (u_int64_t)board->dcihid_dev;
+    clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+    event.addr = addr;
+    event.previous = board->port[addr];
+    event.value = value;
+    board->port[addr] = value;
+    if (callback) callback(&event, arg);
+    return 1;
+}
+
+/*
+ * The fd registered for a board, -1 once the hotplug monitor closed or
+ * replaced it. Called with dev->lock held, the fd stays open until it is
+ * released.
+ */
+static int
+dcihid_watch_fd_locked(const struct dcihid_watch_board *board) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev;
+
+    if (dcihid_dev->removed || dcihid_dev->generation != board->generation) return -1;
+    return dcihid_dev->fd;
+}
+
+/*
+ * One non blocking read() on the node of a board. The hotplug monitor
+ * closes and replaces nodes on its own thread, so the read is done under
+ * dev->lock, and returns 0 for an event of a node that is gone: it left
+ * the epoll set when it was closed, dcihid_watch_refresh() registers the
+ * new one. Events are reported after the lock is released, callbacks may
+ * use the handle.
+ */
+static ssize_t
+dcihid_watch_read(struct dcihid_watch_board *board, void *buf, const size_t len) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev;
+    ssize_t                     ret = 0;
+    int                         fd, err = 0;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if ((fd = dcihid_watch_fd_locked(board)) < 0) {
+        board->registered = 0;
+    } else if ((ret = read(fd, buf, len)) < 0) {
+        err = errno;
+    }
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    errno = err;
+    return ret;
+}
+
+/*
+ * A read failed. The node of an unplugged board fails with EIO or ENODEV:
+ * it leaves the epoll set until the hotplug monitor reopens the board.
+ */
+static int32_t
+dcihid_watch_lost(dcihid_watch_t watch, struct dcihid_watch_board *board, const char *what) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev;
+    int                         fd;
+
+    if (errno != EIO && errno != ENODEV && errno != EBADF) {
+        fprintf(stderr, "%s: %s\n", what, strerror(errno));
+        return -1;
+    }
+    /* Not the fd of another generation, nor -1 */
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if ((fd = dcihid_watch_fd_locked(board)) >= 0) epoll_ctl(watch->epfd, EPOLL_CTL_DEL, fd, NULL);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    board->registered = 0;
+    return 0;
+}
+
+/*
+ * Registers the boards reopened since the last call, and reports the
+ * inputs that changed while they were away
+ */
+static int32_t
+dcihid_watch_refresh(dcihid_watch_t watch, dcihid_event_cb callback, void *arg) {
+    struct dcihid_watch_board   *board;
+    struct dcihid_input         input;
+    dcihid_dev_t                dcihid_dev;
+    int32_t                     count = 0;
+    int                         stale, i;
+
+    for (board = watch->boards; board; board = board->next) {
+        dcihid_dev = board->dcihid_dev;
+        pthread_mutex_lock(&dcihid_dev->lock);
+        stale = !dcihid_dev->removed && board->generation != dcihid_dev->generation;
+        pthread_mutex_unlock(&dcihid_dev->lock);
+        if (!stale) continue;
+
+        /* The old fd left the epoll set when it was closed */
+        if (dcihid_watch_register(watch, board) != 0 || dcihid_read_all((u_int64_t)dcihid_dev, &input) != 0) continue;
+        for (i = 0; i < DCIHID_INPUT_PORTS; i++) {
+            count += dcihid_watch_port(board, i, input.port[i], callback, arg);
+        }
+    }
+    return count;
+}
+
+/*
+ * Drains the usage records of one board, reports the ports that changed
+ */
+static int32_t
+dcihid_watch_drain(dcihid_watch_t watch, struct dcihid_watch_board *board, dcihid_event_cb callback, void *arg) {
+    struct hiddev_usage_ref     usage_refs[DCIHID_WATCH_EVENTS];
+    ssize_t                     len;
+    int32_t                     count = 0;
+    size_t                      i;
+
+    while ((len = dcihid_watch_read(board, usage_refs, sizeof(usage_refs))) > 0) {
+        for (i = 0; i < len / sizeof(struct hiddev_usage_ref); i++) {
+            if (usage_refs[i].report_type != HID_REPORT_TYPE_INPUT || usage_refs[i].field_index != 0) continue;
+            if (usage_refs[i].usage_index < eport1 || usage_refs[i].usage_index > eport4) continue;
+            count += dcihid_watch_port(board, usage_refs[i].usage_index - eport1, ~usage_refs[i].value & 0xFF, callback, arg);
+        }
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR) return dcihid_watch_lost(watch, board, "hiddev read");
+    return count;
+}
+
+/*
+ * Same for hidraw, where every read() returns one input report without
+ * the report ID
+ */
+static int32_t
+dcihid_watch_drain_hidraw(dcihid_watch_t watch, struct dcihid_watch_board *board, dcihid_event_cb callback, void *arg) {
+    u_int8_t                    buf[DCIHID_HIDRAW_REPORT_MAX];
+    ssize_t                     len;
+    int32_t                     count = 0;
+    int                         i;
+
+    while ((len = dcihid_watch_read(board, buf, sizeof(buf))) > eport4) {
+        for (i = eport1; i <= eport4; i++) {
+            count += dcihid_watch_port(board, i - eport1, ~buf[i] & 0xFF, callback, arg);
+        }
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR) return dcihid_watch_lost(watch, board, "hidraw read");
+    return count;
+}
+
+int32_t
+dcihid_watch_run(const u_int64_t watch_handle, const int timeout_ms, dcihid_event_cb callback, void *arg) {
+    dcihid_watch_t              watch = (dcihid_watch_t)watch_handle;
+    struct epoll_event          events[DCIHID_WATCH_EVENTS];
+    int32_t                     count, ret;
+    int                         num_events, i;
+
+    count = dcihid_watch_refresh(watch, callback, arg);
+    num_events = epoll_wait(watch->epfd, events, DCIHID_WATCH_EVENTS, timeout_ms);
+    if (num_events < 0) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait");
+        return -1;
+    }
+    for (i = 0; i < num_events; i++) {
+        struct dcihid_watch_board *board = (struct dcihid_watch_board *)events[i].data.ptr;
+
+        if (board->dcihid_dev->transport->id == DCIHID_TRANSPORT_HIDRAW) {
+            ret = dcihid_watch_drain_hidraw(watch, board, callback, arg);
+        } else {
+            ret = dcihid_watch_drain(watch, board, callback, arg);
+        }
+        if (ret < 0) return -1;
+        count += ret;
+    }
+    return count;
+}
+
+int32_t
+dcihid_watch_destroy(const u_int64_t watch_handle) {
+    dcihid_watch_t              watch = (dcihid_watch_t)watch_handle;
+    struct dcihid_watch_board   *board;
+    int                         fd, flags;
+
+    while ((board = watch->boards) != NULL) {
+        watch->boards = board->next;
+        /* A node reopened since was never made non blocking */
+        pthread_mutex_lock(&board->dcihid_dev->lock);
+        if ((fd = dcihid_watch_fd_locked(board)) >= 0) {
+            if (board->registered) epoll_ctl(watch->epfd, EPOLL_CTL_DEL, fd, NULL);
+            if ((flags = fcntl(fd, F_GETFL)) != -1) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
+        pthread_mutex_unlock(&board->dcihid_dev->lock);
+        free(board);
+    }
+    close(watch->epfd);
+    free(watch);
+    return 0;
+}
+
+static u_int64_t
+dcihid_now_ns(void) {
+    struct timespec             now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * Simulated board behind a handle, through the sim transport or a node
+ * of dcisim_wrap.c, -1 for real boards
+ */
+static int
+dcihid_hotplug_sim(const dcihid_dev_t dcihid_dev) {
+    return dcihid_dev->transport->id == DCIHID_TRANSPORT_SIM ? dcihid_dev->sim : dcisim_find(dcihid_dev->devname);
+}
+
+/*
+ * Boards are followed through the kernel uevents of their nodes instead
+ * of probing them: removing a node fails the handles of the board at once
+ * with ENODEV, and the nodes added next are tried for the removed boards.
+ * A board found again gets its new node under the same handle and its
+ * outputs written back from the shadow.
+ */
+u_int64_t
+dcihid_hotplug_create(void) {
+    dcihid_hotplug_t            hotplug;
+    struct sockaddr_nl          addr;
+    struct epoll_event          event;
+
+    hotplug = (dcihid_hotplug_t)calloc(1, sizeof(struct dcihid_hotplug));
+    if (hotplug == NULL) return 0;
+    hotplug->simfd = -1;
+    if ((hotplug->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("epoll_create1");
+        free(hotplug);
+        return 0;
+    }
+
+    /* Group 1 gets the uevents of the kernel, before udev runs its rules */
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;
+    hotplug->nlfd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (hotplug->nlfd >= 0 && bind(hotplug->nlfd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(hotplug->nlfd);
+        hotplug->nlfd = -1;
+    }
+    if (hotplug->nlfd >= 0) {
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = hotplug->nlfd;
+        epoll_ctl(hotplug->epfd, EPOLL_CTL_ADD, hotplug->nlfd, &event);
+    }
+    return (u_int64_t)hotplug;
+}
+
+int32_t
+dcihid_hotplug_add(const u_int64_t hotplug_handle, const u_int64_t dcihid_handle) {
+    dcihid_hotplug_t            hotplug = (dcihid_hotplug_t)hotplug_handle;
+    dcihid_dev_t                dcihid_dev = (dcihid_dev_t)dcihid_handle;
+    struct dcihid_hotplug_board *board;
+    struct epoll_event          event;
+
+    if (dcihid_hotplug_sim(dcihid_dev) >= 0) {
+        /* The simulator stands for the kernel */
+        if (hotplug->simfd < 0) {
+            if ((hotplug->simfd = dcisim_plug_fd()) < 0) return -1;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.fd = hotplug->simfd;
+            if (epoll_ctl(hotplug->epfd, EPOLL_CTL_ADD, hotplug->simfd, &event) == -1) {
+                perror("epoll_ctl");
+                hotplug->simfd = -1;
+                return -1;
+            }
+        }
+    } else if (hotplug->nlfd < 0) {
+        fprintf(stderr, "Kernel uevents are not available, board %s can not be followed\n", dcihid_dev->devname);
+        return -1;
+    }
+
+    board = (struct dcihid_hotplug_board *)calloc(1, sizeof(struct dcihid_hotplug_board));
+    if (board == NULL) return -1;
+    board->dcihid_dev = dcihid_dev;
+    if (realpath(dcihid_dev->devname, board->node) == NULL) snprintf(board->node, sizeof(board->node), "%s", dcihid_dev->devname);
+    board->next = hotplug->boards;
+    hotplug->boards = board;
+    return 0;
+}
+
+/*
+ * Fails the handle until the board is found again
+ */
+static int32_t
+dcihid_hotplug_remove(dcihid_hotplug_t hotplug, struct dcihid_hotplug_board *board, dcihid_hotplug_cb callback, void *arg) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev;
+    struct dcihid_hotplug_event event;
+
+    pthread_mutex_lock(&dcihid_dev->lock);
+    if (dcihid_dev->fd >= 0) close(dcihid_dev->fd);
+    dcihid_dev->fd = -1;
+    dcihid_dev->removed = 1;
+    pthread_mutex_unlock(&dcihid_dev->lock);
+
+    board->removed_ns = dcihid_now_ns();
+    hotplug->num_removed++;
+    hotplug->stats.removals++;
+
+    memset(&event, 0, sizeof(event));
+    event.dcihid_handle = (u_int64_t)dcihid_dev;
+    event.type = DCIHID_HOTPLUG_REMOVED;
+    clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+    snprintf(event.devname, sizeof(event.devname), "%s", dcihid_dev->devname);
+    if (callback) callback(&event, arg);
+    return 1;
+}
+
+/*
+ * Opens a node for a removed board. On success the handle takes the new
+ * node, and the last values written are sent again: the board powered up
+ * with its outputs off.
+ */
+static int32_t
+dcihid_hotplug_reopen(dcihid_hotplug_t hotplug, struct dcihid_hotplug_board *board, const char *path, const u_int64_t since_ns,
+                      dcihid_hotplug_cb callback, void *arg) {
+    dcihid_dev_t                dcihid_dev = board->dcihid_dev, fresh;
+    struct dcihid_shadow        *shadow;
+    struct dcihid_hotplug_event event;
+    u_int64_t                   now_ns;
+    u_int32_t                   addr;
+
+    fresh = (dcihid_dev_t)dcihid_open_transport(path, dcihid_dev->card_type, dcihid_dev->card_id, dcihid_dev->transport->id);
+    if (fresh == DCIHID_DEV_NULL) return -1;
+
+    memset(&event, 0, sizeof(event));
+    pthread_mutex_lock(&dcihid_dev->lock);
+    shadow = dcihid_dev->shadow;
+    dcihid_shadow_lock(dcihid_dev);
+
+    /* Descriptors may differ after a firmware reset, take them all */
+    memcpy(dcihid_dev->devname, fresh->devname, sizeof(dcihid_dev->devname));
+    memcpy(dcihid_dev->prodname, fresh->prodname, sizeof(dcihid_dev->prodname));
+    dcihid_dev->fd = fresh->fd;
+    dcihid_dev->sim = fresh->sim;
+    dcihid_dev->device_info = fresh->device_info;
+    dcihid_dev->report_info_input = fresh->report_info_input;
+    dcihid_dev->field_info_input = fresh->field_info_input;
+    dcihid_dev->usage_code_input = fresh->usage_code_input;
+    dcihid_dev->report_info_output = fresh->report_info_output;
+    dcihid_dev->field_info_output = fresh->field_info_output;
+    dcihid_dev->usage_code_output = fresh->usage_code_output;
+    memcpy(dcihid_dev->output_values, fresh->output_values, sizeof(dcihid_dev->output_values));
+    dcihid_dev->output_num_values = fresh->output_num_values;
+    dcihid_dev->output_multi = fresh->output_multi;
+    dcihid_dev->removed = 0;
+    dcihid_dev->generation++;
+    fresh->fd = -1;
+
+    for (addr = 0; addr < DCIHID_PORTS_MAX; addr++) {
+        if (!(shadow->valid[addr / 8] & (1 << (addr % 8)))) continue;
+        if (!(dciboard_access(dcihid_dev->card_type, addr) & DCIBOARD_WRITE)) continue;
+        if (dcihid_dev->transport->send(dcihid_dev, addr, shadow->value[addr]) == 0) {
+            event.replayed++;
+        } else {
+            event.status = -1;
+        }
+    }
+    if (dcihid_dev->coalesce && dcihid_coalesce_flush_locked(dcihid_dev) != 0) event.status = -1;
+
+    /* The shared shadow is right for the new device number again */
+    if (dcihid_dev->shadow_shared) {
+        shadow->busnum = dcihid_dev->device_info.busnum;
+        shadow->devnum = dcihid_dev->device_info.devnum;
+    }
+    dcihid_shadow_unlock(dcihid_dev);
+    pthread_mutex_unlock(&dcihid_dev->lock);
+    dcihid_close((u_int64_t)fresh);
+
+    now_ns = dcihid_now_ns();
+    event.dcihid_handle = (u_int64_t)dcihid_dev;
+    event.type = DCIHID_HOTPLUG_RECOVERED;
+    clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+    snprintf(event.devname, sizeof(event.devname), "%s", dcihid_dev->devname);
+    event.down_ns = now_ns - board->removed_ns;
+    event.reopen_ns = now_ns - since_ns;
+
+    if (realpath(dcihid_dev->devname, board->node) == NULL) snprintf(board->node, sizeof(board->node), "%s", dcihid_dev->devname);
+    board->removed_ns = 0;
+    hotplug->num_removed--;
+    hotplug->stats.recoveries++;
+    dcihid_stat_add(&hotplug->stats.down, event.down_ns, event.status != 0);
+    dcihid_stat_add(&hotplug->stats.reopen, event.reopen_ns, event.status != 0);
+    if (callback) callback(&event, arg);
+    return 0;
+}
+
+static void
+dcihid_hotplug_drop_node(dcihid_hotplug_t hotplug, const u_int32_t i) {
+    hotplug->num_nodes--;
+    memmove(&hotplug->nodes[i], &hotplug->nodes[i + 1], (hotplug->num_nodes - i) * sizeof(struct dcihid_hotplug_node));
+}
+
+/*
+ * Tries the nodes added for the removed boards. udev may not have given
+ * a node its permissions yet, such nodes are tried again later.
+ */
+static int32_t
+dcihid_hotplug_claim(dcihid_hotplug_t hotplug, dcihid_hotplug_cb callback, void *arg) {
+    struct dcihid_hotplug_board *board;
+    struct dcihid_hotplug_node  *node;
+    int32_t                     count = 0;
+    u_int32_t                   i = 0;
+    int                         mode;
+
+    while (i < hotplug->num_nodes) {
+        node = &hotplug->nodes[i];
+        if (hotplug->num_removed == 0) {
+            /* Some other device */
+            dcihid_hotplug_drop_node(hotplug, i);
+            continue;
+        }
+
+        mode = (dcihid_transports[node->transport].open_flags & O_ACCMODE) == O_RDWR ? R_OK | W_OK : R_OK;
+        if (access(node->path, mode) != 0) {
+            if (dcihid_now_ns() - node->added_ns < DCIHID_HOTPLUG_GIVEUP_MS * 1000000ULL) {
+                hotplug->stats.retries++;
+                i++;
+            } else {
+                dcihid_hotplug_drop_node(hotplug, i);
+            }
+            continue;
+        }
+
+        for (board = hotplug->boards; board; board = board->next) {
+            if (!board->removed_ns || board->dcihid_dev->transport->id != node->transport) continue;
+            if (dcihid_hotplug_reopen(hotplug, board, node->path, node->added_ns, callback, arg) == 0) {
+                count++;
+                break;
+            }
+        }
+        dcihid_hotplug_drop_node(hotplug, i);
+    }
+    return count;
+}
+
+/*
+ * Handles the uevents received, only hiddev and hidraw nodes matter
+ */
+static int32_t
+dcihid_hotplug_uevents(dcihid_hotplug_t hotplug, dcihid_hotplug_cb callback, void *arg) {
+    struct dcihid_hotplug_board *board;
+    struct dcihid_hotplug_node  *node;
+    struct sockaddr_nl          sender;
+    socklen_t                   sender_len;
+    char                        buf[DCIHID_HOTPLUG_BUFFER], path[PATH_MAX];
+    const char                  *action, *subsystem, *devname, *key;
+    ssize_t                     len;
+    int32_t                     count = 0;
+    u_int32_t                   i;
+    int                         transport;
+
+    for (;;) {
+        sender_len = sizeof(sender);
+        len = recvfrom(hotplug->nlfd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&sender, &sender_len);
+        if (len < 0) break;
+
+        /* Only the kernel sends to this group, and the payload is "action@devpath\0KEY=value\0..." */
+        if (sender.nl_pid != 0 || len == 0) continue;
+        buf[len] = '\0';
+        hotplug->stats.uevents++;
+        action = subsystem = devname = NULL;
+        for (key = buf; key < buf + len; key += strlen(key) + 1) {
+            if (strncmp(key, "ACTION=", 7) == 0) action = key + 7;
+            else if (strncmp(key, "SUBSYSTEM=", 10) == 0) subsystem = key + 10;
+            else if (strncmp(key, "DEVNAME=", 8) == 0) devname = key + 8;
+        }
+        if (action == NULL || subsystem == NULL || devname == NULL) continue;
+        if (strcmp(subsystem, "usbmisc") == 0 && strncmp(devname, "usb/hiddev", 10) == 0) {
+            transport = DCIHID_TRANSPORT_HIDDEV;
+        } else if (strcmp(subsystem, "hidraw") == 0) {
+            transport = DCIHID_TRANSPORT_HIDRAW;
+        } else {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/dev/%s", devname);
+
+        if (strcmp(action, "remove") == 0) {
+            for (i = 0; i < hotplug->num_nodes; i++) {
+                if (strcmp(hotplug->nodes[i].path, path) == 0) dcihid_hotplug_drop_node(hotplug, i--);
+            }
+            for (board = hotplug->boards; board; board = board->next) {
+                if (!board->removed_ns && strcmp(board->node, path) == 0) count += dcihid_hotplug_remove(hotplug, board, callback, arg);
+            }
+        } else if (strcmp(action, "add") == 0) {
+            if (hotplug->num_nodes == DCIHID_HOTPLUG_NODES) dcihid_hotplug_drop_node(hotplug, 0);
+            node = &hotplug->nodes[hotplug->num_nodes++];
+            snprintf(node->path, sizeof(node->path), "%s", path);
+            node->transport = transport;
+            node->added_ns = dcihid_now_ns();
+        }
+    }
+
+    if (errno == ENOBUFS) {
+        /* The socket overflowed and uevents were lost, the next ones still count */
+        fprintf(stderr, "dcihid hotplug: uevents lost\n");
+    } else if (errno != EAGAIN && errno != EINTR) {
+        perror("dcihid hotplug recv");
+        return -1;
+    }
+    return count;
+}
+
+/*
+ * Same for the plug changes of the simulator
+ */
+static int32_t
+dcihid_hotplug_simulated(dcihid_hotplug_t hotplug, dcihid_hotplug_cb callback, void *arg) {
+    struct dcihid_hotplug_board *board;
+    u_int64_t                   changes, now_ns;
+    int32_t                     count = 0;
+    int                         sim, plugged;
+
+    if (read(hotplug->simfd, &changes, sizeof(changes)) != sizeof(changes)) return 0;
+    hotplug->stats.uevents++;
+    now_ns = dcihid_now_ns();
+
+    for (board = hotplug->boards; board; board = board->next) {
+        if ((sim = dcihid_hotplug_sim(board->dcihid_dev)) < 0) continue;
+        plugged = dcisim_plugged(sim);
+        if (!plugged && !board->removed_ns) {
+            count += dcihid_hotplug_remove(hotplug, board, callback, arg);
+        } else if (plugged && board->removed_ns && dcihid_hotplug_reopen(hotplug, board, board->node, now_ns, callback, arg) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Waits up to timeout_ms for boards to go or come back, and reports them.
+ * Returns the number of events, -1 on error.
+ */
+int32_t
+dcihid_hotplug_run(const u_int64_t hotplug_handle, const int timeout_ms, dcihid_hotplug_cb callback, void *arg) {
+    dcihid_hotplug_t            hotplug = (dcihid_hotplug_t)hotplug_handle;
+    struct epoll_event          events[2];
+    int32_t                     count = 0, ret;
+    int                         num_events, timeout = timeout_ms, i;
+
+    /* Nodes waiting for their permissions are tried again soon */
+    if (hotplug->num_nodes && (timeout < 0 || timeout > DCIHID_HOTPLUG_RETRY_MS)) timeout = DCIHID_HOTPLUG_RETRY_MS;
+
+    num_events = epoll_wait(hotplug->epfd, events, 2, timeout);
+    if (num_events < 0) {
+        if (errno == EINTR) return 0;
+        perror("epoll_wait");
+        return -1;
+    }
+    for (i = 0; i < num_events; i++) {
+        if (events[i].data.fd == hotplug->nlfd) {
+            ret = dcihid_hotplug_uevents(hotplug, callback, arg);
+        } else {
+            ret = dcihid_hotplug_simulated(hotplug, callback, arg);
+        }
+        if (ret < 0) return -1;
+        count += ret;
+    }
+    if (hotplug->num_nodes) count += dcihid_hotplug_claim(hotplug, callback, arg);
+    return count;
+}
+
+int32_t
+dcihid_hotplug_get_stats(const u_int64_t hotplug_handle, struct dcihid_hotplug_stats *stats) {
+    memcpy(stats, &((dcihid_hotplug_t)hotplug_handle)->stats, sizeof(struct dcihid_hotplug_stats));
+    return 0;
+}
+
+/*
+ * Stops following the boards, handles of removed boards keep failing
+ */
+int32_t
+dcihid_hotplug_destroy(const u_int64_t hotplug_handle) {
+    dcihid_hotplug_t            hotplug = (dcihid_hotplug_t)hotplug_handle;
+    struct dcihid_hotplug_board *board;
+
+    while ((board = hotplug->boards) != NULL) {
+        hotplug->boards = board->next;
+        free(board);
+    }
+    if (hotplug->nlfd >= 0) close(hotplug->nlfd);
+    close(hotplug->epfd);
+    free(hotplug);
+    return 0;
+}
+
+/*
+ * Identifies the board on one hiddev node, used by the parallel scan.
+ */
+struct dcihid_probe {
+    pthread_t               thread;
+    int                     started;
+    int                     found;
+    struct dcihid_devent    devent;
+};
+
+static void *
+dcihid_probe_node(void *arg) {
+    struct dcihid_probe     *probe = (struct dcihid_probe *)arg;
+    struct hiddev_devinfo   device_info;
+    u_int                   card_type, card_id;
+    int                     fd;
+
+    if ((fd = open(probe->devent.devname, O_RDONLY | O_CLOEXEC)) < 0) return NULL;
+    if (dcihid_is_dci(fd, &device_info) &&
+        ioctl(fd, HIDIOCINITREPORT) != -1 &&
+        dcihid_card_of(fd, &card_type, &card_id) != -1) {
+        probe->devent.card_type = card_type;
+        probe->devent.card_id = card_id;
+        probe->devent.busnum = device_info.busnum;
+        probe->devent.devnum = device_info.devnum;
+        probe->found = 1;
+    }
+    close(fd);
+    return NULL;
+}
+
+static const char *
+dcihid_index_file(void) {
+    const char *index_file = getenv(DCIHID_INDEX_ENV);
+
+    return (index_file && index_file[0]) ? index_file : DCIHID_INDEX_FILE;
+}
+
+/*
+ * Rewrites the index file, best effort: boards are still found without it
+ */
+static void
+dcihid_index_write(const struct dcihid_devent *list, const int32_t count) {
+    const char  *index_file = dcihid_index_file();
+    char        tmpname[PATH_MAX];
+    FILE        *fp;
+    int32_t     i;
+
+    if (snprintf(tmpname, sizeof(tmpname), "%s.%d", index_file, (int)getpid()) >= (int)sizeof(tmpname)) return;
+    if ((fp = fopen(tmpname, "w")) == NULL) return;
+    for (i = 0; i < count; i++) {
+        fprintf(fp, "%s 0x%02X %u %u %u\n", list[i].devname, list[i].card_type, list[i].card_id, list[i].busnum, list[i].devnum);
+    }
+    if (fclose(fp) != 0 || rename(tmpname, index_file) != 0) unlink(tmpname);
+}
+
+int32_t
+dcihid_enumerate(struct dcihid_devent *list, const u_int32_t max) {
+    struct dcihid_probe     *probes;
+    glob_t                  nodes;
+    size_t                  num_nodes, i;
+    int32_t                 count = 0;
+    int                     truncated;
+
+    memset(&nodes, 0, sizeof(nodes));
+    glob("/dev/usb/hiddev*", 0, NULL, &nodes);
+    glob("/dev/hiddev*", GLOB_APPEND, NULL, &nodes);
+    num_nodes = nodes.gl_pathc < DCIHID_NODES_MAX ? nodes.gl_pathc : DCIHID_NODES_MAX;
+    truncated = (nodes.gl_pathc > num_nodes);
+
+    probes = (struct dcihid_probe *)calloc(num_nodes ? num_nodes : 1, sizeof(struct dcihid_probe));
+    if (probes == NULL) {
+        globfree(&nodes);
+        return -1;
+    }
+
+    /* Every node gets probed at the same time, a board takes a few ms to answer */
+    for (i = 0; i < num_nodes; i++) {
+        if (strlen(nodes.gl_pathv[i]) >= sizeof(probes[i].devent.devname)) continue;
+        strcpy(probes[i].devent.devname, nodes.gl_pathv[i]);
+        probes[i].started = (pthread_create(&probes[i].thread, NULL, dcihid_probe_node, &probes[i]) == 0);
+        if (!probes[i].started) dcihid_probe_node(&probes[i]);
+    }
+    for (i = 0; i < num_nodes; i++) {
+        if (probes[i].started) pthread_join(probes[i].thread, NULL);
+        if (!probes[i].found) continue;
+        if ((u_int32_t)count >= max) {
+            truncated = 1;
+            continue;
+        }
+        memcpy(&list[count++], &probes[i].devent, sizeof(struct dcihid_devent));
+    }
+    globfree(&nodes);
+    free(probes);
+
+    /* A partial list would hide the boards left out from dcihid_lookup(), keep the old index */
+    if (!truncated) dcihid_index_write(list, count);
+    return count;
+}
+
+/*
+ * Checks an index entry still points to the same USB device
+ */
+static int
+dcihid_index_valid(const struct dcihid_devent *devent) {
+    struct hiddev_devinfo   device_info;
+    int                     fd, valid;
+
+    if ((fd = open(devent->devname, O_RDONLY | O_CLOEXEC)) < 0) return 0;
+    valid = dcihid_is_dci(fd, &device_info) &&
+            device_info.busnum == devent->busnum &&
+            device_info.devnum == devent->devnum;
+    close(fd);
+    return valid;
+}
+
+int32_t
+dcihid_lookup(const u_int card_type, const u_int card_id, char *dev_name, const size_t len) {
+    struct dcihid_devent    list[DCIHID_NODES_MAX];
+    struct dcihid_devent    devent;
+    u_int                   found_type, found_id;
+    int32_t                 count, i;
+    FILE                    *fp;
+
+    /* Index first, a node is only trusted while its bus and device numbers match */
+    if ((fp = fopen(dcihid_index_file(), "r")) != NULL) {
+        while (fscanf(fp, "%63s %x %u %u %u", devent.devname, &found_type, &found_id, &devent.busnum, &devent.devnum) == 5) {
+            if (found_type != card_type || found_id != card_id) continue;
+            if (!dcihid_index_valid(&devent) || strlen(devent.devname) >= len) break;
+            fclose(fp);
+            strcpy(dev_name, devent.devname);
+            return 0;
+        }
+        fclose(fp);
+    }
+
+    /* Stale or missing, scan again */
+    if ((count = dcihid_enumerate(list, DCIHID_NODES_MAX)) < 0) return -1;
+    for (i = 0; i < count; i++) {
+        if (list[i].card_type != card_type || list[i].card_id != card_id) continue;
+        if (strlen(list[i].devname) >= len) return -1;
+        strcpy(dev_name, list[i].devname);
+        return 0;
+    }
+    return -1;
+}
+
+u_int
+dcihid_assert_card_type(const u_int card_type) {
+    return dciboard_card(card_type) != NULL;
+}
+
+u_int
+dcihid_card_has_adc(const u_int card_type) {
+    const struct dciboard_card  *card = dciboard_card(card_type);
+
+    return card && card->adc;
+}
+
 u_int
 dcihid_assert_card_id(const u_int card_id) {
     if (card_id <= 14) return 1;
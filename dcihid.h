@@ -2,10 +2,14 @@
 #define _DCIHID_H_
 
 #include <sys/types.h>
+#include <time.h>
 
 // Uncoment if you need debug messages printed:
 //#define _DCIHID_DEBUG_
 
+// Uncoment (or build with 'make STATS=1') to count and time every ioctl, see dcihid_get_stats():
+//#define _DCIHID_STATS_
+
 /*
  * device type definitions
  */
@@ -24,6 +28,139 @@
 #define USB_IND     0x0E // USB Industry Board
 #define USB_M_4IO   0x10 // USB Mini 4 I/O
 
+/*
+ * transports, as given to dcihid_open_transport()
+ */
+#define DCIHID_TRANSPORT_HIDDEV 0   // hiddev ioctls on /dev/usb/hiddevN, as dcihid_open()
+#define DCIHID_TRANSPORT_HIDRAW 1   // Whole reports on /dev/hidrawN, one syscall per transfer
+#define DCIHID_TRANSPORT_SIM    2   // Software model of the board, see dcisim.h
+
+/*
+ * input report snapshot, as returned by dcihid_read_all()
+ */
+#define DCIHID_INPUT_PORTS  4
+
+struct dcihid_input {
+    u_int8_t    card_type;                  // Card type reported by the board
+    u_int8_t    card_id;                    // Card ID set on the DIP switch
+    u_int8_t    port[DCIHID_INPUT_PORTS];   // Port 0x00 to 0x03, same values as dcihid_read()
+    u_int8_t    adc_index;                  // ADC channel of the last conversion
+    u_int16_t   adc_result;                 // ADC result (upper << 8 | lower)
+};
+
+/*
+ * single output report, as sent by dcihid_write_multi()
+ */
+struct dcihid_write_op {
+    u_int8_t    addr;                       // Port address to write to
+    u_int8_t    data;                       // Byte to be written
+};
+
+/*
+ * board found on a hiddev node, as returned by dcihid_enumerate()
+ */
+struct dcihid_devent {
+    char        devname[64];                // Linux HID device, for example: /dev/usb/hiddev0
+    u_int8_t    card_type;                  // Card type reported by the board
+    u_int8_t    card_id;                    // Card ID set on the DIP switch
+    u_int32_t   busnum;                     // USB bus number
+    u_int32_t   devnum;                     // USB device number, changes on every replug
+};
+
+/*
+ * input port change, as reported by dcihid_watch_run()
+ */
+struct dcihid_event {
+    u_int64_t       dcihid_handle;          // Board the change happened on
+    struct timespec timestamp;              // CLOCK_MONOTONIC time the change was seen
+    u_int8_t        addr;                   // Port 0x00 to 0x03
+    u_int8_t        value;                  // New value, same as dcihid_read()
+    u_int8_t        previous;               // Value before the change
+};
+typedef void (*dcihid_event_cb)(const struct dcihid_event *event, void *arg);
+
+/*
+ * board unplugged or reopened, as reported by dcihid_hotplug_run()
+ */
+#define DCIHID_HOTPLUG_REMOVED      0   // The node went away, I/O fails with ENODEV until recovered
+#define DCIHID_HOTPLUG_RECOVERED    1   // Reopened on its new node, outputs written back
+
+struct dcihid_hotplug_event {
+    u_int64_t       dcihid_handle;          // Same handle before and after the recovery
+    int             type;                   // DCIHID_HOTPLUG_*
+    struct timespec timestamp;              // CLOCK_MONOTONIC time of the event
+    char            devname[64];            // Node of the board, the new one once recovered
+    u_int64_t       down_ns;                // From the removal to the recovery
+    u_int64_t       reopen_ns;              // From the node coming back to the recovery
+    u_int32_t       replayed;               // Output ports written back from the shadow
+    int32_t         status;                 // -1 if one of them failed
+};
+typedef void (*dcihid_hotplug_cb)(const struct dcihid_hotplug_event *event, void *arg);
+
+/*
+ * ioctl statistics, as returned by dcihid_get_stats()
+ */
+#define DCIHID_STAT_GREPORT 0       // HIDIOCGREPORT, HIDIOCGINPUT on hidraw
+#define DCIHID_STAT_GUSAGE  1       // HIDIOCGUSAGE and HIDIOCGUSAGES
+#define DCIHID_STAT_SUSAGE  2       // HIDIOCSUSAGE and HIDIOCSUSAGES
+#define DCIHID_STAT_SREPORT 3       // HIDIOCSREPORT, write() on hidraw
+#define DCIHID_STAT_OPEN    4       // Whole open, with the descriptor enumeration
+#define DCIHID_STAT_MAX     5
+
+#define DCIHID_STAT_BUCKETS 40      // Bucket i counts latencies from 2^(i-1) to 2^i - 1 ns
+#define DCIHID_STAT_ERRNOS  128     // Errors by errno, index 0 counts the errno values above
+
+struct dcihid_stat {
+    u_int64_t   count;
+    u_int64_t   errors;
+    u_int64_t   total_ns;
+    u_int64_t   max_ns;
+    u_int64_t   hist[DCIHID_STAT_BUCKETS];
+};
+
+struct dcihid_stats {
+    struct dcihid_stat  op[DCIHID_STAT_MAX];
+    u_int64_t           errnos[DCIHID_STAT_ERRNOS];
+};
+
+/*
+ * handle pool counters, as returned by dcihid_pool_get_stats()
+ */
+struct dcihid_pool_stats {
+    u_int32_t   entries;                    // Boards with cached metadata
+    u_int32_t   referenced;                 // Boards currently open
+    u_int64_t   opens;                      // Calls to dcihid_pool_open()
+    u_int64_t   hits;                       // Opens served by an already open handle
+    u_int64_t   fast_opens;                 // Reopens from cached metadata
+    u_int64_t   fast_open_ns;               // Time spent in reopens from cached metadata
+    u_int64_t   full_opens;                 // Opens that walked the descriptors
+    u_int64_t   full_open_ns;               // Time spent in opens that walked the descriptors
+};
+
+/*
+ * write coalescing counters, as returned by dcihid_coalesce_get_stats()
+ */
+struct dcihid_coalesce_stats {
+    u_int64_t   submitted;                  // Writes taken while coalescing
+    u_int64_t   sent;                       // Output reports sent for them, the others were overwritten
+    u_int64_t   flushes;                    // Calls to dcihid_flush(), and reads of a port with a pending write
+    u_int64_t   windows;                    // Windows that ended with writes pending
+    u_int64_t   errors;                     // Output reports that failed
+    u_int32_t   pending;                    // Ports with a write not sent yet
+};
+
+/*
+ * hotplug counters, as returned by dcihid_hotplug_get_stats()
+ */
+struct dcihid_hotplug_stats {
+    u_int64_t   uevents;                    // Kernel uevents and simulator plug changes received
+    u_int64_t   removals;
+    u_int64_t   recoveries;
+    u_int64_t   retries;                    // Reopens put off, the new node was not accessible yet
+    struct dcihid_stat down;                // Removal to recovery, in ns
+    struct dcihid_stat reopen;              // Node back to recovery, in ns
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -31,13 +168,48 @@ extern "C" {
  * function prototypes
  */
 u_int64_t   dcihid_open(const char *dev_name, const u_int card_type, const u_int card_id);
+u_int64_t   dcihid_open_transport(const char *dev_name, const u_int card_type, const u_int card_id, const int transport);
+int         dcihid_get_transport(const u_int64_t dcihid_handle);
 int32_t     dcihid_close(const u_int64_t dcihid_handle);
 int32_t     dcihid_write(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t data);
+int32_t     dcihid_write_multi(const u_int64_t dcihid_handle, const struct dcihid_write_op *ops, const u_int32_t count);
 int32_t     dcihid_read(const u_int64_t dcihid_handle, const u_int32_t addr, u_int8_t *data);
+int32_t     dcihid_set_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data);
+int32_t     dcihid_clear_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data);
+int32_t     dcihid_toggle_bits(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, u_int8_t *data);
+int32_t     dcihid_write_masked(const u_int64_t dcihid_handle, const u_int32_t addr, const u_int8_t mask, const u_int8_t value,
+                                u_int8_t *data);
+int32_t     dcihid_coalesce_enable(const u_int64_t dcihid_handle, const u_int32_t window_us);
+int32_t     dcihid_coalesce_disable(const u_int64_t dcihid_handle);
+int32_t     dcihid_flush(const u_int64_t dcihid_handle);
+int32_t     dcihid_coalesce_get_stats(const u_int64_t dcihid_handle, struct dcihid_coalesce_stats *stats);
+int32_t     dcihid_resync(const u_int64_t dcihid_handle, const u_int32_t addr);
+int32_t     dcihid_get_stats(const u_int64_t dcihid_handle, struct dcihid_stats *stats);
+int32_t     dcihid_reset_stats(const u_int64_t dcihid_handle);
+u_int64_t   dcihid_stat_percentile(const struct dcihid_stat *stat, const double fraction);
+int32_t     dcihid_shadow_attach(const u_int64_t dcihid_handle, const char *path);
+int32_t     dcihid_read_all(const u_int64_t dcihid_handle, struct dcihid_input *input);
+int32_t     dcihid_read_adc(const u_int64_t dcihid_handle, u_int8_t *channel, u_int16_t *result);
+u_int64_t   dcihid_watch_create(void);
+int32_t     dcihid_watch_add(const u_int64_t watch_handle, const u_int64_t dcihid_handle);
+int32_t     dcihid_watch_run(const u_int64_t watch_handle, const int timeout_ms, dcihid_event_cb callback, void *arg);
+int32_t     dcihid_watch_destroy(const u_int64_t watch_handle);
+u_int64_t   dcihid_hotplug_create(void);
+int32_t     dcihid_hotplug_add(const u_int64_t hotplug_handle, const u_int64_t dcihid_handle);
+int32_t     dcihid_hotplug_run(const u_int64_t hotplug_handle, const int timeout_ms, dcihid_hotplug_cb callback, void *arg);
+int32_t     dcihid_hotplug_get_stats(const u_int64_t hotplug_handle, struct dcihid_hotplug_stats *stats);
+int32_t     dcihid_hotplug_destroy(const u_int64_t hotplug_handle);
+u_int64_t   dcihid_pool_open(const char *dev_name, const u_int card_type, const u_int card_id);
+int32_t     dcihid_pool_close(const u_int64_t dcihid_handle);
+void        dcihid_pool_flush(void);
+void        dcihid_pool_get_stats(struct dcihid_pool_stats *stats);
+int32_t     dcihid_enumerate(struct dcihid_devent *list, const u_int32_t max);
+int32_t     dcihid_lookup(const u_int card_type, const u_int card_id, char *dev_name, const size_t len);
 u_int       dcihid_assert_card_type(const u_int card_type);
 u_int       dcihid_assert_card_id(const u_int card_id);
+u_int       dcihid_card_has_adc(const u_int card_type);
 
-#ifdef _cplusplus
+#ifdef __cplusplus
 }
 #endif
 
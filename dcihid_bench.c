@@ -0,0 +1,833 @@
+/*
+ * File:
+ *      dcihid_bench.c
+ *
+ * Description:
+ *      Benchmark of the dcihid calls against a simulated board (dcisim.c),
+ *      run by 'make bench' on the hiddev, hidraw and sim transports.
+ *      Prints one line per case:
+ *          bench=<case> transport=<hiddev|hidraw|sim> ops=<n> ops_per_sec=<r> syscalls_per_op=<s> p50_us=<t> p99_us=<t> max_us=<t>
+ *      The keys and their order are kept stable, so results can be
+ *      compared across releases.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcisim.h"
+#include "dcicount.h"
+#include "dcipub.h"
+#include "dcirule.h"
+
+#define BENCH_FORMAT_VERSION    2
+#define BENCH_CARD_TYPE         USB_IND
+#define BENCH_CARD_ID           0
+#define BENCH_THREADS           8
+#define BENCH_WINDOW_US         200
+#define BENCH_HOTPLUG_PORTS     8
+#define BENCH_BOUNCE_PERIOD_NS  20000000ULL     // One press and release of the bouncing contact
+#define BENCH_BOUNCE_RUN_NS     500000000ULL
+#define BENCH_BOUNCE_RATE       2000
+#define BENCH_BOUNCE_US         1000
+#define BENCH_BOUNCE_LOST       16              // Samples missed to miss a level, 9.2 ms less the debounce
+#define BENCH_PUB_RATE          20000
+#define BENCH_PUB_READERS       4
+#define BENCH_PUB_SNAPSHOTS     1000            // Published while the readers run, at the least
+#define BENCH_PUB_FILE          "/dev/shm/dcihid_bench-%d.inputs"
+#define BENCH_RULE_OUT_TYPE     USB_32RO
+#define BENCH_RULE_RATE         4000
+#define BENCH_RULE_RUN_NS       206500000ULL    // 6.5 ms into a period of the stimuli
+#define BENCH_RULE_SETTLE_NS    5000000
+#define BENCH_RULE_LOST         4               // Reads missed to miss a level of 1 ms
+
+struct bench_case {
+    const char          *name;
+    u_int64_t           ops;
+    u_int64_t           syscalls;
+    double              elapsed;
+    u_int64_t           *ns;            // Latency of every op
+};
+
+static const char       *bench_transports[] = { "hiddev", "hidraw", "sim" };
+static char             bench_devnames[3][64];
+static char             *bench_devname;
+static int              bench_transport;
+static u_int64_t        bench_handle;
+static int              bench_sim;
+static atomic_uint      bench_mismatches;
+
+static u_int64_t
+now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+cmp_u64(const void *a, const void *b) {
+    u_int64_t x = *(const u_int64_t *)a, y = *(const u_int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void
+bench_report(struct bench_case *bc) {
+    u_int64_t p50, p99, max;
+
+    qsort(bc->ns, bc->ops, sizeof(u_int64_t), cmp_u64);
+    p50 = bc->ns[bc->ops / 2];
+    p99 = bc->ns[(bc->ops * 99) / 100];
+    max = bc->ns[bc->ops - 1];
+    printf("bench=%s transport=%s ops=%llu ops_per_sec=%.1f syscalls_per_op=%.2f p50_us=%.2f p99_us=%.2f max_us=%.2f\n",
+           bc->name, bench_transports[bench_transport], (unsigned long long)bc->ops, bc->ops / bc->elapsed, (double)bc->syscalls / bc->ops,
+           p50 / 1e3, p99 / 1e3, max / 1e3);
+    fflush(stdout);
+    free(bc->ns);
+}
+
+/*
+ * Times one call per op, returns -1 as soon as a call fails
+ */
+static int
+bench_run(const char *name, u_int64_t ops, int (*op)(u_int64_t i)) {
+    struct bench_case bc;
+    u_int64_t i, start, t;
+
+    bc.name = name;
+    bc.ops = ops;
+    if ((bc.ns = (u_int64_t *)malloc(ops * sizeof(u_int64_t))) == NULL) return -1;
+    bc.syscalls = dcisim_syscalls();
+    start = now_ns();
+    for (i = 0; i < ops; i++) {
+        t = now_ns();
+        if (op(i) != 0) {
+            fprintf(stderr, "bench=%s: failed at op %llu\n", name, (unsigned long long)i);
+            free(bc.ns);
+            return -1;
+        }
+        bc.ns[i] = now_ns() - t;
+    }
+    bc.elapsed = (now_ns() - start) / 1e9;
+    bc.syscalls = dcisim_syscalls() - bc.syscalls;
+    bench_report(&bc);
+    return 0;
+}
+
+static int
+op_open(u_int64_t i) {
+    u_int64_t handle = dcihid_open_transport(bench_devname, BENCH_CARD_TYPE, BENCH_CARD_ID, bench_transport);
+
+    if (handle == 0) return -1;
+    return dcihid_close(handle);
+}
+
+static int
+op_pool_reopen(u_int64_t i) {
+    u_int64_t handle = dcihid_pool_open(bench_devname, BENCH_CARD_TYPE, BENCH_CARD_ID);
+
+    if (handle == 0) return -1;
+    return dcihid_pool_close(handle);
+}
+
+static int
+op_read(u_int64_t i) {
+    u_int8_t data;
+
+    return dcihid_read(bench_handle, i & 3, &data);
+}
+
+static int
+op_read_all(u_int64_t i) {
+    struct dcihid_input input;
+
+    return dcihid_read_all(bench_handle, &input);
+}
+
+static int
+op_write(u_int64_t i) {
+    return dcihid_write(bench_handle, i & 3, i & 0xFF);
+}
+
+static int
+op_write_multi(u_int64_t i) {
+    struct dcihid_write_op ops[4] = {
+        { 0, i & 0xFF }, { 1, i & 0xFF }, { 2, i & 0xFF }, { 3, i & 0xFF }
+    };
+
+    return dcihid_write_multi(bench_handle, ops, 4);
+}
+
+/*
+ * Set/clear as main.c did it before the shadow: read the port, then write
+ */
+static int
+op_setbit_rmw(u_int64_t i) {
+    u_int8_t data;
+
+    if (dcihid_read(bench_handle, 0, &data) != 0) return -1;
+    return dcihid_write(bench_handle, 0, data | (1 << (i & 7)));
+}
+
+static int
+op_setbit_shadow(u_int64_t i) {
+    return dcihid_set_bits(bench_handle, 0, 1 << (i & 7), NULL);
+}
+
+/*
+ * Eight subsystems each drive their own bit of port 0, all eight are
+ * sent by one flush when coalescing
+ */
+static int
+op_setbit_coalesce(u_int64_t i) {
+    if (dcihid_write_masked(bench_handle, 0, 1 << (i & 7), (i & 8) ? 0xFF : 0x00, NULL) != 0) return -1;
+    return (i & 7) == 7 ? dcihid_flush(bench_handle) : 0;
+}
+
+/*
+ * Only merged reports reach the board, every bit at the value of its round
+ */
+static void
+check_coalesced(const int sim, const u_int8_t addr, const u_int8_t data, void *arg) {
+    if (addr != 0 || (data != 0x00 && data != 0xFF)) atomic_fetch_add(&bench_mismatches, 1);
+}
+
+static int
+bench_coalesce(u_int64_t ops) {
+    struct dcihid_coalesce_stats stats;
+    int ret;
+
+    atomic_store(&bench_mismatches, 0);
+    if (dcihid_coalesce_enable(bench_handle, 0) != 0) return -1;
+    dcisim_set_report_cb(check_coalesced, NULL);
+    ret = bench_run("setbit_coalesce", ops & ~7ULL, op_setbit_coalesce);
+    dcisim_set_report_cb(NULL, NULL);
+    dcihid_coalesce_get_stats(bench_handle, &stats);
+    dcihid_coalesce_disable(bench_handle);
+    if (ret != 0) return -1;
+
+    printf("check=coalesce transport=%s submitted=%llu sent=%llu consistent=%s mismatches=%u\n",
+           bench_transports[bench_transport], (unsigned long long)stats.submitted, (unsigned long long)stats.sent,
+           atomic_load(&bench_mismatches) ? "no" : "yes", atomic_load(&bench_mismatches));
+    return atomic_load(&bench_mismatches) ? -1 : 0;
+}
+
+/*
+ * Every thread writes its own address with its number in the upper bits
+ * of the data and the count of its writes in the lower ones, so a report
+ * mixing two transactions, a lost or a repeated one shows up at once.
+ * Reports of one board reach the callback one at a time.
+ */
+static u_int64_t        bench_received[BENCH_THREADS];
+
+static void
+check_report(const int sim, const u_int8_t addr, const u_int8_t data, void *arg) {
+    if (addr >= BENCH_THREADS || (data >> 5) != addr || (data & 0x1F) != (bench_received[addr] & 0x1F)) {
+        atomic_fetch_add(&bench_mismatches, 1);
+    }
+    if (addr < BENCH_THREADS) bench_received[addr]++;
+}
+
+struct mt_arg {
+    u_int32_t           thread;
+    u_int64_t           ops;
+    u_int64_t           *ns;
+};
+
+static void *
+mt_writer(void *arg) {
+    struct mt_arg *mt = (struct mt_arg *)arg;
+    u_int64_t i, t;
+
+    for (i = 0; i < mt->ops; i++) {
+        t = now_ns();
+        dcihid_write(bench_handle, mt->thread, (mt->thread << 5) | (i & 0x1F));
+        mt->ns[i] = now_ns() - t;
+    }
+    return NULL;
+}
+
+static int
+bench_mt_write(const char *name, u_int64_t ops) {
+    pthread_t threads[BENCH_THREADS];
+    struct mt_arg args[BENCH_THREADS];
+    struct bench_case bc;
+    u_int64_t per_thread = ops / BENCH_THREADS, start;
+    u_int32_t t;
+
+    bc.name = name;
+    bc.ops = per_thread * BENCH_THREADS;
+    if (bc.ops == 0 || (bc.ns = (u_int64_t *)malloc(bc.ops * sizeof(u_int64_t))) == NULL) return -1;
+
+    atomic_store(&bench_mismatches, 0);
+    memset(bench_received, 0, sizeof(bench_received));
+    dcisim_set_report_cb(check_report, NULL);
+    bc.syscalls = dcisim_syscalls();
+    start = now_ns();
+    for (t = 0; t < BENCH_THREADS; t++) {
+        args[t].thread = t;
+        args[t].ops = per_thread;
+        args[t].ns = &bc.ns[t * per_thread];
+        pthread_create(&threads[t], NULL, mt_writer, &args[t]);
+    }
+    for (t = 0; t < BENCH_THREADS; t++) pthread_join(threads[t], NULL);
+    bc.elapsed = (now_ns() - start) / 1e9;
+    bc.syscalls = dcisim_syscalls() - bc.syscalls;
+    dcisim_set_report_cb(NULL, NULL);
+    /* Exactly once each */
+    for (t = 0; t < BENCH_THREADS; t++) {
+        if (bench_received[t] != per_thread) atomic_fetch_add(&bench_mismatches, 1);
+    }
+
+    bench_report(&bc);
+    printf("check=%s transport=%s threads=%d consistent=%s mismatches=%u\n",
+           name, bench_transports[bench_transport], BENCH_THREADS, atomic_load(&bench_mismatches) ? "no" : "yes", atomic_load(&bench_mismatches));
+    return atomic_load(&bench_mismatches) ? -1 : 0;
+}
+
+/*
+ * Writes coalesced over a window by the eight threads, each on its own
+ * port: only writes of the owner reach a port, every report sent is
+ * counted and the last write of every thread is what the board keeps
+ */
+static u_int64_t        bench_coalesced;
+static u_int8_t         bench_last[BENCH_THREADS];
+
+static void
+check_window(const int sim, const u_int8_t addr, const u_int8_t data, void *arg) {
+    bench_coalesced++;
+    if (addr >= BENCH_THREADS || (data >> 5) != addr) {
+        atomic_fetch_add(&bench_mismatches, 1);
+        return;
+    }
+    bench_last[addr] = data;
+}
+
+static int
+bench_coalesce_window(u_int64_t ops) {
+    struct dcihid_coalesce_stats stats;
+    pthread_t threads[BENCH_THREADS];
+    struct mt_arg args[BENCH_THREADS];
+    struct bench_case bc;
+    u_int64_t per_thread = ops / BENCH_THREADS, start;
+    u_int32_t t;
+    u_int8_t last, output;
+
+    bc.name = "coalesce_window";
+    bc.ops = per_thread * BENCH_THREADS;
+    if (bc.ops == 0 || (bc.ns = (u_int64_t *)malloc(bc.ops * sizeof(u_int64_t))) == NULL) return -1;
+    if (dcihid_coalesce_enable(bench_handle, BENCH_WINDOW_US) != 0) {
+        free(bc.ns);
+        return -1;
+    }
+
+    atomic_store(&bench_mismatches, 0);
+    bench_coalesced = 0;
+    memset(bench_last, 0xFF, sizeof(bench_last));
+    dcisim_set_report_cb(check_window, NULL);
+    bc.syscalls = dcisim_syscalls();
+    start = now_ns();
+    for (t = 0; t < BENCH_THREADS; t++) {
+        args[t].thread = t;
+        args[t].ops = per_thread;
+        args[t].ns = &bc.ns[t * per_thread];
+        pthread_create(&threads[t], NULL, mt_writer, &args[t]);
+    }
+    for (t = 0; t < BENCH_THREADS; t++) pthread_join(threads[t], NULL);
+    dcihid_flush(bench_handle);
+    bc.elapsed = (now_ns() - start) / 1e9;
+    bc.syscalls = dcisim_syscalls() - bc.syscalls;
+    dcihid_coalesce_get_stats(bench_handle, &stats);
+    dcihid_coalesce_disable(bench_handle);
+    dcisim_set_report_cb(NULL, NULL);
+
+    /* Last write wins, in the reports and on the board */
+    for (t = 0; t < BENCH_THREADS; t++) {
+        last = (t << 5) | ((per_thread - 1) & 0x1F);
+        if (bench_last[t] != last || dcisim_get_output(bench_sim, t, &output) != 0 || output != last) {
+            atomic_fetch_add(&bench_mismatches, 1);
+        }
+    }
+    if (stats.submitted != bc.ops || stats.sent != bench_coalesced || stats.sent > stats.submitted || stats.errors ||
+        stats.pending) {
+        atomic_fetch_add(&bench_mismatches, 1);
+    }
+
+    bench_report(&bc);
+    printf("check=coalesce_window transport=%s threads=%d window_us=%d submitted=%llu sent=%llu windows=%llu consistent=%s mismatches=%u\n",
+           bench_transports[bench_transport], BENCH_THREADS, BENCH_WINDOW_US, (unsigned long long)stats.submitted,
+           (unsigned long long)stats.sent, (unsigned long long)stats.windows, atomic_load(&bench_mismatches) ? "no" : "yes",
+           atomic_load(&bench_mismatches));
+    return atomic_load(&bench_mismatches) ? -1 : 0;
+}
+
+/*
+ * Same on a handle without HIDIOCSUSAGES, where address and data go in
+ * two HIDIOCSUSAGE before the HIDIOCSREPORT and only the lock of the
+ * handle keeps another thread from slipping in between
+ */
+static int
+bench_mt_write_usage(u_int64_t ops) {
+    u_int64_t handle = bench_handle;
+    int ret;
+
+    if ((bench_handle = dcihid_open_transport(bench_devname, BENCH_CARD_TYPE, BENCH_CARD_ID, bench_transport)) == 0) {
+        bench_handle = handle;
+        return -1;
+    }
+    /* The first write finds HIDIOCSUSAGES refused and falls back for good */
+    dcisim_set_usages_multi(0);
+    ret = dcihid_write(bench_handle, 0, 0);
+    if (ret == 0) ret = bench_mt_write("mt_write_usage", ops);
+    dcisim_set_usages_multi(1);
+    dcihid_close(bench_handle);
+    bench_handle = handle;
+    return ret;
+}
+
+/*
+ * A contact on bits 0 and 1 of port 0 that bounces for 0.8 ms on every
+ * press and release. Channel 0 is debounced for two samples, longer than
+ * any bounce, channel 1 counts every change it samples.
+ */
+static const char bench_bounce[] =
+    "0 in 0 0\n"
+    "1.0 in 0 3\n"
+    "1.2 in 0 0\n"
+    "1.4 in 0 3\n"
+    "1.6 in 0 0\n"
+    "1.8 in 0 3\n"
+    "11.0 in 0 0\n"
+    "11.2 in 0 3\n"
+    "11.4 in 0 0\n"
+    "11.6 in 0 3\n"
+    "11.8 in 0 0\n"
+    "20 repeat\n";
+
+static int
+bench_stimuli(const char *text) {
+    FILE *script;
+    int ret;
+
+    if ((script = fmemopen((void *)text, strlen(text), "r")) == NULL) return -1;
+    ret = dcisim_load_stimuli(bench_sim, script);
+    fclose(script);
+    return ret;
+}
+
+/*
+ * Every press and release counts once on the debounced channel, give or
+ * take the one cut by the first and the last sample
+ */
+static int
+bench_debounce(void) {
+    struct dcicount_config config;
+    struct dcicount_counters counters;
+    struct timespec run = { BENCH_BOUNCE_RUN_NS / 1000000000ULL, BENCH_BOUNCE_RUN_NS % 1000000000ULL };
+    u_int64_t counter, start, elapsed, presses, releases, lost;
+    int consistent;
+
+    memset(&config, 0, sizeof(config));
+    config.rate = BENCH_BOUNCE_RATE;
+    config.debounce_us[0] = BENCH_BOUNCE_US;
+
+    if (bench_stimuli(bench_bounce) != 0) return -1;
+    start = now_ns();
+    if ((counter = dcicount_start(bench_handle, &config)) == 0) {
+        bench_stimuli("\n");
+        return -1;
+    }
+    while (nanosleep(&run, &run) != 0 && errno == EINTR);
+    dcicount_read(counter, &counters);
+    dcicount_stop(counter);
+    bench_stimuli("\n");
+
+    /*
+     * Presses start 1 ms into every period, releases 11 ms. A bounce
+     * counted shows as an edge too many, a stall of the sampler longer
+     * than a level (BENCH_BOUNCE_LOST samples) may hide a whole press.
+     */
+    elapsed = counters.timestamp - start;
+    presses = elapsed > 1000000 ? (elapsed - 1000000) / BENCH_BOUNCE_PERIOD_NS + 1 : 0;
+    releases = elapsed > 11000000 ? (elapsed - 11000000) / BENCH_BOUNCE_PERIOD_NS + 1 : 0;
+    lost = counters.missed / BENCH_BOUNCE_LOST + 1;
+    consistent = counters.errors == 0 && counters.rising[0] + lost >= presses && counters.rising[0] <= presses + 1 &&
+                 counters.falling[0] + lost >= releases && counters.falling[0] <= releases + 1;
+    printf("check=debounce transport=%s presses=%llu releases=%llu rising=%llu falling=%llu raw_rising=%llu samples=%llu missed=%llu consistent=%s\n",
+           bench_transports[bench_transport], (unsigned long long)presses, (unsigned long long)releases,
+           (unsigned long long)counters.rising[0],
+           (unsigned long long)counters.falling[0], (unsigned long long)counters.rising[1], (unsigned long long)counters.samples,
+           (unsigned long long)counters.missed, consistent ? "yes" : "no");
+    return consistent ? 0 : -1;
+}
+
+/*
+ * Ports 0x00 to 0x03 step through 8 values together, every
+ * step applied at once by the board, so a snapshot mixing two input
+ * reports has ports that differ
+ */
+static const char bench_steps[] =
+    "0.0 in 0 0\n0.0 in 1 0\n0.0 in 2 0\n0.0 in 3 0\n"
+    "0.1 in 0 1\n0.1 in 1 1\n0.1 in 2 1\n0.1 in 3 1\n"
+    "0.2 in 0 2\n0.2 in 1 2\n0.2 in 2 2\n0.2 in 3 2\n"
+    "0.3 in 0 3\n0.3 in 1 3\n0.3 in 2 3\n0.3 in 3 3\n"
+    "0.4 in 0 4\n0.4 in 1 4\n0.4 in 2 4\n0.4 in 3 4\n"
+    "0.5 in 0 5\n0.5 in 1 5\n0.5 in 2 5\n0.5 in 3 5\n"
+    "0.6 in 0 6\n0.6 in 1 6\n0.6 in 2 6\n0.6 in 3 6\n"
+    "0.7 in 0 7\n0.7 in 1 7\n0.7 in 2 7\n0.7 in 3 7\n"
+    "0.8 repeat\n";
+
+static char             bench_pub_path[64];
+static atomic_uint      bench_torn;
+
+struct pub_arg {
+    u_int64_t           ops;
+    u_int64_t           *ns;
+    u_int64_t           reads;
+};
+
+/*
+ * Reads the published snapshot, which has to be whole and never older
+ * than the one read before. Times the first ops reads, and goes on
+ * until BENCH_PUB_SNAPSHOTS were published.
+ */
+static void *
+pub_reader(void *arg) {
+    struct pub_arg *pa = (struct pub_arg *)arg;
+    struct dcipub_snapshot snapshot;
+    u_int64_t reader, i, t, samples = 0, timestamp = 0;
+
+    if ((reader = dcipub_attach(BENCH_CARD_TYPE, BENCH_CARD_ID, bench_pub_path)) == 0) {
+        atomic_fetch_add(&bench_torn, 1);
+        return NULL;
+    }
+    for (i = 0; i < pa->ops || samples < BENCH_PUB_SNAPSHOTS; i++) {
+        t = now_ns();
+        if (dcipub_read(reader, &snapshot) != 0) {
+            atomic_fetch_add(&bench_torn, 1);
+            break;
+        }
+        if (i < pa->ops) pa->ns[i] = now_ns() - t;
+        if (snapshot.port[1] != snapshot.port[0] || snapshot.port[2] != snapshot.port[0] ||
+            snapshot.port[3] != snapshot.port[0] || snapshot.samples < samples || snapshot.timestamp < timestamp ||
+            (snapshot.samples == samples) != (snapshot.timestamp == timestamp)) {
+            atomic_fetch_add(&bench_torn, 1);
+        }
+        samples = snapshot.samples;
+        timestamp = snapshot.timestamp;
+    }
+    pa->reads = i;
+    dcipub_detach(reader);
+    return NULL;
+}
+
+static int
+bench_pub(u_int64_t ops) {
+    pthread_t threads[BENCH_PUB_READERS];
+    struct pub_arg args[BENCH_PUB_READERS];
+    struct dcipub_snapshot snapshot;
+    struct bench_case bc;
+    u_int64_t per_thread = ops / BENCH_PUB_READERS, pub, start, reads = 0;
+    u_int32_t t;
+
+    bc.name = "pub_read";
+    bc.ops = per_thread * BENCH_PUB_READERS;
+    if (bc.ops == 0 || (bc.ns = (u_int64_t *)malloc(bc.ops * sizeof(u_int64_t))) == NULL) return -1;
+    snprintf(bench_pub_path, sizeof(bench_pub_path), BENCH_PUB_FILE, (int)getpid());
+    if (bench_stimuli(bench_steps) != 0 || (pub = dcipub_start(bench_handle, bench_pub_path, BENCH_PUB_RATE)) == 0) {
+        bench_stimuli("\n");
+        free(bc.ns);
+        return -1;
+    }
+
+    atomic_store(&bench_torn, 0);
+    bc.syscalls = dcisim_syscalls();
+    start = now_ns();
+    for (t = 0; t < BENCH_PUB_READERS; t++) {
+        args[t].ops = per_thread;
+        args[t].ns = &bc.ns[t * per_thread];
+        pthread_create(&threads[t], NULL, pub_reader, &args[t]);
+    }
+    for (t = 0; t < BENCH_PUB_READERS; t++) {
+        pthread_join(threads[t], NULL);
+        reads += args[t].reads;
+    }
+    /* Rate of all the reads, latencies of the timed ones. Transfers of the publisher do not count. */
+    bc.elapsed = (now_ns() - start) / 1e9 * bc.ops / reads;
+    bc.syscalls = 0;
+    dcipub_read(pub, &snapshot);
+    dcipub_stop(pub);
+    unlink(bench_pub_path);
+    bench_stimuli("\n");
+
+    bench_report(&bc);
+    printf("check=pub transport=%s readers=%d reads=%llu published=%llu consistent=%s torn=%u\n",
+           bench_transports[bench_transport], BENCH_PUB_READERS, (unsigned long long)reads, (unsigned long long)snapshot.samples,
+           atomic_load(&bench_torn) ? "no" : "yes", atomic_load(&bench_torn));
+    return atomic_load(&bench_torn) ? -1 : 0;
+}
+
+/*
+ * Port 0 counts from 0 to 7, one step per ms. Bit 0 toggles every ms,
+ * bits 1 and 2 are high together from 6 to 8 ms of every period and bit
+ * 2 goes low at its end.
+ */
+static const char bench_count[] =
+    "0 in 0 0\n1 in 0 1\n2 in 0 2\n3 in 0 3\n4 in 0 4\n5 in 0 5\n6 in 0 6\n7 in 0 7\n"
+    "8 repeat\n";
+
+/*
+ * Edges at first + i * period seen in elapsed ns
+ */
+static u_int64_t
+bench_edges(const u_int64_t elapsed, const u_int64_t first, const u_int64_t period) {
+    return elapsed > first ? (elapsed - first) / period + 1 : 0;
+}
+
+/*
+ * Four interlocks of the bench board onto a relay board: OUT01 goes on
+ * with bits 1 and 2 of port 0 and off with bit 2, OUT00 follows bit 0.
+ * OUT01 goes on as OUT00 goes off, in one write that keeps both bits.
+ * Every rule fires once per edge that makes it hold, off and on rules
+ * in turn, the outputs end as the inputs and every write but the ones of
+ * the first evaluation is timed.
+ */
+static int
+bench_rule(void) {
+    struct dcirule_config config;
+    struct dcirule_stats stats;
+    struct dcirule_result results[4];
+    struct dcirule *rules;
+    struct timespec end, settle = { 0, BENCH_RULE_SETTLE_NS };
+    char text[512];
+    FILE *script;
+    u_int64_t engine, start, elapsed, expected[4], lost;
+    u_int32_t count, r;
+    u_int8_t inputs, outputs;
+    int out_sim, consistent;
+
+    snprintf(text, sizeof(text),
+             "0x%02X:%d 0.1 high 0.2 high -> 0x%02X:%d OUT01 on\n"
+             "0x%02X:%d 0.2 low -> 0x%02X:%d OUT01 off\n"
+             "0x%02X:%d 0.0 high -> 0x%02X:%d OUT00 on\n"
+             "0x%02X:%d 0.0 low -> 0x%02X:%d OUT00 off\n",
+             BENCH_CARD_TYPE, BENCH_CARD_ID, BENCH_RULE_OUT_TYPE, BENCH_CARD_ID,
+             BENCH_CARD_TYPE, BENCH_CARD_ID, BENCH_RULE_OUT_TYPE, BENCH_CARD_ID,
+             BENCH_CARD_TYPE, BENCH_CARD_ID, BENCH_RULE_OUT_TYPE, BENCH_CARD_ID,
+             BENCH_CARD_TYPE, BENCH_CARD_ID, BENCH_RULE_OUT_TYPE, BENCH_CARD_ID);
+    if ((script = fmemopen(text, strlen(text), "r")) == NULL) return -1;
+    rules = dcirule_load(script, &count);
+    fclose(script);
+    if (rules == NULL || count != 4) {
+        free(rules);
+        return -1;
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.rules = rules;
+    config.count = count;
+    config.transport = DCIHID_TRANSPORT_SIM;
+    config.rate = BENCH_RULE_RATE;
+    config.cpu = -1;
+
+    start = now_ns();
+    if (bench_stimuli(bench_count) != 0 || (engine = dcirule_start(&config)) == 0) {
+        bench_stimuli("\n");
+        free(rules);
+        return -1;
+    }
+    /* End with bits 1 and 2 high, where a merge that drops OUT01 shows */
+    end.tv_sec = (start + BENCH_RULE_RUN_NS) / 1000000000ULL;
+    end.tv_nsec = (start + BENCH_RULE_RUN_NS) % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR);
+    /* Hold the last inputs until the engine has seen them */
+    bench_stimuli("\n");
+    elapsed = now_ns() - start;
+    while (nanosleep(&settle, &settle) != 0 && errno == EINTR);
+    dcirule_stop(engine, &stats, results);
+    free(rules);
+
+    /* The off rules also fire on the first evaluation, the inputs start at 0 */
+    expected[0] = bench_edges(elapsed, 6000000, 8000000);
+    expected[1] = bench_edges(elapsed, 8000000, 8000000) + 1;
+    expected[2] = bench_edges(elapsed, 1000000, 2000000);
+    expected[3] = bench_edges(elapsed, 2000000, 2000000) + 1;
+    lost = stats.missed / BENCH_RULE_LOST + 1;
+
+    out_sim = dcisim_find_card(BENCH_RULE_OUT_TYPE, BENCH_CARD_ID);
+    consistent = out_sim >= 0 && dcihid_read(bench_handle, 0x00, &inputs) == 0 &&
+                 dcisim_get_output(out_sim, 0x00, &outputs) == 0 && stats.errors == 0 &&
+                 (outputs & 0x01) == (inputs & 0x01) && ((outputs & 0x02) != 0) == ((inputs & 0x06) == 0x06);
+    for (r = 0; r < 4; r++) {
+        if (results[r].errors != 0 || results[r].firings > expected[r] + 1 || results[r].firings + lost < expected[r] ||
+            results[r].latency.count > results[r].firings || results[r].latency.count + 1 < results[r].firings ||
+            results[r].latency_p50 > results[r].latency_p99 || results[r].latency_p99 > results[r].latency.max_ns / 1000) {
+            consistent = 0;
+        }
+    }
+    /* On and off in turn */
+    if (results[0].firings + 1 < results[1].firings || results[1].firings < results[0].firings ||
+        results[2].firings + 1 < results[3].firings || results[3].firings < results[2].firings) {
+        consistent = 0;
+    }
+
+    printf("check=rule transport=%s rate=%d fired=%llu,%llu,%llu,%llu expected=%llu,%llu,%llu,%llu reads=%llu missed=%llu p50_us=%u p99_us=%u consistent=%s\n",
+           bench_transports[bench_transport], BENCH_RULE_RATE, (unsigned long long)results[0].firings,
+           (unsigned long long)results[1].firings, (unsigned long long)results[2].firings, (unsigned long long)results[3].firings,
+           (unsigned long long)expected[0], (unsigned long long)expected[1], (unsigned long long)expected[2],
+           (unsigned long long)expected[3], (unsigned long long)stats.reads, (unsigned long long)stats.missed,
+           results[2].latency_p50, results[2].latency_p99, consistent ? "yes" : "no");
+    return consistent ? 0 : -1;
+}
+
+/*
+ * Waits for the monitor to report an event of the given type
+ */
+static void
+hotplug_event(const struct dcihid_hotplug_event *event, void *arg) {
+    *(struct dcihid_hotplug_event *)arg = *event;
+}
+
+static int
+hotplug_wait(u_int64_t hotplug, int type, struct dcihid_hotplug_event *event) {
+    int tries;
+
+    for (tries = 0; tries < 100; tries++) {
+        event->type = -1;
+        if (dcihid_hotplug_run(hotplug, 10, hotplug_event, event) < 0) return -1;
+        if (event->type == type) return 0;
+    }
+    return -1;
+}
+
+/*
+ * Unplugs and plugs the board back, the handle has to fail with ENODEV
+ * while it is away and find its outputs as they were written once back.
+ * The time to reopen is reported as the latency.
+ */
+static int
+bench_hotplug(u_int64_t ops) {
+    struct dcihid_hotplug_stats stats;
+    struct dcihid_hotplug_event event;
+    struct bench_case bc;
+    u_int64_t hotplug, i, start;
+    u_int32_t mismatches = 0;
+    u_int8_t addr, value;
+
+    bc.name = "hotplug";
+    bc.ops = ops / 1000 > 10 ? ops / 1000 : 10;
+    if ((bc.ns = (u_int64_t *)malloc(bc.ops * sizeof(u_int64_t))) == NULL) return -1;
+    if ((hotplug = dcihid_hotplug_create()) == 0 || dcihid_hotplug_add(hotplug, bench_handle) != 0) {
+        if (hotplug) dcihid_hotplug_destroy(hotplug);
+        free(bc.ns);
+        return -1;
+    }
+    for (addr = 0; addr < BENCH_HOTPLUG_PORTS; addr++) dcihid_write(bench_handle, addr, 0xA0 | addr);
+
+    bc.syscalls = dcisim_syscalls();
+    start = now_ns();
+    for (i = 0; i < bc.ops; i++) {
+        dcisim_unplug(bench_sim);
+        if (hotplug_wait(hotplug, DCIHID_HOTPLUG_REMOVED, &event) != 0) break;
+        if (dcihid_write(bench_handle, 0, 0x00) == 0 || errno != ENODEV) mismatches++;
+        dcisim_plug(bench_sim);
+        if (hotplug_wait(hotplug, DCIHID_HOTPLUG_RECOVERED, &event) != 0) break;
+        bc.ns[i] = event.reopen_ns;
+        if (event.status != 0) mismatches++;
+        for (addr = 0; addr < BENCH_HOTPLUG_PORTS; addr++) {
+            if (dcisim_get_output(bench_sim, addr, &value) != 0 || value != (0xA0 | addr)) mismatches++;
+        }
+    }
+    bc.elapsed = (now_ns() - start) / 1e9;
+    bc.syscalls = dcisim_syscalls() - bc.syscalls;
+    dcihid_hotplug_get_stats(hotplug, &stats);
+    dcihid_hotplug_destroy(hotplug);
+    if (i < bc.ops) {
+        fprintf(stderr, "bench=hotplug: no event at cycle %llu\n", (unsigned long long)i);
+        free(bc.ns);
+        return -1;
+    }
+
+    bench_report(&bc);
+    printf("check=hotplug transport=%s recoveries=%llu consistent=%s mismatches=%u\n", bench_transports[bench_transport],
+           (unsigned long long)stats.recoveries, mismatches ? "no" : "yes", mismatches);
+    return mismatches ? -1 : 0;
+}
+
+/*
+ * Main
+ */
+int
+main(int argc, char *argv[])
+{
+    u_int64_t ops = 100000;
+    u_int32_t latency_us = 0;
+    int opt, ret = 0;
+
+    while ((opt = getopt(argc, argv, "l:n:h")) != -1) {
+        switch (opt) {
+            case 'l':
+                latency_us = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                ops = strtoull(optarg, NULL, 0);
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s [-l <latency_us per transfer>] [-n <ops per case>]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (ops < BENCH_THREADS) ops = BENCH_THREADS;
+
+    bench_sim = dcisim_create(BENCH_CARD_TYPE, BENCH_CARD_ID, bench_devnames[DCIHID_TRANSPORT_HIDDEV], sizeof(bench_devnames[0]));
+    snprintf(bench_devnames[DCIHID_TRANSPORT_HIDRAW], sizeof(bench_devnames[0]), DCISIM_RAW_PATH, bench_sim);
+    /* bench_devnames[DCIHID_TRANSPORT_SIM] stays empty, the sim transport finds the board by type and ID */
+    dcisim_set_latency(latency_us);
+    printf("# dcihid_bench format=%d latency_us=%u ops=%llu\n", BENCH_FORMAT_VERSION, latency_us, (unsigned long long)ops);
+
+    for (bench_transport = DCIHID_TRANSPORT_HIDDEV; bench_transport <= DCIHID_TRANSPORT_SIM && ret == 0; bench_transport++) {
+        bench_devname = bench_devnames[bench_transport];
+
+        /* Opens walk the descriptors at every call, no need for as many */
+        if (bench_run("open", ops / 10 ? ops / 10 : 1, op_open) != 0) return 1;
+        if (bench_transport == DCIHID_TRANSPORT_HIDDEV) {
+            if (bench_run("pool_reopen", ops / 10 ? ops / 10 : 1, op_pool_reopen) != 0) return 1;
+            dcihid_pool_flush();
+        }
+
+        if ((bench_handle = dcihid_open_transport(bench_devname, BENCH_CARD_TYPE, BENCH_CARD_ID, bench_transport)) == 0) {
+            fprintf(stderr, "Could not open simulated board '%s'\n", bench_devname);
+            return 1;
+        }
+        if (bench_run("read", ops, op_read) != 0 ||
+            bench_run("read_all", ops, op_read_all) != 0 ||
+            bench_run("write", ops, op_write) != 0 ||
+            bench_run("write_multi", ops, op_write_multi) != 0 ||
+            bench_run("setbit_rmw", ops, op_setbit_rmw) != 0 ||
+            bench_run("setbit_shadow", ops, op_setbit_shadow) != 0 ||
+            bench_coalesce(ops) != 0 ||
+            bench_coalesce_window(ops) != 0 ||
+            bench_mt_write("mt_write", ops) != 0 ||
+            (bench_transport == DCIHID_TRANSPORT_HIDDEV && bench_mt_write_usage(ops) != 0) ||
+            bench_debounce() != 0 ||
+            bench_pub(ops) != 0 ||
+            (bench_transport == DCIHID_TRANSPORT_SIM && bench_rule() != 0) ||
+            bench_hotplug(ops) != 0) ret = 1;
+        dcihid_close(bench_handle);
+    }
+
+    return ret;
+}
@@ -0,0 +1,312 @@
+/*
+ * File:
+ *      dcihidd.c
+ *
+ * Description:
+ *      Daemon that keeps DCI USB HID devices from Decision-Computer open
+ *      and serves read/write requests over a Unix domain socket, so the
+ *      device enumeration in dcihid_open() is only paid once per board.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "dcihid.h"
+#include "dcihidd.h"
+
+#define MAX_BOARDS      16
+#define MAX_CLIENTS     32
+
+/*
+ * One board kept open by the daemon
+ */
+struct board {
+    char        devname[64];
+    u_int8_t    card_type;
+    u_int8_t    card_id;
+    u_int64_t   handle;
+};
+
+static struct board boards[MAX_BOARDS];
+static int num_boards = 0;
+static volatile sig_atomic_t running = 1;
+
+static void
+on_signal(int sig) {
+    running = 0;
+}
+
+/*
+ * Parses "<device>:<type>:<id>" as given to -b
+ */
+static int
+parse_board(const char *arg, struct board *board) {
+    char tmp[128];
+    char *type, *id;
+
+    if (strlen(arg) >= sizeof(tmp)) return -1;
+    strcpy(tmp, arg);
+    if ((id = strrchr(tmp, ':')) == NULL) return -1;
+    *id++ = '\0';
+    if ((type = strrchr(tmp, ':')) == NULL) return -1;
+    *type++ = '\0';
+    if (strlen(tmp) >= sizeof(board->devname)) return -1;
+
+    strcpy(board->devname, tmp);
+    board->card_type = (u_int8_t)strtol(type, NULL, 0);
+    board->card_id = (u_int8_t)strtol(id, NULL, 0);
+    if (!dcihid_assert_card_type(board->card_type) || !dcihid_assert_card_id(board->card_id)) return -1;
+    board->handle = 0;
+    return 0;
+}
+
+static struct board *
+find_board(const u_int8_t card_type, const u_int8_t card_id) {
+    int i;
+
+    for (i = 0; i < num_boards; i++) {
+        if (boards[i].card_type == card_type && boards[i].card_id == card_id) return &boards[i];
+    }
+    return NULL;
+}
+
+/*
+ * Runs one request against an open board
+ */
+static void
+serve_request(const struct dcihidd_request *request, struct dcihidd_response *response) {
+    struct board *board;
+    u_int8_t tmp;
+
+    memset(response, 0, sizeof(struct dcihidd_response));
+    response->addr = request->addr;
+
+    if ((board = find_board(request->card_type, request->card_id)) == NULL) {
+        response->status = DCIHIDD_ENODEV;
+        return;
+    }
+
+    switch (request->op) {
+        case DCIHIDD_OP_READ:
+            if (dcihid_read(board->handle, request->addr, &tmp) != 0) goto io_error;
+            response->data = tmp;
+            break;
+        case DCIHIDD_OP_WRITE:
+            if (dcihid_write(board->handle, request->addr, request->data) != 0) goto io_error;
+            response->data = request->data;
+            break;
+        case DCIHIDD_OP_SET_BIT:
+        case DCIHIDD_OP_CLEAR_BIT:
+            if (request->data > 7) {
+                response->status = DCIHIDD_EINVAL;
+                return;
+            }
+            if (request->op == DCIHIDD_OP_SET_BIT) {
+                if (dcihid_set_bits(board->handle, request->addr, 1 << request->data, &tmp) != 0) goto io_error;
+            } else {
+                if (dcihid_clear_bits(board->handle, request->addr, 1 << request->data, &tmp) != 0) goto io_error;
+            }
+            response->data = tmp;
+            break;
+        default:
+            response->status = DCIHIDD_EINVAL;
+            return;
+    }
+    response->status = DCIHIDD_OK;
+    return;
+
+io_error:
+    response->status = DCIHIDD_EIO;
+}
+
+static int
+open_socket(const char *sock_name) {
+    struct sockaddr_un addr;
+    int sock;
+
+    if (strlen(sock_name) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket name too long\n");
+        return -1;
+    }
+    if ((sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_name);
+    unlink(sock_name);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, MAX_CLIENTS) < 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/*
+ * Main
+ */
+int
+main(int argc, char *argv[])
+{
+    char sock_name[108] = DCIHIDD_SOCKET;
+    char sock_path[PATH_MAX];
+    int foreground = 0;
+    struct pollfd fds[1 + MAX_CLIENTS];
+    int num_fds;
+    int listen_sock;
+    int i, opt;
+
+    while ((opt = getopt(argc, argv, "s:b:fhv")) != -1) {
+        switch (opt) {
+            case 's':
+                // Set the socket to listen on:
+                if (strlen(optarg) >= sizeof(sock_name)) {
+                    fprintf(stderr, "Socket name too long\n");
+                    return 1;
+                }
+                strcpy(sock_name, optarg);
+                break;
+            case 'b':
+                // Add a board to serve:
+                if (num_boards == MAX_BOARDS) {
+                    fprintf(stderr, "Too many boards, at most %d are supported\n", MAX_BOARDS);
+                    return 1;
+                }
+                if (parse_board(optarg, &boards[num_boards]) != 0) {
+                    fprintf(stderr, "Invalid board '%s'. Try '%s -h' for more information.\n", optarg, argv[0]);
+                    return 1;
+                }
+                num_boards++;
+                break;
+            case 'f':
+                // Stay in foreground:
+                foreground = 1;
+                break;
+            case 'h':
+                printf("%s: Daemon serving DCI USB HID devices from Decision-Computer over a Unix socket\n", argv[0]);
+                printf("Usage: %s [-s <socket>] [-f] -b <device>:<type>:<id> [-b ...]\n", argv[0]);
+                printf("Where:\n");
+                printf("  <socket> is the Unix socket to listen on, default: %s\n", DCIHIDD_SOCKET);
+                printf("  -f keeps the daemon in foreground\n");
+                printf("  -b adds a board to keep open, see 'DecisionUsbdio -h' for <type> and <id>\n");
+                printf("Examples:\n");
+                printf("  %s -b /dev/usb/hiddev0:0x06:0 -b /dev/usb/hiddev1:0x0D:1\n", argv[0]);
+                return 0;
+                break;
+            case 'v':
+                printf("%s: Daemon serving DCI USB HID devices from Decision-Computer over a Unix socket\n", argv[0]);
+                printf("Version: 1.0\n");
+                return 0;
+                break;
+            case '?':
+                fprintf(stderr, "Unknown option: %c. Try '%s -h' for more information.\n", optopt, argv[0]);
+                return 1;
+                break;
+        }
+    }
+
+    if (num_boards == 0) {
+        fprintf(stderr, "No boards specified. Try '%s -h' for more information.\n", argv[0]);
+        return 1;
+    }
+
+    // Open all handles once:
+    for (i = 0; i < num_boards; i++) {
+        boards[i].handle = dcihid_open(boards[i].devname, boards[i].card_type, boards[i].card_id);
+        if (boards[i].handle == 0) {
+            fprintf(stderr, "There is no Decision-Computer DCI HID USB device (CardID, CardNO) = (%d, %d) on %s\n",
+                    boards[i].card_type, boards[i].card_id, boards[i].devname);
+            return 1;
+        }
+    }
+
+    if ((listen_sock = open_socket(sock_name)) < 0) return 1;
+
+    // daemon() moves to /, keep the absolute path of the socket to remove it:
+    if (realpath(sock_name, sock_path) == NULL) snprintf(sock_path, sizeof(sock_path), "%s", sock_name);
+
+    if (!foreground && daemon(0, 0) < 0) {
+        perror("daemon");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    fds[0].fd = listen_sock;
+    fds[0].events = POLLIN;
+    num_fds = 1;
+
+    while (running) {
+        if (poll(fds, num_fds, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // Serve the clients:
+        for (i = 1; i < num_fds; i++) {
+            struct dcihidd_request request;
+            struct dcihidd_response response;
+            ssize_t len;
+
+            if (!fds[i].revents) continue;
+            len = recv(fds[i].fd, &request, sizeof(request), MSG_DONTWAIT);
+            if (len < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            if (len > 0) {
+                if (len == sizeof(request)) {
+                    serve_request(&request, &response);
+                } else {
+                    memset(&response, 0, sizeof(response));
+                    response.status = DCIHIDD_EINVAL;
+                }
+                if (send(fds[i].fd, &response, sizeof(response), MSG_NOSIGNAL) == sizeof(response)) continue;
+            }
+
+            // Client gone, drop it:
+            close(fds[i].fd);
+            fds[i] = fds[--num_fds];
+            i--;
+        }
+
+        // Accept new clients:
+        if (fds[0].revents & POLLIN) {
+            int sock = accept4(listen_sock, NULL, NULL, SOCK_CLOEXEC);
+            if (sock >= 0) {
+                if (num_fds == 1 + MAX_CLIENTS) {
+                    close(sock);
+                } else {
+                    fds[num_fds].fd = sock;
+                    fds[num_fds].events = POLLIN;
+                    fds[num_fds].revents = 0;
+                    num_fds++;
+                }
+            }
+        }
+    }
+
+    // Close everything and exit:
+    for (i = 1; i < num_fds; i++) close(fds[i].fd);
+    close(listen_sock);
+    unlink(sock_path);
+    for (i = 0; i < num_boards; i++) dcihid_close(boards[i].handle);
+    return 0;
+}
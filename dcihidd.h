@@ -0,0 +1,63 @@
+#ifndef _DCIHIDD_H_
+#define _DCIHIDD_H_
+
+#include <sys/types.h>
+
+/*
+ * socket the daemon listens on unless told otherwise
+ */
+#define DCIHIDD_SOCKET      "/run/dcihidd.sock"
+
+/*
+ * request operations
+ */
+#define DCIHIDD_OP_READ         0x01 // Read a port
+#define DCIHIDD_OP_WRITE        0x02 // Write a byte to a port
+#define DCIHIDD_OP_SET_BIT      0x03 // Set a bit on a port, from the output shadow of the daemon
+#define DCIHIDD_OP_CLEAR_BIT    0x04 // Clear a bit on a port, from the output shadow of the daemon
+
+/*
+ * response status
+ */
+#define DCIHIDD_OK          0   // Request done
+#define DCIHIDD_EIO         -1  // The board failed the request
+#define DCIHIDD_ENODEV      -2  // No such board is served by the daemon
+#define DCIHIDD_EINVAL      -3  // Malformed request
+
+/*
+ * wire format: one request per SOCK_SEQPACKET message, one response back
+ */
+struct dcihidd_request {
+    u_int8_t    op;                         // DCIHIDD_OP_*
+    u_int8_t    card_type;                  // Card type as in dcihid.h
+    u_int8_t    card_id;                    // Card ID set on the DIP switch
+    u_int8_t    addr;                       // Port address
+    u_int8_t    data;                       // Byte to write or bit to set/clear
+    u_int8_t    reserved[3];
+};
+
+struct dcihidd_response {
+    int8_t      status;                     // DCIHIDD_OK or DCIHIDD_E*
+    u_int8_t    addr;                       // Port address
+    u_int8_t    data;                       // Port value after the request
+    u_int8_t    reserved;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * client function prototypes
+ */
+int         dcihidd_connect(const char *sock_name);
+int32_t     dcihidd_disconnect(const int sock);
+int32_t     dcihidd_read(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, u_int8_t *data);
+int32_t     dcihidd_write(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t data);
+int32_t     dcihidd_set_bit(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t bit, u_int8_t *data);
+int32_t     dcihidd_clear_bit(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t bit, u_int8_t *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * File:
+ *      dcihidd_bench.c
+ *
+ * Description:
+ *      Compares the per-operation latency of reading a port through the
+ *      dcihidd daemon against spawning the DecisionUsbdio binary for
+ *      every operation, as DecisionUsbdio.py does.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "dcihidd.h"
+
+#define UNDEFINED 0xFF
+
+static double
+elapsed_us(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int
+compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void
+print_result(const char *name, double *samples, const int count) {
+    double total = 0;
+    int i;
+
+    for (i = 0; i < count; i++) total += samples[i];
+    qsort(samples, count, sizeof(double), compare_double);
+    printf("%-8s ops=%d avg=%.1fus p50=%.1fus p99=%.1fus max=%.1fus\n", name, count,
+           total / count, samples[count / 2], samples[(count * 99) / 100], samples[count - 1]);
+}
+
+/*
+ * Main
+ */
+int
+main(int argc, char *argv[])
+{
+    char sock_name[108] = DCIHIDD_SOCKET;
+    char linux_hiddev[64] = "";
+    char binary[256] = "DecisionUsbdio";
+    u_int8_t card_type = UNDEFINED;
+    u_int8_t card_id = UNDEFINED;
+    u_int8_t port_address = 0x00;
+    int count = 1000, popen_count = 20;
+    struct timespec start, end;
+    double *samples;
+    u_int8_t data;
+    int sock;
+    int i, opt;
+
+    while ((opt = getopt(argc, argv, "s:d:t:i:r:n:p:P:h")) != -1) {
+        switch (opt) {
+            case 's': snprintf(sock_name, sizeof(sock_name), "%s", optarg); break;
+            case 'd': snprintf(linux_hiddev, sizeof(linux_hiddev), "%s", optarg); break;
+            case 't': card_type = (u_int8_t)strtol(optarg, NULL, 0); break;
+            case 'i': card_id = (u_int8_t)strtol(optarg, NULL, 0); break;
+            case 'r': port_address = (u_int8_t)strtol(optarg, NULL, 0); break;
+            case 'n': count = atoi(optarg); break;
+            case 'p': popen_count = atoi(optarg); break;
+            case 'P': snprintf(binary, sizeof(binary), "%s", optarg); break;
+            case 'h':
+                printf("Usage: %s -t <type> -i <id> [-r <port>] [-s <socket>] [-n <ops>] [-d <device> [-p <ops>] [-P <binary>]]\n", argv[0]);
+                printf("  Reads <port> <ops> times through the daemon on <socket>, and if <device> is\n");
+                printf("  given, <ops> times through the DecisionUsbdio <binary> started with popen()\n");
+                return 0;
+            default:
+                return 1;
+        }
+    }
+
+    if (card_type == UNDEFINED || card_id == UNDEFINED || count <= 0 || popen_count <= 0) {
+        fprintf(stderr, "No card type/ID specified. Try '%s -h' for more information.\n", argv[0]);
+        return 1;
+    }
+
+    samples = malloc(sizeof(double) * (count > popen_count ? count : popen_count));
+    if (samples == NULL) return 1;
+
+    // Through the daemon:
+    if ((sock = dcihidd_connect(sock_name)) < 0) return 1;
+    for (i = 0; i < count; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (dcihidd_read(sock, card_type, card_id, port_address, &data) != 0) return 1;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = elapsed_us(&start, &end);
+    }
+    dcihidd_disconnect(sock);
+    print_result("daemon", samples, count);
+
+    // Through a new process for every operation:
+    if (linux_hiddev[0] != '\0') {
+        char command[512];
+
+        snprintf(command, sizeof(command), "%s -d %s -t 0x%02X -i %u -r 0x%02X", binary, linux_hiddev, card_type, card_id, port_address);
+        for (i = 0; i < popen_count; i++) {
+            char line[128];
+            FILE *pipe;
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            if ((pipe = popen(command, "r")) == NULL) return 1;
+            while (fgets(line, sizeof(line), pipe) != NULL);
+            pclose(pipe);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            samples[i] = elapsed_us(&start, &end);
+        }
+        print_result("popen", samples, popen_count);
+    }
+
+    free(samples);
+    return 0;
+}
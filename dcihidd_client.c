@@ -0,0 +1,127 @@
+/*
+ * File:
+ *      dcihidd_client.c
+ *
+ * Description:
+ *      Client routines to talk to the dcihidd daemon, which keeps the
+ *      DCI USB HID devices from Decision-Computer open.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "dcihidd.h"
+
+
+/*
+ * functions
+ */
+
+int
+dcihidd_connect(const char *sock_name) {
+    struct sockaddr_un  addr;
+    int                 sock;
+
+    if (strlen(sock_name) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "dcihidd connect: socket name too long\n");
+        return -1;
+    }
+
+    if ((sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)) < 0) {
+        perror("dcihidd socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_name);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("dcihidd connect");
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+int32_t
+dcihidd_disconnect(const int sock) {
+    close(sock);
+    return 0;
+}
+
+/*
+ * Sends one request and waits for its response.
+ */
+static int32_t
+dcihidd_transact(const int sock, const u_int8_t op, const u_int card_type, const u_int card_id,
+                 const u_int8_t addr, const u_int8_t data, u_int8_t *result) {
+    struct dcihidd_request  request;
+    struct dcihidd_response response;
+    ssize_t                 len;
+
+    memset(&request, 0, sizeof(request));
+    request.op = op;
+    request.card_type = card_type;
+    request.card_id = card_id;
+    request.addr = addr;
+    request.data = data;
+    if (send(sock, &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request)) {
+        fprintf(stderr, "dcihidd send: %s\n", strerror(errno));
+        return -1;
+    }
+
+    do {
+        len = recv(sock, &response, sizeof(response), 0);
+    } while (len < 0 && errno == EINTR);
+    if (len != sizeof(response)) {
+        fprintf(stderr, "dcihidd recv: %s\n", len < 0 ? strerror(errno) : "short response");
+        return -1;
+    }
+
+    if (response.status != DCIHIDD_OK) {
+        switch (response.status) {
+            case DCIHIDD_ENODEV:
+                fprintf(stderr, "dcihidd: no card (0x%02X, %u) served\n", card_type, card_id);
+                break;
+            case DCIHIDD_EINVAL:
+                fprintf(stderr, "dcihidd: invalid request\n");
+                break;
+            default:
+                fprintf(stderr, "dcihidd: I/O error on card (0x%02X, %u)\n", card_type, card_id);
+                break;
+        }
+        return -1;
+    }
+
+    if (result) *result = response.data;
+    return 0;
+}
+
+int32_t
+dcihidd_read(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, u_int8_t *data) {
+    return dcihidd_transact(sock, DCIHIDD_OP_READ, card_type, card_id, addr, 0, data);
+}
+
+int32_t
+dcihidd_write(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t data) {
+    return dcihidd_transact(sock, DCIHIDD_OP_WRITE, card_type, card_id, addr, data, NULL);
+}
+
+int32_t
+dcihidd_set_bit(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t bit, u_int8_t *data) {
+    return dcihidd_transact(sock, DCIHIDD_OP_SET_BIT, card_type, card_id, addr, bit, data);
+}
+
+int32_t
+dcihidd_clear_bit(const int sock, const u_int card_type, const u_int card_id, const u_int8_t addr, const u_int8_t bit, u_int8_t *data) {
+    return dcihidd_transact(sock, DCIHIDD_OP_CLEAR_BIT, card_type, card_id, addr, bit, data);
+}
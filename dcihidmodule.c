@@ -0,0 +1,451 @@
+/*
+ * File:
+ *      dcihidmodule.c
+ *
+ * Description:
+ *      Native Python module on top of dcihid.c. Provides the same
+ *      DecisionUsbdio class as DecisionUsbdio.py, but keeps the device
+ *      handle open instead of starting DecisionUsbdio for every call.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+
+#define CLOSED              -2      // Status of a call that found the device closed under the lock
+
+
+/*
+ * type declarations
+ */
+typedef struct {
+    PyObject_HEAD
+    u_int64_t           handle;
+    PyThread_type_lock  lock;
+    PyObject            *linuxhiddev;
+    int                 card_type;
+    int                 card_id;
+    int                 silent;
+} DecisionUsbdioObject;
+
+
+/*
+ * helpers
+ */
+
+/* Accepts ints and strings such as '0x02', like the popen wrapper did */
+static int
+to_int(PyObject *obj, long *value) {
+    PyObject *num;
+
+    if (PyUnicode_Check(obj)) {
+        num = PyLong_FromUnicodeObject(obj, 0);
+    } else {
+        num = PyNumber_Index(obj);
+    }
+    if (num == NULL) return -1;
+    *value = PyLong_AsLong(num);
+    Py_DECREF(num);
+    if (*value == -1 && PyErr_Occurred()) return -1;
+    return 0;
+}
+
+static int
+to_byte(PyObject *obj, u_int8_t *byte, const long max, const char *what) {
+    long value;
+
+    if (to_int(obj, &value) < 0) return -1;
+    if (value < 0 || value > max) {
+        PyErr_Format(PyExc_ValueError, "%s out of range: %ld", what, value);
+        return -1;
+    }
+    *byte = (u_int8_t)value;
+    return 0;
+}
+
+/*
+ * Fails early with the GIL held. Calls check the handle again once they
+ * hold self->lock, a close() may run while the GIL is released.
+ */
+static int
+check_open(DecisionUsbdioObject *self) {
+    if (self->handle == 0) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed device");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *
+io_error(DecisionUsbdioObject *self, const int32_t status) {
+    if (status == CLOSED) {
+        PyErr_SetString(PyExc_ValueError, "I/O operation on closed device");
+        return NULL;
+    }
+    PyErr_Format(PyExc_IOError, "I/O error on card (0x%02X, %d)", self->card_type, self->card_id);
+    return NULL;
+}
+
+static PyObject *
+result(DecisionUsbdioObject *self, const u_int8_t port, const u_int8_t data) {
+    if (!self->silent) PySys_WriteStdout("[0x%02X]=0x%02X\n", port, data);
+    return PyLong_FromLong(data);
+}
+
+
+/*
+ * DecisionUsbdio methods
+ */
+
+static int
+DecisionUsbdio_init(DecisionUsbdioObject *self, PyObject *args, PyObject *kwds) {
+    static char *kwlist[] = {"linuxhiddev", "card_type", "card_id", "silent", NULL};
+    PyObject *linuxhiddev = NULL;
+    const char *devname = "/dev/usb/hiddev1";
+    int card_type = USB_8PR, card_id = 0, silent = 1;
+    u_int64_t handle, old;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|Uiip", kwlist, &linuxhiddev, &card_type, &card_id, &silent))
+        return -1;
+    if (linuxhiddev != NULL && (devname = PyUnicode_AsUTF8(linuxhiddev)) == NULL) return -1;
+    if (strlen(devname) >= 64) {
+        PyErr_SetString(PyExc_ValueError, "device name too long");
+        return -1;
+    }
+    if (!dcihid_assert_card_type(card_type) || !dcihid_assert_card_id(card_id)) {
+        PyErr_Format(PyExc_ValueError, "invalid card (0x%02X, %d)", card_type, card_id);
+        return -1;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    handle = dcihid_open(devname, card_type, card_id);
+    Py_END_ALLOW_THREADS
+    if (handle == 0) {
+        PyErr_Format(PyExc_IOError, "There is no Decision-Computer DCI HID USB device (CardID, CardNO) = (%d, %d) plugged on %s",
+                     card_type, card_id, devname);
+        return -1;
+    }
+
+    /* Other threads may be using the old handle, swap it under the lock */
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    old = self->handle;
+    self->handle = handle;
+    PyThread_release_lock(self->lock);
+    if (old) dcihid_close(old);
+    Py_END_ALLOW_THREADS
+    Py_XSETREF(self->linuxhiddev, PyUnicode_FromString(devname));
+    self->card_type = card_type;
+    self->card_id = card_id;
+    self->silent = silent;
+    return 0;
+}
+
+static PyObject *
+DecisionUsbdio_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+    DecisionUsbdioObject *self = (DecisionUsbdioObject *)type->tp_alloc(type, 0);
+
+    if (self == NULL) return NULL;
+    if ((self->lock = PyThread_allocate_lock()) == NULL) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+static void
+DecisionUsbdio_dealloc(DecisionUsbdioObject *self) {
+    if (self->handle) dcihid_close(self->handle);
+    if (self->lock) PyThread_free_lock(self->lock);
+    Py_XDECREF(self->linuxhiddev);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *
+DecisionUsbdio_close(DecisionUsbdioObject *self, PyObject *unused) {
+    if (self->handle) {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        /* Another close() may have run since the check */
+        if (self->handle) dcihid_close(self->handle);
+        self->handle = 0;
+        PyThread_release_lock(self->lock);
+        Py_END_ALLOW_THREADS
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+DecisionUsbdio_enter(DecisionUsbdioObject *self, PyObject *unused) {
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+static PyObject *
+DecisionUsbdio_exit(DecisionUsbdioObject *self, PyObject *args) {
+    return DecisionUsbdio_close(self, NULL);
+}
+
+static PyObject *
+DecisionUsbdio_read_byte(DecisionUsbdioObject *self, PyObject *arg) {
+    u_int8_t port, data;
+    int32_t ret;
+
+    if (check_open(self) < 0 || to_byte(arg, &port, 0xFF, "port") < 0) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    ret = self->handle ? dcihid_read(self->handle, port, &data) : CLOSED;
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) return io_error(self, ret);
+
+    return result(self, port, data);
+}
+
+static PyObject *
+DecisionUsbdio_write_byte(DecisionUsbdioObject *self, PyObject *args) {
+    PyObject *port_obj, *byte_obj;
+    u_int8_t port, data;
+    int32_t ret;
+
+    if (!PyArg_ParseTuple(args, "OO", &port_obj, &byte_obj)) return NULL;
+    if (check_open(self) < 0 || to_byte(port_obj, &port, 0xFF, "port") < 0 || to_byte(byte_obj, &data, 0xFF, "byte") < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    ret = self->handle ? dcihid_write(self->handle, port, data) : CLOSED;
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) return io_error(self, ret);
+
+    return result(self, port, data);
+}
+
+static PyObject *
+modify_bit(DecisionUsbdioObject *self, PyObject *args, const int set) {
+    PyObject *port_obj, *bit_obj;
+    u_int8_t port, bit, data;
+    int32_t ret;
+
+    if (!PyArg_ParseTuple(args, "OO", &port_obj, &bit_obj)) return NULL;
+    if (check_open(self) < 0 || to_byte(port_obj, &port, 0xFF, "port") < 0 || to_byte(bit_obj, &bit, 7, "bit") < 0)
+        return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    if (self->handle == 0) {
+        ret = CLOSED;
+    } else if (set) {
+        ret = dcihid_set_bits(self->handle, port, 1 << bit, &data);
+    } else {
+        ret = dcihid_clear_bits(self->handle, port, 1 << bit, &data);
+    }
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) return io_error(self, ret);
+
+    return result(self, port, data);
+}
+
+static PyObject *
+DecisionUsbdio_set_bit(DecisionUsbdioObject *self, PyObject *args) {
+    return modify_bit(self, args, 1);
+}
+
+static PyObject *
+DecisionUsbdio_clear_bit(DecisionUsbdioObject *self, PyObject *args) {
+    return modify_bit(self, args, 0);
+}
+
+/* Reads len samples of one port into buf, the GIL is not held meanwhile */
+static int32_t
+read_samples(DecisionUsbdioObject *self, const u_int8_t port, u_int8_t *buf, const Py_ssize_t len) {
+    Py_ssize_t i;
+    int32_t ret;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    ret = self->handle ? 0 : CLOSED;
+    for (i = 0; i < len && ret == 0; i++) {
+        ret = dcihid_read(self->handle, port, &buf[i]);
+    }
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    return ret;
+}
+
+static PyObject *
+DecisionUsbdio_read_block(DecisionUsbdioObject *self, PyObject *args) {
+    PyObject *port_obj, *block;
+    Py_ssize_t count;
+    u_int8_t port;
+    int32_t ret;
+
+    if (!PyArg_ParseTuple(args, "On", &port_obj, &count)) return NULL;
+    if (check_open(self) < 0 || to_byte(port_obj, &port, 0xFF, "port") < 0) return NULL;
+    if (count < 0) {
+        PyErr_SetString(PyExc_ValueError, "negative count");
+        return NULL;
+    }
+
+    if ((block = PyBytes_FromStringAndSize(NULL, count)) == NULL) return NULL;
+    if ((ret = read_samples(self, port, (u_int8_t *)PyBytes_AS_STRING(block), count)) != 0) {
+        Py_DECREF(block);
+        return io_error(self, ret);
+    }
+    return block;
+}
+
+static PyObject *
+DecisionUsbdio_read_block_into(DecisionUsbdioObject *self, PyObject *args) {
+    PyObject *port_obj;
+    Py_buffer view;
+    u_int8_t port;
+    int32_t ret;
+
+    if (!PyArg_ParseTuple(args, "Ow*", &port_obj, &view)) return NULL;
+    if (check_open(self) < 0 || to_byte(port_obj, &port, 0xFF, "port") < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+
+    ret = read_samples(self, port, (u_int8_t *)view.buf, view.len);
+    PyBuffer_Release(&view);
+    if (ret != 0) return io_error(self, ret);
+
+    return PyLong_FromSsize_t(view.len);
+}
+
+static PyObject *
+DecisionUsbdio_read_all(DecisionUsbdioObject *self, PyObject *unused) {
+    struct dcihid_input input;
+    int32_t ret;
+
+    if (check_open(self) < 0) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    ret = self->handle ? dcihid_read_all(self->handle, &input) : CLOSED;
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) return io_error(self, ret);
+
+    return PyBytes_FromStringAndSize((const char *)input.port, DCIHID_INPUT_PORTS);
+}
+
+static PyObject *
+DecisionUsbdio_read_adc(DecisionUsbdioObject *self, PyObject *unused) {
+    u_int8_t channel;
+    u_int16_t result;
+    int32_t ret;
+
+    if (check_open(self) < 0) return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    ret = self->handle ? dcihid_read_adc(self->handle, &channel, &result) : CLOSED;
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    if (ret != 0) return io_error(self, ret);
+
+    return Py_BuildValue("(ii)", channel, result);
+}
+
+static PyMethodDef DecisionUsbdio_methods[] = {
+    {"read_byte", (PyCFunction)DecisionUsbdio_read_byte, METH_O,
+     "read_byte(port) -> value read from the port"},
+    {"write_byte", (PyCFunction)DecisionUsbdio_write_byte, METH_VARARGS,
+     "write_byte(port, byte) -> byte written to the port"},
+    {"set_bit", (PyCFunction)DecisionUsbdio_set_bit, METH_VARARGS,
+     "set_bit(port, bit) -> new value of the port"},
+    {"clear_bit", (PyCFunction)DecisionUsbdio_clear_bit, METH_VARARGS,
+     "clear_bit(port, bit) -> new value of the port"},
+    {"read_all", (PyCFunction)DecisionUsbdio_read_all, METH_NOARGS,
+     "read_all() -> bytes with ports 0x00 to 0x03 taken from a single input report"},
+    {"read_adc", (PyCFunction)DecisionUsbdio_read_adc, METH_NOARGS,
+     "read_adc() -> (channel, result) of the last ADC conversion"},
+    {"read_block", (PyCFunction)DecisionUsbdio_read_block, METH_VARARGS,
+     "read_block(port, count) -> bytes with count samples of the port"},
+    {"read_block_into", (PyCFunction)DecisionUsbdio_read_block_into, METH_VARARGS,
+     "read_block_into(port, buffer) -> fills a writable buffer with samples of the port"},
+    {"close", (PyCFunction)DecisionUsbdio_close, METH_NOARGS,
+     "close() -> closes the device handle"},
+    {"__enter__", (PyCFunction)DecisionUsbdio_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)DecisionUsbdio_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyObject *
+DecisionUsbdio_get_linuxhiddev(DecisionUsbdioObject *self, void *closure) {
+    if (self->linuxhiddev == NULL) Py_RETURN_NONE;
+    Py_INCREF(self->linuxhiddev);
+    return self->linuxhiddev;
+}
+
+static PyObject *
+DecisionUsbdio_get_card_type(DecisionUsbdioObject *self, void *closure) {
+    return PyLong_FromLong(self->card_type);
+}
+
+static PyObject *
+DecisionUsbdio_get_card_id(DecisionUsbdioObject *self, void *closure) {
+    return PyLong_FromLong(self->card_id);
+}
+
+static PyGetSetDef DecisionUsbdio_getset[] = {
+    {"linuxhiddev", (getter)DecisionUsbdio_get_linuxhiddev, NULL, "Linux HID device in use", NULL},
+    {"card_type", (getter)DecisionUsbdio_get_card_type, NULL, "Card type", NULL},
+    {"card_id", (getter)DecisionUsbdio_get_card_id, NULL, "Card ID", NULL},
+    {NULL}
+};
+
+static PyTypeObject DecisionUsbdioType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "dcihid.DecisionUsbdio",
+    .tp_doc = "DecisionUsbdio(linuxhiddev='/dev/usb/hiddev1', card_type=0x06, card_id=0, silent=True)\n\n"
+              "Decision-Computer DCI USB HID board, kept open until close() is called.",
+    .tp_basicsize = sizeof(DecisionUsbdioObject),
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_new = DecisionUsbdio_new,
+    .tp_init = (initproc)DecisionUsbdio_init,
+    .tp_dealloc = (destructor)DecisionUsbdio_dealloc,
+    .tp_methods = DecisionUsbdio_methods,
+    .tp_getset = DecisionUsbdio_getset,
+};
+
+
+/*
+ * module
+ */
+
+static struct PyModuleDef dcihid_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "dcihid",
+    .m_doc = "Native driver for DCI USB HID devices from Decision-Computer",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC
+PyInit_dcihid(void) {
+    PyObject *m;
+
+    if (PyType_Ready(&DecisionUsbdioType) < 0) return NULL;
+    if ((m = PyModule_Create(&dcihid_module)) == NULL) return NULL;
+
+    Py_INCREF(&DecisionUsbdioType);
+    if (PyModule_AddObject(m, "DecisionUsbdio", (PyObject *)&DecisionUsbdioType) < 0) {
+        Py_DECREF(&DecisionUsbdioType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,526 @@
+/*
+ * File:
+ *      dcimgr.c
+ *
+ * Description:
+ *      Manager for several DCI USB HID devices from Decision-Computer.
+ *      Every board gets its own worker thread and command queue, so a
+ *      slow transaction on one board does not hold back the others, and
+ *      requests to all boards run in parallel.
+ *
+ *      Operations can also be submitted without waiting. Each board runs
+ *      its operations in submission order, overlapping with the other
+ *      boards, and completions are delivered to a callback or queued
+ *      until dcimgr_reap(), with an eventfd to poll on.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/eventfd.h>
+
+#include "dcihid.h"
+#include "dcimgr.h"
+
+
+/*
+ * type declarations
+ */
+
+/* Completion shared by all commands of one request */
+struct dcimgr_batch {
+    pthread_mutex_t             lock;
+    pthread_cond_t              cond;
+    int32_t                     pending;
+};
+
+struct dcimgr_cmd {
+    int                         op;
+    u_int32_t                   addr;
+    u_int8_t                    data;
+    u_int8_t                    *result;
+    struct dcihid_input         *input;
+    int32_t                     *status;
+    struct dcimgr_batch         *batch;
+    int                         async;          // Completion goes to dcimgr_complete()
+    u_int64_t                   user_data;
+    u_int64_t                   submitted;
+};
+
+struct dcimgr;
+
+struct dcimgr_worker {
+    struct dcimgr               *mgr;
+    int32_t                     board;
+    u_int64_t                   dcihid_handle;
+    pthread_t                   thread;
+    pthread_mutex_t             lock;
+    pthread_cond_t              not_empty;
+    pthread_cond_t              not_full;
+    struct dcimgr_cmd           queue[DCIMGR_QUEUE_SIZE];
+    u_int32_t                   head;
+    u_int32_t                   tail;
+    int                         stop;
+};
+
+struct dcimgr {
+    struct dcimgr_worker        *workers[DCIMGR_BOARDS_MAX];
+    int32_t                     num_workers;
+
+    /* Asynchronous completions, under cq_lock */
+    pthread_mutex_t             cq_lock;
+    pthread_cond_t              cq_cond;
+    struct dcimgr_completion    cq[DCIMGR_INFLIGHT_MAX];
+    u_int32_t                   cq_head;
+    u_int32_t                   cq_tail;
+    u_int32_t                   inflight;
+    int                         eventfd;
+    dcimgr_callback             callback;
+    void                        *callback_arg;
+};
+typedef struct dcimgr *dcimgr_t;
+
+
+/*
+ * functions
+ */
+
+static void
+dcimgr_batch_init(struct dcimgr_batch *batch, const int32_t pending) {
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->cond, NULL);
+    batch->pending = pending;
+}
+
+static void
+dcimgr_batch_wait(struct dcimgr_batch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    while (batch->pending) pthread_cond_wait(&batch->cond, &batch->lock);
+    pthread_mutex_unlock(&batch->lock);
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+}
+
+static void
+dcimgr_batch_done(struct dcimgr_batch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    if (--batch->pending == 0) pthread_cond_signal(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static u_int64_t
+dcimgr_now_ns(void) {
+    struct timespec             ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Hands a completion to the callback, or queues it and wakes the eventfd
+ */
+static void
+dcimgr_complete(struct dcimgr *mgr, const struct dcimgr_completion *completion) {
+    u_int64_t                   one = 1;
+
+    if (mgr->callback) {
+        mgr->callback(completion, mgr->callback_arg);
+        pthread_mutex_lock(&mgr->cq_lock);
+        mgr->inflight--;
+        pthread_cond_broadcast(&mgr->cq_cond);
+        pthread_mutex_unlock(&mgr->cq_lock);
+        return;
+    }
+
+    /* Submissions are limited to DCIMGR_INFLIGHT_MAX, the ring can not overflow */
+    pthread_mutex_lock(&mgr->cq_lock);
+    mgr->cq[mgr->cq_head % DCIMGR_INFLIGHT_MAX] = *completion;
+    mgr->cq_head++;
+    pthread_cond_broadcast(&mgr->cq_cond);
+    pthread_mutex_unlock(&mgr->cq_lock);
+    if (write(mgr->eventfd, &one, sizeof(one)) != sizeof(one)) perror("dcimgr: eventfd");
+}
+
+static void
+dcimgr_execute(struct dcimgr_worker *worker, struct dcimgr_cmd *cmd) {
+    struct dcimgr_completion    completion;
+    u_int8_t                    *result = cmd->result;
+    struct dcihid_input         *input = cmd->input;
+    int32_t                     ret = -1;
+
+    if (cmd->async) {
+        memset(&completion, 0, sizeof(completion));
+        result = &completion.data;
+        input = &completion.input;
+        completion.data = cmd->data;
+    }
+
+    switch (cmd->op) {
+        case DCIMGR_READ:
+            ret = dcihid_read(worker->dcihid_handle, cmd->addr, result);
+            break;
+        case DCIMGR_WRITE:
+            ret = dcihid_write(worker->dcihid_handle, cmd->addr, cmd->data);
+            break;
+        case DCIMGR_READ_ALL:
+            ret = dcihid_read_all(worker->dcihid_handle, input);
+            break;
+    }
+
+    if (cmd->async) {
+        completion.user_data = cmd->user_data;
+        completion.board = worker->board;
+        completion.op = cmd->op;
+        completion.addr = cmd->addr;
+        completion.status = ret;
+        completion.error = ret ? errno : 0;
+        completion.submitted = cmd->submitted;
+        completion.completed = dcimgr_now_ns();
+        dcimgr_complete(worker->mgr, &completion);
+        return;
+    }
+    if (cmd->status) *cmd->status = ret;
+    if (cmd->batch) dcimgr_batch_done(cmd->batch);
+}
+
+static void *
+dcimgr_work(void *arg) {
+    struct dcimgr_worker        *worker = (struct dcimgr_worker *)arg;
+    struct dcimgr_cmd           cmds[DCIMGR_QUEUE_SIZE];
+    u_int32_t                   count, i;
+
+    for (;;) {
+        /* Takes every queued command at once, submitters are not held back by the transfers */
+        pthread_mutex_lock(&worker->lock);
+        while (worker->head == worker->tail && !worker->stop) pthread_cond_wait(&worker->not_empty, &worker->lock);
+        if (worker->head == worker->tail) {
+            pthread_mutex_unlock(&worker->lock);
+            break;
+        }
+        for (count = 0; worker->tail != worker->head; count++) {
+            cmds[count] = worker->queue[worker->tail % DCIMGR_QUEUE_SIZE];
+            worker->tail++;
+        }
+        pthread_cond_broadcast(&worker->not_full);
+        pthread_mutex_unlock(&worker->lock);
+
+        for (i = 0; i < count; i++) dcimgr_execute(worker, &cmds[i]);
+    }
+    return NULL;
+}
+
+/*
+ * Queues one command, waiting for room when the queue of the board is
+ * full or failing with EAGAIN without wait
+ */
+static int32_t
+dcimgr_submit(struct dcimgr_worker *worker, const struct dcimgr_cmd *cmd, const int wait) {
+    pthread_mutex_lock(&worker->lock);
+    while (worker->head - worker->tail == DCIMGR_QUEUE_SIZE) {
+        if (!wait) {
+            pthread_mutex_unlock(&worker->lock);
+            errno = EAGAIN;
+            return -1;
+        }
+        pthread_cond_wait(&worker->not_full, &worker->lock);
+    }
+    worker->queue[worker->head % DCIMGR_QUEUE_SIZE] = *cmd;
+    worker->head++;
+    pthread_cond_signal(&worker->not_empty);
+    pthread_mutex_unlock(&worker->lock);
+    return 0;
+}
+
+u_int64_t
+dcimgr_create(void) {
+    dcimgr_t                    mgr;
+
+    mgr = (dcimgr_t)calloc(1, sizeof(struct dcimgr));
+    if (mgr == NULL) return 0;
+    if ((mgr->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+        perror("dcimgr: eventfd");
+        free(mgr);
+        return 0;
+    }
+    pthread_mutex_init(&mgr->cq_lock, NULL);
+    pthread_cond_init(&mgr->cq_cond, NULL);
+    return (u_int64_t)mgr;
+}
+
+int32_t
+dcimgr_add(const u_int64_t mgr_handle, const u_int64_t dcihid_handle) {
+    dcimgr_t                    mgr = (dcimgr_t)mgr_handle;
+    struct dcimgr_worker        *worker;
+
+    if (mgr->num_workers == DCIMGR_BOARDS_MAX) {
+        fprintf(stderr, "dcimgr: at most %d boards are supported\n", DCIMGR_BOARDS_MAX);
+        return -1;
+    }
+
+    worker = (struct dcimgr_worker *)calloc(1, sizeof(struct dcimgr_worker));
+    if (worker == NULL) return -1;
+    worker->mgr = mgr;
+    worker->board = mgr->num_workers;
+    worker->dcihid_handle = dcihid_handle;
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->not_empty, NULL);
+    pthread_cond_init(&worker->not_full, NULL);
+    if (pthread_create(&worker->thread, NULL, dcimgr_work, worker) != 0) {
+        perror("dcimgr: pthread_create");
+        free(worker);
+        return -1;
+    }
+
+    mgr->workers[mgr->num_workers] = worker;
+    return mgr->num_workers++;
+}
+
+int32_t
+dcimgr_count(const u_int64_t mgr_handle) {
+    return ((dcimgr_t)mgr_handle)->num_workers;
+}
+
+/*
+ * Runs one command on one board and waits for it
+ */
+static int32_t
+dcimgr_run(dcimgr_t mgr, const int32_t board, struct dcimgr_cmd *cmd) {
+    struct dcimgr_batch         batch;
+    int32_t                     status = -1;
+
+    if (board < 0 || board >= mgr->num_workers) return -1;
+    dcimgr_batch_init(&batch, 1);
+    cmd->status = &status;
+    cmd->batch = &batch;
+    dcimgr_submit(mgr->workers[board], cmd, 1);
+    dcimgr_batch_wait(&batch);
+    return status;
+}
+
+int32_t
+dcimgr_read(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, u_int8_t *data) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_READ;
+    cmd.addr = addr;
+    cmd.result = data;
+    return dcimgr_run((dcimgr_t)mgr_handle, board, &cmd);
+}
+
+int32_t
+dcimgr_write(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int8_t data) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_WRITE;
+    cmd.addr = addr;
+    cmd.data = data;
+    return dcimgr_run((dcimgr_t)mgr_handle, board, &cmd);
+}
+
+/*
+ * Fans one command out to every board and gathers the results, returns
+ * the number of boards that failed.
+ */
+static int32_t
+dcimgr_fan_out(dcimgr_t mgr, struct dcimgr_cmd *cmd, struct dcihid_input *inputs, const u_int8_t *data, int32_t *status) {
+    struct dcimgr_batch         batch;
+    int32_t                     results[DCIMGR_BOARDS_MAX];
+    int32_t                     i, failed = 0;
+
+    dcimgr_batch_init(&batch, mgr->num_workers);
+    cmd->batch = &batch;
+    for (i = 0; i < mgr->num_workers; i++) {
+        cmd->status = &results[i];
+        if (inputs) cmd->input = &inputs[i];
+        if (data) cmd->data = data[i];
+        dcimgr_submit(mgr->workers[i], cmd, 1);
+    }
+    dcimgr_batch_wait(&batch);
+
+    for (i = 0; i < mgr->num_workers; i++) {
+        if (results[i] != 0) failed++;
+        if (status) status[i] = results[i];
+    }
+    return failed;
+}
+
+int32_t
+dcimgr_read_all(const u_int64_t mgr_handle, struct dcihid_input *inputs, int32_t *status) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_READ_ALL;
+    return dcimgr_fan_out((dcimgr_t)mgr_handle, &cmd, inputs, NULL, status);
+}
+
+int32_t
+dcimgr_write_all(const u_int64_t mgr_handle, const u_int32_t addr, const u_int8_t *data, int32_t *status) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_WRITE;
+    cmd.addr = addr;
+    return dcimgr_fan_out((dcimgr_t)mgr_handle, &cmd, NULL, data, status);
+}
+
+/*
+ * Sends completions to a callback instead of the completion queue. Only
+ * while nothing is in flight.
+ */
+int32_t
+dcimgr_set_callback(const u_int64_t mgr_handle, dcimgr_callback callback, void *arg) {
+    dcimgr_t                    mgr = (dcimgr_t)mgr_handle;
+    int32_t                     ret = 0;
+
+    pthread_mutex_lock(&mgr->cq_lock);
+    if (mgr->inflight) {
+        errno = EBUSY;
+        ret = -1;
+    } else {
+        mgr->callback = callback;
+        mgr->callback_arg = arg;
+    }
+    pthread_mutex_unlock(&mgr->cq_lock);
+    return ret;
+}
+
+/*
+ * Readable while completions are queued, for poll() or epoll
+ */
+int
+dcimgr_eventfd(const u_int64_t mgr_handle) {
+    return ((dcimgr_t)mgr_handle)->eventfd;
+}
+
+/*
+ * Queues one command on one board without waiting for it, or for room:
+ * fails with EAGAIN when DCIMGR_INFLIGHT_MAX operations are in flight or
+ * DCIMGR_QUEUE_SIZE are queued on the board
+ */
+static int32_t
+dcimgr_submit_async(dcimgr_t mgr, const int32_t board, struct dcimgr_cmd *cmd) {
+    if (board < 0 || board >= mgr->num_workers) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&mgr->cq_lock);
+    if (mgr->inflight == DCIMGR_INFLIGHT_MAX) {
+        pthread_mutex_unlock(&mgr->cq_lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    mgr->inflight++;
+    pthread_mutex_unlock(&mgr->cq_lock);
+
+    cmd->async = 1;
+    cmd->submitted = dcimgr_now_ns();
+    if (dcimgr_submit(mgr->workers[board], cmd, 0) != 0) {
+        pthread_mutex_lock(&mgr->cq_lock);
+        mgr->inflight--;
+        pthread_cond_broadcast(&mgr->cq_cond);
+        pthread_mutex_unlock(&mgr->cq_lock);
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t
+dcimgr_submit_read(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int64_t user_data) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_READ;
+    cmd.addr = addr;
+    cmd.user_data = user_data;
+    return dcimgr_submit_async((dcimgr_t)mgr_handle, board, &cmd);
+}
+
+int32_t
+dcimgr_submit_write(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int8_t data,
+                    const u_int64_t user_data) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_WRITE;
+    cmd.addr = addr;
+    cmd.data = data;
+    cmd.user_data = user_data;
+    return dcimgr_submit_async((dcimgr_t)mgr_handle, board, &cmd);
+}
+
+int32_t
+dcimgr_submit_read_all(const u_int64_t mgr_handle, const int32_t board, const u_int64_t user_data) {
+    struct dcimgr_cmd           cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.op = DCIMGR_READ_ALL;
+    cmd.user_data = user_data;
+    return dcimgr_submit_async((dcimgr_t)mgr_handle, board, &cmd);
+}
+
+/*
+ * Takes up to max queued completions, returns how many. With wait, blocks
+ * until there is one or nothing is left in flight: with a callback, until
+ * every submitted operation completed.
+ */
+int32_t
+dcimgr_reap(const u_int64_t mgr_handle, struct dcimgr_completion *completions, const u_int32_t max, const int32_t wait) {
+    dcimgr_t                    mgr = (dcimgr_t)mgr_handle;
+    u_int64_t                   counter, one = 1;
+    u_int32_t                   count;
+
+    /* Completions queued from now on wake the eventfd again */
+    if (read(mgr->eventfd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) perror("dcimgr: eventfd");
+
+    pthread_mutex_lock(&mgr->cq_lock);
+    while (wait && mgr->cq_head == mgr->cq_tail && mgr->inflight) pthread_cond_wait(&mgr->cq_cond, &mgr->cq_lock);
+    for (count = 0; count < max && mgr->cq_tail != mgr->cq_head; count++) {
+        completions[count] = mgr->cq[mgr->cq_tail % DCIMGR_INFLIGHT_MAX];
+        mgr->cq_tail++;
+    }
+    mgr->inflight -= count;
+    counter = mgr->cq_head - mgr->cq_tail;
+    pthread_mutex_unlock(&mgr->cq_lock);
+
+    /* Some are left, keep the eventfd readable */
+    if (counter && write(mgr->eventfd, &one, sizeof(one)) != sizeof(one)) perror("dcimgr: eventfd");
+    return count;
+}
+
+int32_t
+dcimgr_destroy(const u_int64_t mgr_handle) {
+    dcimgr_t                    mgr = (dcimgr_t)mgr_handle;
+    struct dcimgr_worker        *worker;
+    int32_t                     i;
+
+    /* Queued commands are still run, the handles stay open, unreaped completions are dropped */
+    for (i = 0; i < mgr->num_workers; i++) {
+        worker = mgr->workers[i];
+        pthread_mutex_lock(&worker->lock);
+        worker->stop = 1;
+        pthread_cond_signal(&worker->not_empty);
+        pthread_mutex_unlock(&worker->lock);
+        pthread_join(worker->thread, NULL);
+        pthread_cond_destroy(&worker->not_empty);
+        pthread_cond_destroy(&worker->not_full);
+        pthread_mutex_destroy(&worker->lock);
+        free(worker);
+    }
+    close(mgr->eventfd);
+    pthread_cond_destroy(&mgr->cq_cond);
+    pthread_mutex_destroy(&mgr->cq_lock);
+    free(mgr);
+    return 0;
+}
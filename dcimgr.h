@@ -0,0 +1,73 @@
+#ifndef _DCIMGR_H_
+#define _DCIMGR_H_
+
+#include <sys/types.h>
+
+#include "dcihid.h"
+
+/*
+ * manager limits
+ */
+#define DCIMGR_BOARDS_MAX   32
+#define DCIMGR_INFLIGHT_MAX 1024        // Asynchronous operations submitted and not yet reaped
+#define DCIMGR_QUEUE_SIZE   64          // Operations queued on one board and not yet started
+
+/*
+ * operations
+ */
+enum {
+    DCIMGR_READ,
+    DCIMGR_WRITE,
+    DCIMGR_READ_ALL
+};
+
+/*
+ * completion of an asynchronous operation, as given to the callback or
+ * returned by dcimgr_reap()
+ */
+struct dcimgr_completion {
+    u_int64_t           user_data;      // As given at submission
+    int32_t             board;
+    int32_t             op;             // DCIMGR_READ, DCIMGR_WRITE or DCIMGR_READ_ALL
+    u_int32_t           addr;
+    u_int8_t            data;           // Byte read or written
+    struct dcihid_input input;          // DCIMGR_READ_ALL only
+    int32_t             status;         // 0 or -1
+    int32_t             error;          // errno when status is -1
+    u_int64_t           submitted;      // CLOCK_MONOTONIC times, in ns
+    u_int64_t           completed;
+};
+
+/*
+ * called on the worker thread of the board, must not block
+ */
+typedef void (*dcimgr_callback)(const struct dcimgr_completion *completion, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+u_int64_t   dcimgr_create(void);
+int32_t     dcimgr_add(const u_int64_t mgr_handle, const u_int64_t dcihid_handle);
+int32_t     dcimgr_count(const u_int64_t mgr_handle);
+int32_t     dcimgr_read(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, u_int8_t *data);
+int32_t     dcimgr_write(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int8_t data);
+int32_t     dcimgr_read_all(const u_int64_t mgr_handle, struct dcihid_input *inputs, int32_t *status);
+int32_t     dcimgr_write_all(const u_int64_t mgr_handle, const u_int32_t addr, const u_int8_t *data, int32_t *status);
+int32_t     dcimgr_set_callback(const u_int64_t mgr_handle, dcimgr_callback callback, void *arg);
+int         dcimgr_eventfd(const u_int64_t mgr_handle);
+int32_t     dcimgr_submit_read(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int64_t user_data);
+int32_t     dcimgr_submit_write(const u_int64_t mgr_handle, const int32_t board, const u_int32_t addr, const u_int8_t data,
+                                const u_int64_t user_data);
+int32_t     dcimgr_submit_read_all(const u_int64_t mgr_handle, const int32_t board, const u_int64_t user_data);
+int32_t     dcimgr_reap(const u_int64_t mgr_handle, struct dcimgr_completion *completions, const u_int32_t max,
+                        const int32_t wait);
+int32_t     dcimgr_destroy(const u_int64_t mgr_handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
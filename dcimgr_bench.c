@@ -0,0 +1,331 @@
+/*
+ * File:
+ *      dcimgr_bench.c
+ *
+ * Description:
+ *      Measures the aggregate rate of "read all inputs on all boards"
+ *      through the dcimgr manager for 1 to N boards, against the same
+ *      requests issued one board after the other from a single thread.
+ *
+ *      The fan-out test times rounds of one read per board, issued by
+ *      a synchronous loop and submitted asynchronously with completions
+ *      taken by a callback or through the eventfd, and checks that the
+ *      operations of every board complete in submission order and that
+ *      a full queue refuses submissions instead of blocking, and exits
+ *      with 1 when one of them fails. With -S it runs against simulated
+ *      boards.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcimgr.h"
+#include "dcisim.h"
+
+#define FANOUT_SIM_CARD     USB_IND
+#define FANOUT_CHECK_OPS    64              // Operations per board of the ordering check
+
+static double
+now_s(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Parses "[<device>:]<type>:<id>" as given to -b
+ */
+static u_int64_t
+open_board(const char *arg) {
+    char tmp[128], devname[64] = "";
+    char *type, *id;
+    u_int card_type, card_id;
+
+    snprintf(tmp, sizeof(tmp), "%s", arg);
+    if ((id = strrchr(tmp, ':')) == NULL) return 0;
+    *id++ = '\0';
+    if ((type = strrchr(tmp, ':')) != NULL) {
+        *type++ = '\0';
+        if (strlen(tmp) >= sizeof(devname)) return 0;
+        strcpy(devname, tmp);
+    } else {
+        type = tmp;
+    }
+    card_type = strtol(type, NULL, 0);
+    card_id = strtol(id, NULL, 0);
+    if (devname[0] == '\0' && dcihid_lookup(card_type, card_id, devname, sizeof(devname)) != 0) return 0;
+    return dcihid_open(devname, card_type, card_id);
+}
+
+static u_int64_t
+now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int
+compare_u64(const void *a, const void *b) {
+    u_int64_t x = *(const u_int64_t *)a, y = *(const u_int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void
+print_fanout(const char *mode, const int boards, u_int64_t *times, const u_int32_t rounds, const u_int64_t errors) {
+    u_int64_t total = 0;
+    u_int32_t i;
+
+    qsort(times, rounds, sizeof(times[0]), compare_u64);
+    for (i = 0; i < rounds; i++) total += times[i];
+    printf("%6d  %-8s  %6u  %10.1f  %10.1f  %10.1f  %6llu\n", boards, mode, rounds, times[rounds / 2] / 1e3,
+           times[(u_int64_t)rounds * 99 / 100] / 1e3, (double)total / rounds / 1e3, (unsigned long long)errors);
+}
+
+static atomic_uint_fast64_t callback_errors;
+
+static void
+count_errors(const struct dcimgr_completion *completion, void *arg) {
+    if (completion->status != 0) atomic_fetch_add(&callback_errors, 1);
+}
+
+/*
+ * Submits alternate writes and reads of port 0x02 on every board, each
+ * read has to return the write before it and come back in order
+ */
+static int
+check_ordering(const u_int64_t mgr, const int boards) {
+    struct dcimgr_completion completions[64];
+    u_int64_t next[DCIMGR_BOARDS_MAX];
+    u_int64_t mismatches = 0, done = 0;
+    int32_t count, i, k, consistent;
+
+    for (k = 0; k < FANOUT_CHECK_OPS; k += 2) {
+        for (i = 0; i < boards; i++) {
+            dcimgr_submit_write(mgr, i, 0x02, (u_int8_t)(k * 7 + i), k);
+            dcimgr_submit_read(mgr, i, 0x02, k + 1);
+        }
+    }
+    memset(next, 0, sizeof(next));
+    while (done < (u_int64_t)boards * FANOUT_CHECK_OPS) {
+        if ((count = dcimgr_reap(mgr, completions, 64, 1)) <= 0) break;
+        for (i = 0; i < count; i++) {
+            struct dcimgr_completion *c = &completions[i];
+
+            if (c->status != 0 || c->user_data != next[c->board]++) mismatches++;
+            else if (c->op == DCIMGR_READ && c->data != (u_int8_t)((c->user_data - 1) * 7 + c->board)) mismatches++;
+        }
+        done += count;
+    }
+    consistent = mismatches == 0 && done == (u_int64_t)boards * FANOUT_CHECK_OPS;
+    printf("check=ordering boards=%d ops=%llu consistent=%s mismatches=%llu\n", boards, (unsigned long long)done,
+           consistent ? "yes" : "no", (unsigned long long)mismatches);
+    return consistent ? 0 : -1;
+}
+
+/*
+ * Submits twice what the queue of board 0 holds in one burst: the ones
+ * without room fail at once with EAGAIN and every accepted one completes
+ */
+static int
+check_backpressure(const u_int64_t mgr) {
+    struct dcimgr_completion completions[64];
+    u_int64_t accepted = 0, rejected = 0, other = 0, done = 0;
+    int32_t count, k, consistent;
+
+    for (k = 0; k < 2 * DCIMGR_QUEUE_SIZE; k++) {
+        if (dcimgr_submit_write(mgr, 0, 0x02, (u_int8_t)k, k) == 0) accepted++;
+        else if (errno == EAGAIN) rejected++;
+        else other++;
+    }
+    while (done < accepted) {
+        if ((count = dcimgr_reap(mgr, completions, 64, 1)) <= 0) break;
+        done += count;
+    }
+    consistent = other == 0 && rejected > 0 && done == accepted;
+    printf("check=backpressure queue=%d accepted=%llu rejected=%llu consistent=%s\n", DCIMGR_QUEUE_SIZE,
+           (unsigned long long)accepted, (unsigned long long)rejected, consistent ? "yes" : "no");
+    return consistent ? 0 : -1;
+}
+
+/*
+ * Times rounds of one read_all per board, synchronous and asynchronous,
+ * returns -1 when a check fails
+ */
+static int
+fanout(u_int64_t *handles, const int boards, const u_int32_t rounds) {
+    struct dcimgr_completion completions[DCIMGR_BOARDS_MAX];
+    struct dcihid_input input;
+    struct pollfd pfd;
+    u_int64_t *times, start, errors;
+    u_int32_t r;
+    int32_t done, count, i, ret = 0;
+    u_int64_t mgr;
+
+    if ((times = (u_int64_t *)calloc(rounds, sizeof(u_int64_t))) == NULL) {
+        perror("fanout");
+        return -1;
+    }
+    printf("fanout  mode      rounds      p50_us      p99_us     mean_us  errors\n");
+
+    // One thread, one board after the other:
+    errors = 0;
+    for (r = 0; r < rounds; r++) {
+        start = now_ns();
+        for (i = 0; i < boards; i++) {
+            if (dcihid_read_all(handles[i], &input) != 0) errors++;
+        }
+        times[r] = now_ns() - start;
+    }
+    print_fanout("sync", boards, times, rounds, errors);
+
+    mgr = dcimgr_create();
+    for (i = 0; i < boards; i++) dcimgr_add(mgr, handles[i]);
+
+    // Completions on the worker threads:
+    atomic_store(&callback_errors, 0);
+    dcimgr_set_callback(mgr, count_errors, NULL);
+    for (r = 0; r < rounds; r++) {
+        start = now_ns();
+        for (i = 0; i < boards; i++) dcimgr_submit_read_all(mgr, i, i);
+        dcimgr_reap(mgr, NULL, 0, 1);
+        times[r] = now_ns() - start;
+    }
+    print_fanout("callback", boards, times, rounds, atomic_load(&callback_errors));
+    dcimgr_set_callback(mgr, NULL, NULL);
+
+    // Completions queued, polled through the eventfd:
+    errors = 0;
+    pfd.fd = dcimgr_eventfd(mgr);
+    pfd.events = POLLIN;
+    for (r = 0; r < rounds; r++) {
+        start = now_ns();
+        for (i = 0; i < boards; i++) dcimgr_submit_read_all(mgr, i, i);
+        for (done = 0; done < boards; done += count) {
+            poll(&pfd, 1, -1);
+            count = dcimgr_reap(mgr, completions, DCIMGR_BOARDS_MAX, 0);
+            for (i = 0; i < count; i++) {
+                if (completions[i].status != 0) errors++;
+            }
+        }
+        times[r] = now_ns() - start;
+    }
+    print_fanout("eventfd", boards, times, rounds, errors);
+
+    if (check_ordering(mgr, boards) != 0) ret = -1;
+    if (check_backpressure(mgr) != 0) ret = -1;
+    dcimgr_destroy(mgr);
+    free(times);
+    return ret;
+}
+
+/*
+ * Main
+ */
+int
+main(int argc, char *argv[])
+{
+    u_int64_t handles[DCIMGR_BOARDS_MAX];
+    struct dcihid_input inputs[DCIMGR_BOARDS_MAX];
+    int num_boards = 0, boards, i, opt, sims = 0, fanout_only = 0, ret = 0;
+    double seconds = 2.0, start, elapsed;
+    u_int32_t latency_us = 1000, fanout_rounds = 200;
+    u_int64_t mgr, rounds;
+
+    while ((opt = getopt(argc, argv, "b:s:S:l:r:fh")) != -1) {
+        switch (opt) {
+            case 'b':
+                if (num_boards == DCIMGR_BOARDS_MAX) return 1;
+                if ((handles[num_boards] = open_board(optarg)) == 0) {
+                    fprintf(stderr, "Could not open board '%s'\n", optarg);
+                    return 1;
+                }
+                num_boards++;
+                break;
+            case 's':
+                seconds = atof(optarg);
+                break;
+            case 'S':
+                sims = atoi(optarg);
+                break;
+            case 'l':
+                latency_us = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                fanout_rounds = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                fanout_only = 1;
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s -b [<device>:]<type>:<id> [-b ...] [-S <simulated boards>] [-l <latency_us>] [-s <seconds>]\n"
+                       "       [-r <fan-out rounds>] [-f]\n", argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    /* Simulated boards, each transfer taking latency_us */
+    if (sims) dcisim_set_latency(latency_us);
+    for (i = 0; i < sims; i++) {
+        if (num_boards == DCIMGR_BOARDS_MAX) return 1;
+        if ((handles[num_boards] = dcihid_open_transport("", FANOUT_SIM_CARD, i, DCIHID_TRANSPORT_SIM)) == 0) {
+            fprintf(stderr, "Could not open simulated board %d\n", i);
+            return 1;
+        }
+        num_boards++;
+    }
+    if (num_boards == 0) {
+        fprintf(stderr, "No boards specified. Try '%s -h' for more information.\n", argv[0]);
+        return 1;
+    }
+
+    if (fanout_rounds == 0) fanout_rounds = 1;
+
+    if (!fanout_only) printf("boards  serial_ops/s  parallel_ops/s  speedup\n");
+    for (boards = 1; !fanout_only && boards <= num_boards; boards++) {
+        double serial, parallel;
+
+        // One thread, one board after the other:
+        rounds = 0;
+        start = now_s();
+        do {
+            for (i = 0; i < boards; i++) dcihid_read_all(handles[i], &inputs[i]);
+            rounds++;
+        } while ((elapsed = now_s() - start) < seconds);
+        serial = rounds * boards / elapsed;
+
+        // All boards at once through the manager:
+        mgr = dcimgr_create();
+        for (i = 0; i < boards; i++) dcimgr_add(mgr, handles[i]);
+        rounds = 0;
+        start = now_s();
+        do {
+            dcimgr_read_all(mgr, inputs, NULL);
+            rounds++;
+        } while ((elapsed = now_s() - start) < seconds);
+        parallel = rounds * boards / elapsed;
+        dcimgr_destroy(mgr);
+
+        printf("%6d  %12.1f  %14.1f  %7.2f\n", boards, serial, parallel, parallel / serial);
+    }
+
+    if (fanout(handles, num_boards, fanout_rounds) != 0) ret = 1;
+
+    for (i = 0; i < num_boards; i++) dcihid_close(handles[i]);
+    return ret;
+}
@@ -0,0 +1,342 @@
+/*
+ * File:
+ *      dcipub.c
+ *
+ * Description:
+ *      Publishes the input state of DCI USB HID devices from
+ *      Decision-Computer to other processes. The only process talking to
+ *      the board samples its input report at a fixed rate and writes the
+ *      ports, the ADC fields and a timestamp to a shared memory file.
+ *
+ *      The snapshot is guarded by a seqlock: the publisher makes the
+ *      sequence odd while it writes, readers copy the snapshot and retry
+ *      if the sequence was odd or changed meanwhile. Readers take no lock
+ *      and make no system call, and can not hold back the publisher. A
+ *      reader that keeps finding a copy in progress yields the CPU, and
+ *      gives up if the publisher never finishes it.
+ *
+ *      One publisher per board is enforced with an exclusive flock() on
+ *      the file, held while publishing and released by the kernel if the
+ *      publisher dies.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "dcihid.h"
+#include "dcipub.h"
+#include "dcirt.h"
+
+
+/*
+ * configuration
+ */
+#define DCIPUB_MAGIC            0x44434950      // "DCIP"
+#define DCIPUB_VERSION          1
+#define DCIPUB_SPINS            100             // Retries of a reader before it yields the CPU
+#define DCIPUB_RETRIES          10000           // Retries before a copy in progress is taken for a dead publisher
+
+#if defined(__i386__) || defined(__x86_64__)
+#define DCIPUB_RELAX()          __builtin_ia32_pause()
+#else
+#define DCIPUB_RELAX()
+#endif
+
+
+/*
+ * type declarations
+ */
+
+/* Layout of the shared memory file */
+struct dcipub_region {
+    u_int32_t                   magic;
+    u_int32_t                   version;
+    atomic_uint                 sequence;       // Odd while the publisher writes the snapshot
+    u_int32_t                   reserved;
+    struct dcipub_snapshot      snapshot;
+};
+
+struct dcipub {
+    struct dcipub_region        *region;
+    int                         fd;             // Holds the flock() of the publisher, -1 for readers
+
+    /* Publisher only */
+    u_int64_t                   dcihid_handle;
+    u_int32_t                   rate;
+    pthread_t                   thread;
+    atomic_int                  stop;
+    struct dcipub_snapshot      snapshot;       // Copy written to the region
+};
+typedef struct dcipub *dcipub_t;
+
+
+/*
+ * functions
+ */
+
+/*
+ * Copies the snapshot of the publisher to the region, under the seqlock
+ */
+static void
+dcipub_publish(dcipub_t pub) {
+    struct dcipub_region        *region = pub->region;
+    u_int32_t                   sequence = atomic_load_explicit(&region->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&region->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&region->snapshot, &pub->snapshot, sizeof(struct dcipub_snapshot));
+    atomic_store_explicit(&region->sequence, sequence + 2, memory_order_release);
+}
+
+static void
+dcipub_update(dcipub_t pub, const struct dcihid_input *input, const u_int64_t timestamp) {
+    pub->snapshot.timestamp = timestamp;
+    pub->snapshot.samples++;
+    pub->snapshot.card_type = input->card_type;
+    pub->snapshot.card_id = input->card_id;
+    memcpy(pub->snapshot.port, input->port, sizeof(pub->snapshot.port));
+    pub->snapshot.adc_index = input->adc_index;
+    pub->snapshot.adc_result = input->adc_result;
+}
+
+static void *
+dcipub_run(void *arg) {
+    dcipub_t                    pub = (dcipub_t)arg;
+    struct dcihid_input         input;
+    u_int64_t                   period = NSEC_PER_SEC / pub->rate;
+    u_int64_t                   next;
+
+    next = dcirt_now_ns() + period;
+
+    while (!atomic_load_explicit(&pub->stop, memory_order_relaxed)) {
+        dcirt_sleep_until(next);
+
+        if (dcihid_read_all(pub->dcihid_handle, &input) != 0) {
+            pub->snapshot.errors++;
+        } else {
+            dcipub_update(pub, &input, dcirt_now_ns());
+        }
+
+        pub->snapshot.missed += dcirt_next_period(&next, period);
+        dcipub_publish(pub);
+    }
+    return NULL;
+}
+
+/*
+ * Starts publishing the inputs of a board rate times per second, to path
+ * or to DCIPUB_FILE of its type and ID. Fails if another process already
+ * publishes them.
+ */
+u_int64_t
+dcipub_start(const u_int64_t dcihid_handle, const char *path, const u_int32_t rate) {
+    struct dcipub_region        *region;
+    struct dcihid_input         input;
+    u_int64_t                   timestamp;
+    char                        pub_name[PATH_MAX];
+    dcipub_t                    pub;
+    int                         fd;
+
+    if (rate == 0 || rate > NSEC_PER_SEC) {
+        fprintf(stderr, "dcipub: invalid rate\n");
+        return 0;
+    }
+
+    /* The first report names the board and fills the first snapshot */
+    if (dcihid_read_all(dcihid_handle, &input) != 0) return 0;
+    timestamp = dcirt_now_ns();
+    if (path == NULL) {
+        snprintf(pub_name, sizeof(pub_name), DCIPUB_FILE, input.card_type, input.card_id);
+        path = pub_name;
+    }
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+        perror("dcipub open");
+        return 0;
+    }
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        if (errno == EWOULDBLOCK) {
+            fprintf(stderr, "dcipub: the inputs of card type 0x%02X ID %u are already published to %s\n",
+                    input.card_type, input.card_id, path);
+        } else {
+            perror("dcipub flock");
+        }
+        close(fd);
+        return 0;
+    }
+    if (ftruncate(fd, sizeof(struct dcipub_region)) == -1) {
+        perror("dcipub ftruncate");
+        close(fd);
+        return 0;
+    }
+    region = (struct dcipub_region *)mmap(NULL, sizeof(struct dcipub_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        perror("dcipub mmap");
+        close(fd);
+        return 0;
+    }
+
+    pub = (dcipub_t)calloc(1, sizeof(struct dcipub));
+    if (pub == NULL) {
+        munmap(region, sizeof(struct dcipub_region));
+        close(fd);
+        return 0;
+    }
+    pub->region = region;
+    pub->fd = fd;
+    pub->dcihid_handle = dcihid_handle;
+    pub->rate = rate;
+    atomic_init(&pub->stop, 0);
+
+    /* Readers may be mapped already, the sequence only moves forward */
+    if (region->magic != DCIPUB_MAGIC || region->version != DCIPUB_VERSION) {
+        memset(region, 0, sizeof(struct dcipub_region));
+        region->magic = DCIPUB_MAGIC;
+        region->version = DCIPUB_VERSION;
+    } else if (atomic_load(&region->sequence) & 1) {
+        /* The last publisher died while writing */
+        atomic_fetch_add(&region->sequence, 1);
+    }
+    pub->snapshot.publisher = getpid();
+    pub->snapshot.rate = rate;
+    dcipub_update(pub, &input, timestamp);
+    dcipub_publish(pub);
+
+    if (pthread_create(&pub->thread, NULL, dcipub_run, pub) != 0) {
+        perror("dcipub: pthread_create");
+        pub->snapshot.publisher = 0;
+        dcipub_publish(pub);
+        munmap(region, sizeof(struct dcipub_region));
+        close(fd);
+        free(pub);
+        return 0;
+    }
+    return (u_int64_t)pub;
+}
+
+/*
+ * Stops publishing, readers keep the last snapshot with publisher 0
+ */
+int32_t
+dcipub_stop(const u_int64_t pub_handle) {
+    dcipub_t                    pub = (dcipub_t)pub_handle;
+
+    atomic_store(&pub->stop, 1);
+    pthread_join(pub->thread, NULL);
+    pub->snapshot.publisher = 0;
+    dcipub_publish(pub);
+
+    munmap(pub->region, sizeof(struct dcipub_region));
+    close(pub->fd);
+    free(pub);
+    return 0;
+}
+
+/*
+ * Maps the inputs published for a board, from path or DCIPUB_FILE of its
+ * type and ID. The board does not have to be published yet.
+ */
+u_int64_t
+dcipub_attach(const u_int card_type, const u_int card_id, const char *path) {
+    struct dcipub_region        *region;
+    char                        pub_name[PATH_MAX];
+    struct stat                 st;
+    dcipub_t                    pub;
+    int                         fd;
+
+    if (path == NULL) {
+        snprintf(pub_name, sizeof(pub_name), DCIPUB_FILE, card_type, card_id);
+        path = pub_name;
+    }
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(path);
+        return 0;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct dcipub_region)) {
+        fprintf(stderr, "dcipub: %s is not a published board\n", path);
+        close(fd);
+        return 0;
+    }
+    region = (struct dcipub_region *)mmap(NULL, sizeof(struct dcipub_region), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        perror("dcipub mmap");
+        return 0;
+    }
+    if (region->magic != DCIPUB_MAGIC || region->version != DCIPUB_VERSION) {
+        fprintf(stderr, "dcipub: %s is not a published board\n", path);
+        munmap(region, sizeof(struct dcipub_region));
+        return 0;
+    }
+
+    pub = (dcipub_t)calloc(1, sizeof(struct dcipub));
+    if (pub == NULL) {
+        munmap(region, sizeof(struct dcipub_region));
+        return 0;
+    }
+    pub->region = region;
+    pub->fd = -1;
+    return (u_int64_t)pub;
+}
+
+int32_t
+dcipub_detach(const u_int64_t pub_handle) {
+    dcipub_t                    pub = (dcipub_t)pub_handle;
+
+    munmap(pub->region, sizeof(struct dcipub_region));
+    free(pub);
+    return 0;
+}
+
+/*
+ * Copies the latest snapshot, without a lock or a system call. Works on
+ * the handles of the publisher and of the readers. Fails with EAGAIN if
+ * the publisher died or stalled in the middle of a copy.
+ */
+int32_t
+dcipub_read(const u_int64_t pub_handle, struct dcipub_snapshot *snapshot) {
+    struct dcipub_region        *region = ((dcipub_t)pub_handle)->region;
+    u_int32_t                   sequence, tries;
+
+    for (tries = 0;; tries++) {
+        sequence = atomic_load_explicit(&region->sequence, memory_order_acquire);
+        if (!(sequence & 1)) {
+            memcpy(snapshot, &region->snapshot, sizeof(struct dcipub_snapshot));
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&region->sequence, memory_order_relaxed) == sequence) break;
+        }
+
+        /* The publisher is in the middle of a copy, let it finish on a busy or single CPU */
+        if (tries == DCIPUB_RETRIES) {
+            errno = EAGAIN;
+            return -1;
+        }
+        if (tries < DCIPUB_SPINS) {
+            DCIPUB_RELAX();
+        } else {
+            sched_yield();
+        }
+    }
+
+    if (snapshot->samples == 0) {
+        errno = ENODATA;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef _DCIPUB_H_
+#define _DCIPUB_H_
+
+#include <sys/types.h>
+
+#include "dcihid.h"
+
+/*
+ * shared region of a board, one publisher and any number of readers
+ */
+#define DCIPUB_FILE         "/dev/shm/dcihid-%02X-%u.inputs"
+
+/*
+ * latest input report of a board, as returned by dcipub_read()
+ */
+struct dcipub_snapshot {
+    u_int64_t   timestamp;                  // CLOCK_MONOTONIC time of the input report, in ns
+    u_int64_t   samples;                    // Input reports published, 0 before the first
+    u_int64_t   missed;                     // Deadlines missed by the publisher, sample periods skipped
+    u_int64_t   errors;                     // Failed reads
+    u_int32_t   publisher;                  // Process ID of the publisher, 0 once it stopped
+    u_int32_t   rate;                       // Input reports per second
+    u_int8_t    card_type;
+    u_int8_t    card_id;
+    u_int8_t    port[DCIHID_INPUT_PORTS];   // Ports 0x00 to 0x03, same values as dcihid_read()
+    u_int8_t    adc_index;                  // ADC channel of the conversion
+    u_int16_t   adc_result;                 // ADC result (upper << 8 | lower)
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+u_int64_t   dcipub_start(const u_int64_t dcihid_handle, const char *path, const u_int32_t rate);
+int32_t     dcipub_stop(const u_int64_t pub_handle);
+u_int64_t   dcipub_attach(const u_int card_type, const u_int card_id, const char *path);
+int32_t     dcipub_detach(const u_int64_t pub_handle);
+int32_t     dcipub_read(const u_int64_t pub_handle, struct dcipub_snapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
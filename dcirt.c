@@ -0,0 +1,115 @@
+/*
+ * File:
+ *      dcirt.c
+ *
+ * Description:
+ *      Timing helpers of the threads running on absolute deadlines, and
+ *      the creation of their SCHED_FIFO threads.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "dcirt.h"
+
+
+/*
+ * functions
+ */
+
+u_int64_t
+dcirt_timespec_ns(const struct timespec *ts) {
+    return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+void
+dcirt_ns_timespec(const u_int64_t ns, struct timespec *ts) {
+    ts->tv_sec = ns / NSEC_PER_SEC;
+    ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+u_int64_t
+dcirt_now_ns(void) {
+    struct timespec             now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return dcirt_timespec_ns(&now);
+}
+
+/*
+ * Sleeps until the absolute deadline, no drift from the loop of the caller
+ */
+void
+dcirt_sleep_until(const u_int64_t deadline) {
+    struct timespec             wake;
+
+    dcirt_ns_timespec(deadline, &wake);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR);
+}
+
+/*
+ * Moves next to the following deadline of the schedule. The periods
+ * already over are skipped instead of run in a burst, returns their
+ * number for the missed statistics.
+ */
+u_int64_t
+dcirt_next_period(u_int64_t *next, const u_int64_t period) {
+    u_int64_t                   now = dcirt_now_ns(), late;
+
+    *next += period;
+    if (now <= *next) return 0;
+    late = (now - *next) / period + 1;
+    *next += late * period;
+    return late;
+}
+
+/*
+ * Creates a thread with the policy and affinity asked for. SCHED_FIFO
+ * needs CAP_SYS_NICE or an RLIMIT_RTPRIO, without them the thread falls
+ * back to the default policy. realtime tells which one it got.
+ */
+int32_t
+dcirt_spawn(const char *name, pthread_t *thread, void *(*run)(void *), void *arg,
+            const int priority, const int cpu, int *realtime) {
+    pthread_attr_t              attr;
+    struct sched_param          param;
+    cpu_set_t                   cpus;
+    int                         ret;
+
+    *realtime = 0;
+    pthread_attr_init(&attr);
+    if (cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+    if (priority > 0) {
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        *realtime = 1;
+    }
+
+    ret = pthread_create(thread, &attr, run, arg);
+    if (ret == EPERM && *realtime) {
+        fprintf(stderr, "%s: SCHED_FIFO: %s, using the default policy\n", name, strerror(ret));
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        *realtime = 0;
+        ret = pthread_create(thread, &attr, run, arg);
+    }
+    if (ret != 0) fprintf(stderr, "%s: pthread_create: %s\n", name, strerror(ret));
+
+    pthread_attr_destroy(&attr);
+    return ret ? -1 : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _DCIRT_H_
+#define _DCIRT_H_
+
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define NSEC_PER_SEC            1000000000ULL
+#define NSEC_PER_MSEC           1000000ULL
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * CLOCK_MONOTONIC time as ns
+ */
+u_int64_t dcirt_timespec_ns(const struct timespec *ts);
+void dcirt_ns_timespec(const u_int64_t ns, struct timespec *ts);
+u_int64_t dcirt_now_ns(void);
+
+/*
+ * periodic schedules on absolute deadlines
+ */
+void dcirt_sleep_until(const u_int64_t deadline);
+u_int64_t dcirt_next_period(u_int64_t *next, const u_int64_t period);
+
+/*
+ * threads with SCHED_FIFO priority and CPU affinity, priority 0 and cpu -1 for neither
+ */
+int32_t dcirt_spawn(const char *name, pthread_t *thread, void *(*run)(void *), void *arg,
+                    const int priority, const int cpu, int *realtime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,599 @@
+/*
+ * File:
+ *      dcirule.c
+ *
+ * Description:
+ *      Input to output interlocks for DCI USB HID devices from
+ *      Decision-Computer. Declarative rules over the inputs of one board
+ *      drive an output bit of the same or another board, and the reaction
+ *      latency of every rule is measured.
+ *
+ *      Rules are compiled into a flat table grouped by input board, every
+ *      entry is a mask and a match over the 32 bits of ports 0x00 to 0x03.
+ *      A dedicated thread reads the input report of every input board,
+ *      back to back or at a given rate, or takes the changes delivered by
+ *      dcihid_watch_run(), and only tests the rules looking at bits that
+ *      changed. Rules drive their output on the evaluation they start to
+ *      hold, the writes of rules firing together are merged per port.
+ *
+ *      Rules are loaded from a script, one rule per line, '#' starts a
+ *      comment. Boards are <type>:<id>, bits are channel names of the card
+ *      as IN03 or <port>.<bit>, levels are low/high, off/on or 0/1:
+ *          <board> <bit> <level> [<bit> <level> ...] -> <board> <bit> <level>
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dciboard.h"
+#include "dcirule.h"
+#include "dcirt.h"
+
+
+/*
+ * configuration
+ */
+#define DCIRULE_SLICE_MS        100     // Longest wait for events before checking for dcirule_stop()
+#define DCIRULE_LOAD_CHUNK      64      // Rules allocated at once by dcirule_load()
+#define DCIRULE_TOKENS_MAX      64
+#define DCIRULE_LATENCY_MAX     10000   // Latency histogram range, in us
+
+
+/*
+ * type declarations
+ */
+struct dcirule_board {
+    u_int64_t                   handle;
+    u_int8_t                    card_type;
+    u_int8_t                    card_id;
+    u_int32_t                   inputs;         // Last ports 0x00 to 0x03, port 0x00 in the low byte
+    u_int32_t                   watched;        // Bits tested by the rules of the board
+    u_int32_t                   first;          // Rules of the board in the table
+    u_int32_t                   count;
+};
+
+/* Entry of the evaluation table */
+struct dcirule_entry {
+    u_int32_t                   mask;
+    u_int32_t                   match;
+    u_int8_t                    out_board;
+    u_int8_t                    out_port;
+    u_int8_t                    out_mask;
+    u_int8_t                    out_value;
+    u_int32_t                   active;         // The rule held on the last evaluation
+    u_int32_t                   rule;           // Index in the configuration, for the results
+};
+
+/* Write merged from the rules firing together */
+struct dcirule_write {
+    u_int8_t                    board;
+    u_int8_t                    port;
+    u_int8_t                    mask;
+    u_int8_t                    value;
+    int32_t                     status;
+};
+
+/* Rule that started to hold, and the write carrying its output */
+struct dcirule_fired {
+    u_int32_t                   entry;
+    u_int32_t                   write;
+};
+
+struct dcirule_engine {
+    struct dcirule_config       config;
+    struct dcirule_board        boards[DCIRULE_BOARDS_MAX];
+    u_int32_t                   num_boards;
+    struct dcirule_entry        *table;
+    struct dcirule_result       *results;
+    u_int32_t                   (*latency)[DCIRULE_LATENCY_MAX + 1];    // Latency histogram of every rule, 1 us buckets
+    u_int64_t                   watch;
+    pthread_t                   thread;
+    int                         realtime;
+    atomic_int                  stop;
+
+    /* Scratch of dcirule_evaluate(), sized for every rule firing at once */
+    struct dcirule_write        *writes;
+    struct dcirule_fired        *fired;
+
+    /* Engine statistics */
+    u_int64_t                   reads;
+    u_int64_t                   errors;
+    u_int64_t                   missed;
+};
+typedef struct dcirule_engine *dcirule_engine_t;
+
+
+/*
+ * functions
+ */
+
+/*
+ * Same buckets as the statistics of dcihid.c, for dcihid_stat_percentile(),
+ * and 1 us buckets in hist for the percentiles of the results
+ */
+static void
+dcirule_stat_add(struct dcihid_stat *stat, u_int32_t *hist, const u_int64_t ns) {
+    int                         bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    u_int64_t                   us = ns / 1000;
+
+    hist[us < DCIRULE_LATENCY_MAX ? us : DCIRULE_LATENCY_MAX]++;
+    stat->count++;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns) stat->max_ns = ns;
+    stat->hist[bucket < DCIHID_STAT_BUCKETS ? bucket : DCIHID_STAT_BUCKETS - 1]++;
+}
+
+static u_int32_t
+dcirule_word(const u_int8_t *port) {
+    return port[0] | port[1] << 8 | port[2] << 16 | (u_int32_t)port[3] << 24;
+}
+
+/*
+ * Parses <type>:<id>
+ */
+static int32_t
+dcirule_parse_board(const char *token, u_int8_t *card_type, u_int8_t *card_id) {
+    char                        *end;
+    u_long                      type, id;
+
+    type = strtoul(token, &end, 0);
+    if (*end != ':' || !dcihid_assert_card_type(type)) return -1;
+    id = strtoul(end + 1, &end, 0);
+    if (*end != '\0' || !dcihid_assert_card_id(id)) return -1;
+    *card_type = type;
+    *card_id = id;
+    return 0;
+}
+
+/*
+ * Parses a channel name of the card or <port>.<bit>
+ */
+static int32_t
+dcirule_parse_bit(const u_int card_type, const char *token, u_int8_t *addr, u_int8_t *bit) {
+    const struct dciboard_port  *port;
+    u_int                       channel, number;
+    char                        *end;
+    u_long                      value;
+
+    if (dciboard_parse_channel(token, &channel, &number) == 0) {
+        return dciboard_channel(card_type, channel, number, addr, bit);
+    }
+    value = strtoul(token, &end, 0);
+    if (*end != '.' || (port = dciboard_port(card_type, value)) == NULL) return -1;
+    *addr = value;
+    value = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || value >= port->width) return -1;
+    *bit = value;
+    return 0;
+}
+
+static int
+dcirule_parse_level(const char *token) {
+    if (strcasecmp(token, "high") == 0 || strcasecmp(token, "on") == 0 || strcmp(token, "1") == 0) return 1;
+    if (strcasecmp(token, "low") == 0 || strcasecmp(token, "off") == 0 || strcmp(token, "0") == 0) return 0;
+    return -1;
+}
+
+/*
+ * Parses one rule, the line is split in place
+ */
+static int32_t
+dcirule_parse(char *line, struct dcirule *rule) {
+    char                        *tokens[DCIRULE_TOKENS_MAX], *save = NULL, *token;
+    u_int32_t                   num = 0, i, bitmask;
+    u_int8_t                    addr, bit;
+    int                         level;
+
+    for (token = strtok_r(line, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save)) {
+        if (num == DCIRULE_TOKENS_MAX) return -1;
+        tokens[num++] = token;
+    }
+
+    /* <board> followed by (<bit> <level>) pairs up to the arrow */
+    if (num < 7 || dcirule_parse_board(tokens[0], &rule->in_type, &rule->in_id) != 0) return -1;
+    for (i = 1; i + 1 < num && strcmp(tokens[i], "->") != 0; i += 2) {
+        if (dcirule_parse_bit(rule->in_type, tokens[i], &addr, &bit) != 0 || addr >= DCIHID_INPUT_PORTS) return -1;
+        if ((level = dcirule_parse_level(tokens[i + 1])) < 0) return -1;
+        bitmask = 1U << (addr * 8 + bit);
+        if (rule->mask & bitmask) return -1;
+        rule->mask |= bitmask;
+        if (level) rule->match |= bitmask;
+    }
+    if (rule->mask == 0 || i + 4 != num || strcmp(tokens[i], "->") != 0) return -1;
+
+    if (dcirule_parse_board(tokens[i + 1], &rule->out_type, &rule->out_id) != 0) return -1;
+    if (dcirule_parse_bit(rule->out_type, tokens[i + 2], &addr, &bit) != 0 ||
+        !(dciboard_access(rule->out_type, addr) & DCIBOARD_WRITE)) return -1;
+    if ((level = dcirule_parse_level(tokens[i + 3])) < 0) return -1;
+    rule->out_port = addr;
+    rule->out_mask = 1 << bit;
+    rule->out_value = level ? rule->out_mask : 0;
+    return 0;
+}
+
+/*
+ * Loads the rules of a script, the array is freed by the caller
+ */
+struct dcirule *
+dcirule_load(FILE *script, u_int32_t *count) {
+    struct dcirule              *rules = NULL, *grown;
+    char                        line[256], *hash;
+    u_int32_t                   size = 0, num = 0, lineno = 0;
+    size_t                      len;
+
+    while (fgets(line, sizeof(line), script)) {
+        lineno++;
+        if ((hash = strchr(line, '#'))) *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        if (num == size) {
+            grown = (struct dcirule *)realloc(rules, sizeof(struct dcirule) * (size + DCIRULE_LOAD_CHUNK));
+            if (grown == NULL) goto error;
+            rules = grown;
+            size += DCIRULE_LOAD_CHUNK;
+        }
+        memset(&rules[num], 0, sizeof(struct dcirule));
+        rules[num].line = lineno;
+        line[strcspn(line, "\r\n")] = '\0';
+        len = strspn(line, " \t");
+        snprintf(rules[num].text, sizeof(rules[num].text), "%s", line + len);
+        if (dcirule_parse(line, &rules[num]) != 0) goto error;
+        num++;
+    }
+
+    if (num == 0) {
+        fprintf(stderr, "dcirule: no rules\n");
+        free(rules);
+        return NULL;
+    }
+    *count = num;
+    return rules;
+
+error:
+    fprintf(stderr, "dcirule: invalid rule on line %u\n", lineno);
+    free(rules);
+    return NULL;
+}
+
+/*
+ * Index of a board in the engine, opened on first use
+ */
+static int
+dcirule_board(dcirule_engine_t engine, const u_int8_t card_type, const u_int8_t card_id) {
+    struct dcirule_board        *board;
+    char                        devname[64] = "";
+    u_int32_t                   i;
+
+    for (i = 0; i < engine->num_boards; i++) {
+        if (engine->boards[i].card_type == card_type && engine->boards[i].card_id == card_id) return i;
+    }
+    if (engine->num_boards == DCIRULE_BOARDS_MAX) {
+        fprintf(stderr, "dcirule: more than %d boards\n", DCIRULE_BOARDS_MAX);
+        return -1;
+    }
+    if (engine->config.transport != DCIHID_TRANSPORT_SIM && dcihid_lookup(card_type, card_id, devname, sizeof(devname)) != 0) {
+        fprintf(stderr, "dcirule: card of type 0x%02X and ID %u is not plugged\n", card_type, card_id);
+        return -1;
+    }
+
+    board = &engine->boards[engine->num_boards];
+    if ((board->handle = dcihid_open_transport(devname, card_type, card_id, engine->config.transport)) == 0) {
+        fprintf(stderr, "dcirule: could not open card of type 0x%02X and ID %u\n", card_type, card_id);
+        return -1;
+    }
+    board->card_type = card_type;
+    board->card_id = card_id;
+    return engine->num_boards++;
+}
+
+/*
+ * Tests the rules of a board against a new input word, and writes the
+ * outputs of the rules that started to hold. seen_ns is when the change
+ * was seen, 0 to not record the latency.
+ */
+static void
+dcirule_evaluate(dcirule_engine_t engine, struct dcirule_board *board, const u_int32_t inputs, const u_int64_t seen_ns) {
+    struct dcirule_entry        *entry;
+    struct dcirule_write        *write;
+    struct dcirule_result       *result;
+    u_int32_t                   changed = (inputs ^ board->inputs) & board->watched;
+    u_int32_t                   num_fired = 0, num_writes = 0, active, i, w;
+    u_int64_t                   done_ns;
+
+    board->inputs = inputs;
+    if (changed == 0 && seen_ns) return;
+
+    for (i = board->first; i < board->first + board->count; i++) {
+        entry = &engine->table[i];
+        if (!(changed & entry->mask) && seen_ns) continue;
+        active = (inputs & entry->mask) == entry->match;
+        if (active == entry->active) continue;
+        entry->active = active;
+        if (!active) continue;
+
+        /* Merge with a write to the same port, the later rule wins on shared bits */
+        for (w = 0; w < num_writes; w++) {
+            if (engine->writes[w].board == entry->out_board && engine->writes[w].port == entry->out_port) break;
+        }
+        write = &engine->writes[w];
+        if (w == num_writes) {
+            write->board = entry->out_board;
+            write->port = entry->out_port;
+            write->mask = 0;
+            write->value = 0;
+            num_writes++;
+        }
+        write->mask |= entry->out_mask;
+        write->value = (write->value & ~entry->out_mask) | entry->out_value;
+        engine->fired[num_fired].entry = i;
+        engine->fired[num_fired].write = w;
+        num_fired++;
+    }
+    if (num_fired == 0) return;
+
+    for (w = 0; w < num_writes; w++) {
+        write = &engine->writes[w];
+        write->status = dcihid_write_masked(engine->boards[write->board].handle, write->port, write->mask, write->value, NULL);
+    }
+    done_ns = dcirt_now_ns();
+
+    for (i = 0; i < num_fired; i++) {
+        entry = &engine->table[engine->fired[i].entry];
+        result = &engine->results[entry->rule];
+        result->firings++;
+        if (engine->writes[engine->fired[i].write].status != 0) {
+            result->errors++;
+            result->latency.errors++;
+            /* Try again on the next change */
+            entry->active = 0;
+        } else if (seen_ns) {
+            dcirule_stat_add(&result->latency, engine->latency[entry->rule], done_ns - seen_ns);
+        }
+    }
+}
+
+static void
+dcirule_on_event(const struct dcihid_event *event, void *arg) {
+    dcirule_engine_t            engine = (dcirule_engine_t)arg;
+    struct dcirule_board        *board;
+    u_int32_t                   i, shift = event->addr * 8;
+
+    engine->reads++;
+    for (i = 0; i < engine->num_boards; i++) {
+        board = &engine->boards[i];
+        if (board->handle != event->dcihid_handle) continue;
+        dcirule_evaluate(engine, board, (board->inputs & ~(0xFFU << shift)) | (u_int32_t)event->value << shift,
+                         dcirt_timespec_ns(&event->timestamp));
+        return;
+    }
+}
+
+/*
+ * Reads every input board once
+ */
+static void
+dcirule_poll(dcirule_engine_t engine) {
+    struct dcirule_board        *board;
+    struct dcihid_input         input;
+    u_int64_t                   seen_ns;
+    u_int32_t                   i;
+
+    for (i = 0; i < engine->num_boards; i++) {
+        board = &engine->boards[i];
+        if (board->count == 0) continue;
+
+        /* The change is seen by the report requested from here on */
+        seen_ns = dcirt_now_ns();
+        if (dcihid_read_all(board->handle, &input) != 0) {
+            engine->errors++;
+            continue;
+        }
+        engine->reads++;
+        dcirule_evaluate(engine, board, dcirule_word(input.port), seen_ns);
+    }
+}
+
+static void *
+dcirule_run(void *arg) {
+    dcirule_engine_t            engine = (dcirule_engine_t)arg;
+    struct timespec             slice;
+    u_int64_t                   period = engine->config.rate ? NSEC_PER_SEC / engine->config.rate : 0;
+    u_int64_t                   next;
+
+    if (engine->config.events) {
+        dcirt_ns_timespec(DCIRULE_SLICE_MS * NSEC_PER_MSEC, &slice);
+        while (!atomic_load_explicit(&engine->stop, memory_order_relaxed)) {
+            if (dcihid_watch_run(engine->watch, DCIRULE_SLICE_MS, dcirule_on_event, engine) < 0) {
+                /* Do not spin on a board that went away */
+                engine->errors++;
+                nanosleep(&slice, NULL);
+            }
+        }
+        return NULL;
+    }
+
+    next = dcirt_now_ns();
+    while (!atomic_load_explicit(&engine->stop, memory_order_relaxed)) {
+        dcirule_poll(engine);
+        if (period == 0) continue;
+
+        engine->missed += dcirt_next_period(&next, period);
+        dcirt_sleep_until(next);
+    }
+    return NULL;
+}
+
+static void
+dcirule_free(dcirule_engine_t engine) {
+    u_int32_t                   i;
+
+    if (engine->watch) dcihid_watch_destroy(engine->watch);
+    for (i = 0; i < engine->num_boards; i++) {
+        dcihid_close(engine->boards[i].handle);
+    }
+    free(engine->table);
+    free(engine->results);
+    free(engine->latency);
+    free(engine->writes);
+    free(engine->fired);
+    free(engine);
+}
+
+/*
+ * Builds the evaluation table, grouped by input board in the order of the rules
+ */
+static int32_t
+dcirule_compile(dcirule_engine_t engine) {
+    const struct dcirule        *rule;
+    struct dcirule_entry        *entry;
+    int                         in[DCIRULE_BOARDS_MAX], out;
+    u_int32_t                   num = 0, b, i;
+
+    for (i = 0; i < engine->config.count; i++) {
+        rule = &engine->config.rules[i];
+        if (dcirule_board(engine, rule->in_type, rule->in_id) < 0 || dcirule_board(engine, rule->out_type, rule->out_id) < 0) {
+            return -1;
+        }
+    }
+
+    for (b = 0; b < engine->num_boards; b++) {
+        engine->boards[b].first = num;
+        for (i = 0; i < engine->config.count; i++) {
+            rule = &engine->config.rules[i];
+            if (dcirule_board(engine, rule->in_type, rule->in_id) != (int)b) continue;
+            out = dcirule_board(engine, rule->out_type, rule->out_id);
+            entry = &engine->table[num++];
+            entry->mask = rule->mask;
+            entry->match = rule->match;
+            entry->out_board = out;
+            entry->out_port = rule->out_port;
+            entry->out_mask = rule->out_mask;
+            entry->out_value = rule->out_value;
+            entry->rule = i;
+            engine->boards[b].watched |= rule->mask;
+        }
+        engine->boards[b].count = num - engine->boards[b].first;
+        in[b] = engine->boards[b].count > 0;
+    }
+
+    /* Read the output ports back now, so a reaction is a single write */
+    for (i = 0; i < num; i++) {
+        entry = &engine->table[i];
+        if (dcihid_resync(engine->boards[entry->out_board].handle, entry->out_port) != 0) return -1;
+    }
+
+    if (engine->config.events) {
+        if ((engine->watch = dcihid_watch_create()) == 0) return -1;
+        for (b = 0; b < engine->num_boards; b++) {
+            if (in[b] && dcihid_watch_add(engine->watch, engine->boards[b].handle) != 0) return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Opens the boards of the rules and starts evaluating them. Rules that
+ * hold from the start drive their outputs before this returns.
+ */
+u_int64_t
+dcirule_start(const struct dcirule_config *config) {
+    dcirule_engine_t            engine;
+    struct dcihid_input         input;
+    struct dcirule_board        *board;
+    u_int32_t                   i;
+
+    if (config->rules == NULL || config->count == 0) {
+        fprintf(stderr, "dcirule: no rules\n");
+        return 0;
+    }
+
+    engine = (dcirule_engine_t)calloc(1, sizeof(struct dcirule_engine));
+    if (engine == NULL) return 0;
+    engine->config = *config;
+    atomic_init(&engine->stop, 0);
+    engine->table = (struct dcirule_entry *)calloc(config->count, sizeof(struct dcirule_entry));
+    engine->results = (struct dcirule_result *)calloc(config->count, sizeof(struct dcirule_result));
+    engine->latency = calloc(config->count, sizeof(*engine->latency));
+    engine->writes = (struct dcirule_write *)calloc(config->count, sizeof(struct dcirule_write));
+    engine->fired = (struct dcirule_fired *)calloc(config->count, sizeof(struct dcirule_fired));
+    if (engine->table == NULL || engine->results == NULL || engine->latency == NULL || engine->writes == NULL || engine->fired == NULL ||
+        dcirule_compile(engine) != 0) {
+        dcirule_free(engine);
+        return 0;
+    }
+
+    /* First evaluation of every rule, from the current inputs */
+    for (i = 0; i < engine->num_boards; i++) {
+        board = &engine->boards[i];
+        if (board->count == 0) continue;
+        if (dcihid_read_all(board->handle, &input) != 0) {
+            dcirule_free(engine);
+            return 0;
+        }
+        dcirule_evaluate(engine, board, dcirule_word(input.port), 0);
+    }
+
+    if (dcirt_spawn("dcirule", &engine->thread, dcirule_run, engine,
+                    engine->config.priority, engine->config.cpu, &engine->realtime) != 0) {
+        dcirule_free(engine);
+        return 0;
+    }
+    return (u_int64_t)engine;
+}
+
+/*
+ * Latency percentile of a rule from its histogram, in us
+ */
+static u_int32_t
+dcirule_percentile(const u_int32_t *hist, const u_int64_t count, const double fraction) {
+    u_int64_t                   seen = 0, rank = (u_int64_t)(count * fraction);
+    u_int32_t                   i;
+
+    for (i = 0; i <= DCIRULE_LATENCY_MAX; i++) {
+        seen += hist[i];
+        if (seen > rank) return i;
+    }
+    return DCIRULE_LATENCY_MAX;
+}
+
+/*
+ * Stops the engine, closes the boards and returns the statistics. results
+ * gets one entry per rule, in the order of the configuration.
+ */
+int32_t
+dcirule_stop(const u_int64_t rule_handle, struct dcirule_stats *stats, struct dcirule_result *results) {
+    dcirule_engine_t            engine = (dcirule_engine_t)rule_handle;
+    struct dcirule_result       *result;
+    u_int32_t                   i;
+
+    atomic_store(&engine->stop, 1);
+    pthread_join(engine->thread, NULL);
+
+    if (stats) {
+        stats->reads = engine->reads;
+        stats->errors = engine->errors;
+        stats->missed = engine->missed;
+        stats->boards = engine->num_boards;
+        stats->realtime = engine->realtime;
+    }
+    for (i = 0; i < engine->config.count; i++) {
+        result = &engine->results[i];
+        if (result->latency.count == 0) continue;
+        result->latency_p50 = dcirule_percentile(engine->latency[i], result->latency.count, 0.50);
+        result->latency_p99 = dcirule_percentile(engine->latency[i], result->latency.count, 0.99);
+    }
+    if (results) memcpy(results, engine->results, sizeof(struct dcirule_result) * engine->config.count);
+    dcirule_free(engine);
+    return 0;
+}
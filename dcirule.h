@@ -0,0 +1,81 @@
+#ifndef _DCIRULE_H_
+#define _DCIRULE_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+
+#define DCIRULE_BOARDS_MAX  16                      // Boards named by the rules, inputs and outputs
+#define DCIRULE_TEXT_MAX    96
+
+/*
+ * one interlock: when every condition holds on the input board, the
+ * output bits are driven to their value
+ */
+struct dcirule {
+    u_int8_t    in_type;                    // Input board
+    u_int8_t    in_id;
+    u_int8_t    out_type;                   // Output board, may be the input board
+    u_int8_t    out_id;
+    u_int32_t   mask;                       // Bits of ports 0x00 to 0x03 tested, port 0x00 in the low byte
+    u_int32_t   match;                      // Their values while the rule holds, same as dcihid_read()
+    u_int8_t    out_port;
+    u_int8_t    out_mask;                   // Bits written
+    u_int8_t    out_value;                  // Their value, same as dcihid_write()
+    u_int8_t    reserved;
+    u_int32_t   line;                       // Line of the script
+    char        text[DCIRULE_TEXT_MAX];     // The rule as written, to name it in reports
+};
+
+/*
+ * engine configuration
+ */
+struct dcirule_config {
+    const struct dcirule *rules;            // Later rules win when two drive the same bit at once
+    u_int32_t   count;
+    int         transport;                  // DCIHID_TRANSPORT_*, boards are looked up by type and ID
+    u_int32_t   rate;                       // Input reports per second and board, 0 to read back to back
+    int         events;                     // Evaluate on dcihid_watch_run() events instead of reading
+    int         priority;                   // SCHED_FIFO priority of the thread, 0 for the default policy
+    int         cpu;                        // CPU the thread is pinned to, -1 for any
+};
+
+/*
+ * reaction of one rule, from the input report or event that showed the
+ * change to the return of the output write
+ */
+struct dcirule_result {
+    u_int64_t   firings;                    // Times the rule started to hold, the first evaluation included
+    u_int64_t   errors;                     // Failed output writes
+    struct dcihid_stat latency;             // Changes seen while running, in ns
+    u_int32_t   latency_p50;                // Of the changes seen, in us
+    u_int32_t   latency_p99;
+};
+
+/*
+ * engine results, as returned by dcirule_stop()
+ */
+struct dcirule_stats {
+    u_int64_t   reads;                      // Input reports read, or events received
+    u_int64_t   errors;                     // Failed reads
+    u_int64_t   missed;                     // Periods skipped at a given rate
+    u_int32_t   boards;                     // Boards opened
+    int         realtime;                   // Thread ran with SCHED_FIFO
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+struct dcirule *dcirule_load(FILE *script, u_int32_t *count);
+u_int64_t   dcirule_start(const struct dcirule_config *config);
+int32_t     dcirule_stop(const u_int64_t rule_handle, struct dcirule_stats *stats, struct dcirule_result *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * File:
+ *      dcisample.c
+ *
+ * Description:
+ *      Input sampler for DCI USB HID devices from Decision-Computer.
+ *      A producer thread reads the input report at a fixed rate on
+ *      absolute deadlines and hands timestamped samples through a
+ *      single-producer/single-consumer ring to a consumer thread that
+ *      streams them out.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dcisample.h"
+#include "dcirt.h"
+
+
+/*
+ * configuration
+ */
+#define DCISAMPLE_RING_SIZE     4096
+#define DCISAMPLE_BATCH         256
+#define DCISAMPLE_JITTER_MAX    10000   // Jitter histogram range, in us
+#define DCISAMPLE_IDLE_NS       1000000 // Consumer sleep when the ring is empty
+
+
+
+/*
+ * type declarations
+ */
+struct dcisample_sampler {
+    u_int64_t                   dcihid_handle;
+    struct dcisample_config     config;
+    pthread_t                   producer;
+    pthread_t                   consumer;
+
+    /* Ring, head only written by the producer and tail only by the consumer */
+    struct dcisample            *ring;
+    u_int32_t                   mask;
+    _Alignas(64) atomic_uint_fast64_t head;
+    _Alignas(64) atomic_uint_fast64_t tail;
+    _Alignas(64) atomic_int     stop;
+    atomic_int                  done;
+
+    /* Producer statistics */
+    u_int64_t                   samples;
+    u_int64_t                   dropped;
+    u_int64_t                   missed;
+    u_int64_t                   errors;
+    u_int64_t                   start_ns;
+    u_int64_t                   end_ns;
+    u_int32_t                   jitter[DCISAMPLE_JITTER_MAX + 1];
+
+    /* Consumer statistics */
+    u_int64_t                   written;
+};
+typedef struct dcisample_sampler *dcisample_sampler_t;
+
+/* Samples taken on the calling thread, on one schedule across calls */
+struct dcisample_acquirer {
+    u_int64_t                   dcihid_handle;
+    u_int64_t                   period;
+    u_int64_t                   next;                           // Deadline of the next sample
+    u_int64_t                   samples;
+    u_int64_t                   missed;
+    u_int64_t                   errors;
+    u_int64_t                   start_ns;
+    u_int32_t                   jitter[DCISAMPLE_JITTER_MAX + 1];
+};
+typedef struct dcisample_acquirer *dcisample_acquirer_t;
+
+
+/*
+ * functions
+ */
+
+static void *
+dcisample_produce(void *arg) {
+    dcisample_sampler_t         sampler = (dcisample_sampler_t)arg;
+    struct dcihid_input         input;
+    struct dcisample            *sample;
+    u_int64_t                   period = NSEC_PER_SEC / sampler->config.rate;
+    u_int64_t                   next, now_ns, head, late;
+
+    next = sampler->start_ns = dcirt_now_ns();
+
+    while (!atomic_load_explicit(&sampler->stop, memory_order_relaxed)) {
+        if (sampler->config.count && sampler->samples + sampler->errors >= sampler->config.count) break;
+
+        dcirt_sleep_until(next);
+
+        now_ns = dcirt_now_ns();
+        late = (now_ns - next) / 1000;
+        sampler->jitter[late < DCISAMPLE_JITTER_MAX ? late : DCISAMPLE_JITTER_MAX]++;
+
+        if (dcihid_read_all(sampler->dcihid_handle, &input) != 0) {
+            sampler->errors++;
+        } else {
+            sampler->samples++;
+            head = atomic_load_explicit(&sampler->head, memory_order_relaxed);
+            if (head - atomic_load_explicit(&sampler->tail, memory_order_acquire) > sampler->mask) {
+                sampler->dropped++;
+            } else {
+                sample = &sampler->ring[head & sampler->mask];
+                sample->timestamp = now_ns;
+                memcpy(sample->port, input.port, sizeof(sample->port));
+                sample->adc_result = input.adc_result;
+                sample->adc_index = input.adc_index;
+                sample->reserved = 0;
+                atomic_store_explicit(&sampler->head, head + 1, memory_order_release);
+            }
+        }
+
+        sampler->missed += dcirt_next_period(&next, period);
+    }
+
+    sampler->end_ns = dcirt_now_ns();
+    atomic_store_explicit(&sampler->done, 1, memory_order_release);
+    return NULL;
+}
+
+static int
+dcisample_write(const int fd, const void *buf, size_t len) {
+    const char *ptr = (const char *)buf;
+    ssize_t ret;
+
+    while (len) {
+        if ((ret = write(fd, ptr, len)) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        ptr += ret;
+        len -= ret;
+    }
+    return 0;
+}
+
+static void *
+dcisample_consume(void *arg) {
+    dcisample_sampler_t         sampler = (dcisample_sampler_t)arg;
+    struct dcisample            batch[DCISAMPLE_BATCH];
+    struct timespec             idle = { 0, DCISAMPLE_IDLE_NS };
+    u_int64_t                   head, tail;
+    u_int32_t                   count;
+    int                         done, failed = 0;
+
+    for (;;) {
+        done = atomic_load_explicit(&sampler->done, memory_order_acquire);
+        head = atomic_load_explicit(&sampler->head, memory_order_acquire);
+        tail = atomic_load_explicit(&sampler->tail, memory_order_relaxed);
+        if (head == tail) {
+            if (done) break;
+            nanosleep(&idle, NULL);
+            continue;
+        }
+
+        /* Copy out a batch so the slots are given back before the write */
+        for (count = 0; tail != head && count < DCISAMPLE_BATCH; tail++, count++) {
+            batch[count] = sampler->ring[tail & sampler->mask];
+        }
+        atomic_store_explicit(&sampler->tail, tail, memory_order_release);
+
+        if (!failed && dcisample_write(sampler->config.out_fd, batch, count * sizeof(struct dcisample)) != 0) {
+            perror("dcisample write");
+            failed = 1;
+        }
+        if (!failed) sampler->written += count;
+    }
+    return NULL;
+}
+
+u_int64_t
+dcisample_start(const u_int64_t dcihid_handle, const struct dcisample_config *config) {
+    dcisample_sampler_t         sampler;
+    u_int32_t                   ring_size = config->ring_size ? config->ring_size : DCISAMPLE_RING_SIZE;
+    char                        magic[8] = DCISAMPLE_MAGIC;
+
+    if (config->rate == 0 || config->rate > NSEC_PER_SEC || (ring_size & (ring_size - 1))) {
+        fprintf(stderr, "dcisample: invalid rate or ring size\n");
+        return 0;
+    }
+
+    sampler = (dcisample_sampler_t)calloc(1, sizeof(struct dcisample_sampler));
+    if (sampler == NULL) return 0;
+    sampler->ring = (struct dcisample *)calloc(ring_size, sizeof(struct dcisample));
+    if (sampler->ring == NULL) {
+        free(sampler);
+        return 0;
+    }
+    sampler->dcihid_handle = dcihid_handle;
+    memcpy(&sampler->config, config, sizeof(struct dcisample_config));
+    sampler->mask = ring_size - 1;
+    atomic_init(&sampler->head, 0);
+    atomic_init(&sampler->tail, 0);
+    atomic_init(&sampler->stop, 0);
+    atomic_init(&sampler->done, 0);
+
+    if (dcisample_write(config->out_fd, magic, sizeof(magic)) != 0) {
+        perror("dcisample write");
+        goto error;
+    }
+    if (pthread_create(&sampler->consumer, NULL, dcisample_consume, sampler) != 0) goto error;
+    if (pthread_create(&sampler->producer, NULL, dcisample_produce, sampler) != 0) {
+        atomic_store(&sampler->done, 1);
+        pthread_join(sampler->consumer, NULL);
+        goto error;
+    }
+    return (u_int64_t)sampler;
+
+error:
+    free(sampler->ring);
+    free(sampler);
+    return 0;
+}
+
+int32_t
+dcisample_done(const u_int64_t sampler_handle) {
+    dcisample_sampler_t         sampler = (dcisample_sampler_t)sampler_handle;
+
+    return atomic_load_explicit(&sampler->done, memory_order_acquire);
+}
+
+/*
+ * Jitter percentile from the histogram, in us
+ */
+static u_int32_t
+dcisample_percentile(const u_int32_t *jitter, const u_int64_t total, const double fraction) {
+    u_int64_t                   seen = 0, rank = (u_int64_t)(total * fraction);
+    u_int32_t                   i;
+
+    for (i = 0; i <= DCISAMPLE_JITTER_MAX; i++) {
+        seen += jitter[i];
+        if (seen > rank) return i;
+    }
+    return DCISAMPLE_JITTER_MAX;
+}
+
+static void
+dcisample_jitter(const u_int32_t *jitter, const u_int64_t total, struct dcisample_stats *stats) {
+    int32_t                     i;
+
+    if (total == 0) return;
+    stats->jitter_p50 = dcisample_percentile(jitter, total, 0.50);
+    stats->jitter_p99 = dcisample_percentile(jitter, total, 0.99);
+    for (i = DCISAMPLE_JITTER_MAX; i > 0 && !jitter[i]; i--);
+    stats->jitter_max = i;
+}
+
+int32_t
+dcisample_stop(const u_int64_t sampler_handle, struct dcisample_stats *stats) {
+    dcisample_sampler_t         sampler = (dcisample_sampler_t)sampler_handle;
+
+    atomic_store(&sampler->stop, 1);
+    pthread_join(sampler->producer, NULL);
+    pthread_join(sampler->consumer, NULL);
+
+    if (stats) {
+        memset(stats, 0, sizeof(struct dcisample_stats));
+        stats->samples = sampler->samples;
+        stats->written = sampler->written;
+        stats->dropped = sampler->dropped;
+        stats->missed = sampler->missed;
+        stats->errors = sampler->errors;
+        if (sampler->end_ns > sampler->start_ns) {
+            stats->rate = (double)sampler->samples * NSEC_PER_SEC / (sampler->end_ns - sampler->start_ns);
+        }
+        dcisample_jitter(sampler->jitter, sampler->samples + sampler->errors, stats);
+    }
+
+    free(sampler->ring);
+    free(sampler);
+    return 0;
+}
+
+/*
+ * Starts a schedule of rate samples per second on the calling thread,
+ * the first sample is due at once
+ */
+u_int64_t
+dcisample_acquire_start(const u_int64_t dcihid_handle, const u_int32_t rate) {
+    dcisample_acquirer_t        acquirer;
+
+    if (rate == 0 || rate > NSEC_PER_SEC) {
+        fprintf(stderr, "dcisample: invalid rate\n");
+        return 0;
+    }
+    if ((acquirer = (dcisample_acquirer_t)calloc(1, sizeof(struct dcisample_acquirer))) == NULL) return 0;
+    acquirer->dcihid_handle = dcihid_handle;
+    acquirer->period = NSEC_PER_SEC / rate;
+    acquirer->next = acquirer->start_ns = dcirt_now_ns();
+    return (u_int64_t)acquirer;
+}
+
+/*
+ * Fills samples with the next count deadlines of the schedule, returns
+ * the number of samples taken, less than count if some reads failed.
+ * Every sample is one input report, with the ports and the ADC result.
+ */
+int32_t
+dcisample_acquire_next(const u_int64_t acquire_handle, struct dcisample *samples, const u_int32_t count) {
+    dcisample_acquirer_t        acquirer = (dcisample_acquirer_t)acquire_handle;
+    struct dcihid_input         input;
+    struct dcisample            *sample;
+    u_int64_t                   now_ns, late;
+    u_int32_t                   taken = 0, errors = 0;
+
+    while (taken + errors < count) {
+        dcirt_sleep_until(acquirer->next);
+
+        now_ns = dcirt_now_ns();
+        late = (now_ns - acquirer->next) / 1000;
+        acquirer->jitter[late < DCISAMPLE_JITTER_MAX ? late : DCISAMPLE_JITTER_MAX]++;
+
+        if (dcihid_read_all(acquirer->dcihid_handle, &input) != 0) {
+            errors++;
+        } else {
+            sample = &samples[taken++];
+            sample->timestamp = now_ns;
+            memcpy(sample->port, input.port, sizeof(sample->port));
+            sample->adc_result = input.adc_result;
+            sample->adc_index = input.adc_index;
+            sample->reserved = 0;
+        }
+
+        acquirer->missed += dcirt_next_period(&acquirer->next, acquirer->period);
+    }
+
+    acquirer->samples += taken;
+    acquirer->errors += errors;
+    return taken;
+}
+
+/*
+ * Ends the schedule, stats cover every sample since dcisample_acquire_start()
+ */
+int32_t
+dcisample_acquire_stop(const u_int64_t acquire_handle, struct dcisample_stats *stats) {
+    dcisample_acquirer_t        acquirer = (dcisample_acquirer_t)acquire_handle;
+    u_int64_t                   now_ns;
+
+    if (stats) {
+        memset(stats, 0, sizeof(struct dcisample_stats));
+        stats->samples = acquirer->samples;
+        stats->written = acquirer->samples;
+        stats->missed = acquirer->missed;
+        stats->errors = acquirer->errors;
+        now_ns = dcirt_now_ns();
+        if (now_ns > acquirer->start_ns) stats->rate = (double)acquirer->samples * NSEC_PER_SEC / (now_ns - acquirer->start_ns);
+        dcisample_jitter(acquirer->jitter, acquirer->samples + acquirer->errors, stats);
+    }
+
+    free(acquirer);
+    return 0;
+}
+
+/*
+ * Fills samples with up to count input reports taken rate times per
+ * second on the calling thread, returns the number of samples taken.
+ */
+int32_t
+dcisample_acquire(const u_int64_t dcihid_handle, const u_int32_t rate, struct dcisample *samples, const u_int32_t count,
+                  struct dcisample_stats *stats) {
+    u_int64_t                   acquirer;
+    int32_t                     taken;
+
+    if ((acquirer = dcisample_acquire_start(dcihid_handle, rate)) == 0) return -1;
+    taken = dcisample_acquire_next(acquirer, samples, count);
+    dcisample_acquire_stop(acquirer, stats);
+    return taken;
+}
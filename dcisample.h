@@ -0,0 +1,63 @@
+#ifndef _DCISAMPLE_H_
+#define _DCISAMPLE_H_
+
+#include <sys/types.h>
+
+/*
+ * stream format: DCISAMPLE_MAGIC followed by struct dcisample records
+ */
+#define DCISAMPLE_MAGIC     "DCISMP1"
+
+struct dcisample {
+    u_int64_t   timestamp;                  // CLOCK_MONOTONIC time of the sample, in ns
+    u_int8_t    port[4];                    // Ports 0x00 to 0x03, same values as dcihid_read()
+    u_int16_t   adc_result;                 // ADC result (upper << 8 | lower)
+    u_int8_t    adc_index;                  // ADC channel of the conversion
+    u_int8_t    reserved;
+};
+
+/*
+ * sampler configuration
+ */
+struct dcisample_config {
+    u_int32_t   rate;                       // Samples per second
+    u_int64_t   count;                      // Samples to take, 0 to run until dcisample_stop()
+    u_int32_t   ring_size;                  // Samples buffered between threads, power of 2, 0 for default
+    int         out_fd;                     // Where samples are streamed to
+};
+
+/*
+ * sampler results, as returned by dcisample_stop()
+ */
+struct dcisample_stats {
+    u_int64_t   samples;                    // Samples taken
+    u_int64_t   written;                    // Samples streamed to out_fd
+    u_int64_t   dropped;                    // Samples lost because the ring was full
+    u_int64_t   missed;                     // Deadlines missed, sample periods skipped
+    u_int64_t   errors;                     // Failed reads
+    double      rate;                       // Achieved samples per second
+    u_int32_t   jitter_p50;                 // Sample start after its deadline, in us
+    u_int32_t   jitter_p99;
+    u_int32_t   jitter_max;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+u_int64_t   dcisample_start(const u_int64_t dcihid_handle, const struct dcisample_config *config);
+int32_t     dcisample_done(const u_int64_t sampler_handle);
+int32_t     dcisample_stop(const u_int64_t sampler_handle, struct dcisample_stats *stats);
+int32_t     dcisample_acquire(const u_int64_t dcihid_handle, const u_int32_t rate, struct dcisample *samples,
+                              const u_int32_t count, struct dcisample_stats *stats);
+u_int64_t   dcisample_acquire_start(const u_int64_t dcihid_handle, const u_int32_t rate);
+int32_t     dcisample_acquire_next(const u_int64_t acquire_handle, struct dcisample *samples, const u_int32_t count);
+int32_t     dcisample_acquire_stop(const u_int64_t acquire_handle, struct dcisample_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
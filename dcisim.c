@@ -0,0 +1,551 @@
+/*
+ * File:
+ *      dcisim.c
+ *
+ * Description:
+ *      Software model of the DCI USB HID devices from Decision-Computer,
+ *      to test and benchmark without the hardware. Every card type is
+ *      modelled from its descriptors in dciboard.h: outputs latch what is
+ *      written, I/O ports read back the last value set from either side,
+ *      inputs are reported inverted as the boards do, and every USB
+ *      transfer takes a configurable latency.
+ *
+ *      Input ports are driven by dcisim_set_input() or by a stimuli
+ *      script, one per line, '#' starts a comment:
+ *          <ms> in <port> <value>          drive an input port, value as dcihid_read() returns it
+ *          <ms> adc <channel> <result>     set the result of the last ADC conversion
+ *          <ms> repeat                     start over <ms> after the start of the script
+ *      Times are taken from the moment the script is loaded, and are
+ *      applied on the next input report after they are due.
+ *
+ *      Boards are reached through the DCIHID_TRANSPORT_SIM transport of
+ *      dcihid.c, or as hiddev/hidraw nodes through dcisim_wrap.c.
+ *
+ *      dcisim_unplug() and dcisim_plug() model a replug: transfers fail
+ *      with ENODEV in between, and the outputs come back off as after a
+ *      power cycle. Every change is signalled on dcisim_plug_fd(), which
+ *      stands for the kernel uevents of real boards.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/eventfd.h>
+
+#include "dcihid.h"
+#include "dciboard.h"
+#include "dcisim.h"
+
+
+/*
+ * hardware configuration, same as dcihid.c
+ */
+enum {
+    eCard_ID = 0,
+    eCard_Num = 1,
+    eport1 = 2,
+    eadc_index = 6,
+    elower_adc_result = 7,
+    eupper_adc_result = 8
+};
+
+enum {
+    eDIO_address = 0,
+    eDIO_data = 1
+};
+
+#define DCISIM_PORTS        (DCISIM_INPUT_USAGES - eport1)  // Addresses seen in the input report
+#define DCISIM_STIMULI_MAX  65536
+#define DCISIM_LINE_MAX     256
+
+enum {
+    DCISIM_STIM_IN,
+    DCISIM_STIM_ADC
+};
+
+
+/*
+ * type declarations
+ */
+struct dcisim_stimulus {
+    u_int64_t                   at_ns;
+    u_int8_t                    op;
+    u_int8_t                    addr;
+    u_int16_t                   value;
+};
+
+struct dcisim_dev {
+    char                        devname[64];
+    char                        rawname[64];
+    const struct dciboard_card  *card;
+    u_int                       card_id;
+    pthread_mutex_t             lock;
+    u_int8_t                    latch[DCISIM_PORTS];            // Last value written
+    u_int8_t                    input[DCISIM_PORTS];            // Value driven from outside
+    u_int8_t                    adc_index;
+    u_int16_t                   adc_result;
+    struct dcisim_stimulus      *stimuli;
+    u_int32_t                   num_stimuli;
+    u_int32_t                   next_stimulus;
+    u_int64_t                   stimuli_start;
+    u_int64_t                   stimuli_period;                 // 0 if the script does not repeat
+    int                         unplugged;
+};
+
+static struct dcisim_dev        dcisim_devs[DCISIM_DEVICES_MAX];
+static int                      dcisim_num_devs = 0;
+static pthread_mutex_t          dcisim_lock = PTHREAD_MUTEX_INITIALIZER;
+static u_int32_t                dcisim_latency_us = 0;
+static int                      dcisim_latency_set = 0;
+static dcisim_report_cb         dcisim_report_callback = NULL;
+static void                     *dcisim_report_arg = NULL;
+static int                      dcisim_plug_efd = -1;
+
+
+/*
+ * functions
+ */
+
+static u_int64_t
+dcisim_now_ns(void) {
+    struct timespec             ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const struct dciboard_port *
+dcisim_port_of(const struct dcisim_dev *dev, const u_int addr) {
+    return dciboard_port(dev->card->card_type, addr);
+}
+
+static u_int8_t
+dcisim_mask(const struct dciboard_port *port) {
+    return (u_int8_t)((1U << port->width) - 1);
+}
+
+static struct dcisim_dev *
+dcisim_dev_of(const int sim) {
+    int                         num_devs;
+
+    pthread_mutex_lock(&dcisim_lock);
+    num_devs = dcisim_num_devs;
+    pthread_mutex_unlock(&dcisim_lock);
+    if (sim < 0 || sim >= num_devs) {
+        errno = ENODEV;
+        return NULL;
+    }
+    return &dcisim_devs[sim];
+}
+
+int
+dcisim_create(const u_int card_type, const u_int card_id, char *dev_name, const size_t len) {
+    const struct dciboard_card  *card = dciboard_card(card_type);
+    struct dcisim_dev           *dev;
+    const char                  *env;
+    FILE                        *script;
+    int                         sim;
+
+    if (card == NULL) {
+        fprintf(stderr, "dcisim: unknown card type 0x%02X\n", card_type);
+        return -1;
+    }
+
+    pthread_mutex_lock(&dcisim_lock);
+    if (dcisim_num_devs == DCISIM_DEVICES_MAX) {
+        pthread_mutex_unlock(&dcisim_lock);
+        fprintf(stderr, "dcisim: at most %d boards are supported\n", DCISIM_DEVICES_MAX);
+        return -1;
+    }
+    if (!dcisim_latency_set && (env = getenv(DCISIM_LATENCY_ENV)) != NULL) {
+        dcisim_latency_us = strtoul(env, NULL, 0);
+        dcisim_latency_set = 1;
+    }
+    sim = dcisim_num_devs;
+    dev = &dcisim_devs[sim];
+    memset(dev, 0, sizeof(struct dcisim_dev));
+    snprintf(dev->devname, sizeof(dev->devname), DCISIM_PATH, sim);
+    snprintf(dev->rawname, sizeof(dev->rawname), DCISIM_RAW_PATH, sim);
+    dev->card = card;
+    dev->card_id = card_id;
+    pthread_mutex_init(&dev->lock, NULL);
+    dcisim_num_devs++;
+    pthread_mutex_unlock(&dcisim_lock);
+
+    if ((env = getenv(DCISIM_STIMULI_ENV)) != NULL && env[0]) {
+        if ((script = fopen(env, "r")) == NULL) {
+            perror(env);
+        } else {
+            dcisim_load_stimuli(sim, script);
+            fclose(script);
+        }
+    }
+
+    if (dev_name) snprintf(dev_name, len, "%s", dev->devname);
+    return sim;
+}
+
+int
+dcisim_find(const char *dev_name) {
+    int                         sim;
+
+    pthread_mutex_lock(&dcisim_lock);
+    for (sim = 0; sim < dcisim_num_devs; sim++) {
+        if (strcmp(dev_name, dcisim_devs[sim].devname) == 0) break;
+        if (strcmp(dev_name, dcisim_devs[sim].rawname) == 0) break;
+    }
+    if (sim == dcisim_num_devs) sim = -1;
+    pthread_mutex_unlock(&dcisim_lock);
+    return sim;
+}
+
+int
+dcisim_find_card(const u_int card_type, const u_int card_id) {
+    int                         sim;
+
+    pthread_mutex_lock(&dcisim_lock);
+    for (sim = 0; sim < dcisim_num_devs; sim++) {
+        if (dcisim_devs[sim].card->card_type == card_type && dcisim_devs[sim].card_id == card_id) break;
+    }
+    if (sim == dcisim_num_devs) sim = -1;
+    pthread_mutex_unlock(&dcisim_lock);
+    return sim;
+}
+
+int
+dcisim_count(void) {
+    int                         num_devs;
+
+    pthread_mutex_lock(&dcisim_lock);
+    num_devs = dcisim_num_devs;
+    pthread_mutex_unlock(&dcisim_lock);
+    return num_devs;
+}
+
+void
+dcisim_set_latency(const u_int32_t latency_us) {
+    dcisim_latency_us = latency_us;
+    dcisim_latency_set = 1;
+}
+
+void
+dcisim_set_report_cb(dcisim_report_cb callback, void *arg) {
+    dcisim_report_arg = arg;
+    dcisim_report_callback = callback;
+}
+
+static int
+dcisim_drivable(const struct dciboard_port *port) {
+    return port != NULL && (port->access & DCIBOARD_READ);
+}
+
+/*
+ * Drives an input from outside the board. Only ports the board reads
+ * can be driven, output ports keep what was written to them.
+ */
+static int
+dcisim_drive(struct dcisim_dev *dev, const u_int8_t addr, const u_int8_t value) {
+    const struct dciboard_port  *port = dcisim_port_of(dev, addr);
+
+    if (!dcisim_drivable(port)) return -1;
+    dev->input[addr] = value & dcisim_mask(port);
+    if (port->access & DCIBOARD_WRITE) dev->latch[addr] = dev->input[addr];
+    return 0;
+}
+
+int
+dcisim_set_input(const int sim, const u_int8_t addr, const u_int8_t value) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    int                         ret;
+
+    if (dev == NULL) return -1;
+    pthread_mutex_lock(&dev->lock);
+    ret = dcisim_drive(dev, addr, value);
+    pthread_mutex_unlock(&dev->lock);
+    if (ret != 0) errno = EINVAL;
+    return ret;
+}
+
+int
+dcisim_set_adc(const int sim, const u_int8_t channel, const u_int16_t result) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+
+    if (dev == NULL) return -1;
+    pthread_mutex_lock(&dev->lock);
+    dev->adc_index = channel;
+    dev->adc_result = result;
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+int
+dcisim_get_output(const int sim, const u_int8_t addr, u_int8_t *value) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+
+    if (dev == NULL) return -1;
+    if (addr >= DCISIM_PORTS) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&dev->lock);
+    *value = dev->latch[addr];
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+int
+dcisim_load_stimuli(const int sim, FILE *script) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    struct dcisim_stimulus      *stimuli;
+    char                        line[DCISIM_LINE_MAX], op[16], *comment;
+    u_int32_t                   num_stimuli = 0;
+    u_int64_t                   at_ns, last_ns = 0, period = 0;
+    u_int                       addr, value;
+    double                      ms;
+    int                         line_num = 0, fields;
+
+    if (dev == NULL) return -1;
+    stimuli = (struct dcisim_stimulus *)malloc(sizeof(struct dcisim_stimulus) * DCISIM_STIMULI_MAX);
+    if (stimuli == NULL) return -1;
+
+    while (fgets(line, sizeof(line), script) != NULL) {
+        line_num++;
+        if ((comment = strchr(line, '#')) != NULL) *comment = '\0';
+        fields = sscanf(line, "%lf %15s %i %i", &ms, op, &addr, &value);
+        if (fields <= 0) continue;
+        if (fields < 2 || ms < 0 || period) goto syntax;
+        at_ns = (u_int64_t)(ms * 1000000.0);
+        if (at_ns < last_ns) goto syntax;
+        last_ns = at_ns;
+
+        if (strcmp(op, "repeat") == 0 && fields == 2 && at_ns > 0) {
+            period = at_ns;
+            continue;
+        }
+        if (fields != 4 || num_stimuli == DCISIM_STIMULI_MAX) goto syntax;
+        if (strcmp(op, "in") == 0 && addr < DCISIM_PORTS && value <= 0xFF) {
+            /* The port has to be an input of the card, or the line would do nothing */
+            if (!dcisim_drivable(dcisim_port_of(dev, addr))) {
+                line[strcspn(line, "\r\n")] = '\0';
+                fprintf(stderr, "dcisim: stimuli line %d: '%s', port 0x%02X is not an input of card 0x%02X\n",
+                        line_num, line, addr, dev->card->card_type);
+                free(stimuli);
+                errno = EINVAL;
+                return -1;
+            }
+            stimuli[num_stimuli].op = DCISIM_STIM_IN;
+        } else if (strcmp(op, "adc") == 0 && addr <= 0xFF && value <= 0xFFFF) {
+            stimuli[num_stimuli].op = DCISIM_STIM_ADC;
+        } else {
+            goto syntax;
+        }
+        stimuli[num_stimuli].at_ns = at_ns;
+        stimuli[num_stimuli].addr = addr;
+        stimuli[num_stimuli].value = value;
+        num_stimuli++;
+    }
+
+    pthread_mutex_lock(&dev->lock);
+    free(dev->stimuli);
+    dev->stimuli = stimuli;
+    dev->num_stimuli = num_stimuli;
+    dev->next_stimulus = 0;
+    dev->stimuli_period = period;
+    dev->stimuli_start = dcisim_now_ns();
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+
+syntax:
+    line[strcspn(line, "\r\n")] = '\0';
+    fprintf(stderr, "dcisim: stimuli line %d: invalid '%s'\n", line_num, line);
+    free(stimuli);
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * Applies the stimuli that are due, the device lock is held
+ */
+static void
+dcisim_stimulate(struct dcisim_dev *dev) {
+    struct dcisim_stimulus      *stimulus;
+    u_int64_t                   now;
+
+    if (dev->num_stimuli == 0) return;
+    now = dcisim_now_ns() - dev->stimuli_start;
+
+    /* Whole periods missed in between end the same, play only the last one */
+    if (dev->stimuli_period && now >= 2 * dev->stimuli_period) {
+        dev->stimuli_start += (now / dev->stimuli_period - 1) * dev->stimuli_period;
+        now = dcisim_now_ns() - dev->stimuli_start;
+        dev->next_stimulus = 0;
+    }
+
+    for (;;) {
+        if (dev->next_stimulus == dev->num_stimuli) {
+            if (dev->stimuli_period == 0 || now < dev->stimuli_period) return;
+            dev->stimuli_start += dev->stimuli_period;
+            now -= dev->stimuli_period;
+            dev->next_stimulus = 0;
+            continue;
+        }
+        stimulus = &dev->stimuli[dev->next_stimulus];
+        if (stimulus->at_ns > now) return;
+        if (stimulus->op == DCISIM_STIM_IN) {
+            if (dcisim_drive(dev, stimulus->addr, stimulus->value) != 0) {
+                fprintf(stderr, "dcisim: stimulus at %.3f ms can not drive port 0x%02X\n", stimulus->at_ns / 1e6, stimulus->addr);
+            }
+        } else {
+            dev->adc_index = stimulus->addr;
+            dev->adc_result = stimulus->value;
+        }
+        dev->next_stimulus++;
+    }
+}
+
+/*
+ * One USB transfer, the board answers after the configured latency
+ */
+static void
+dcisim_transfer(void) {
+    struct timespec             ts;
+
+    if (dcisim_latency_us == 0) return;
+    ts.tv_sec = dcisim_latency_us / 1000000;
+    ts.tv_nsec = (dcisim_latency_us % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+/*
+ * Value of a port as dcihid_read() returns it
+ */
+static u_int8_t
+dcisim_read_port(const struct dcisim_dev *dev, const u_int addr) {
+    const struct dciboard_port  *port = dcisim_port_of(dev, addr);
+
+    if (port == NULL) return 0x00;
+    if (port->access & DCIBOARD_WRITE) return dev->latch[addr] & dcisim_mask(port);
+    return dev->input[addr] & dcisim_mask(port);
+}
+
+int
+dcisim_get_report(const int sim, int32_t *values, const u_int32_t count) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    const struct dciboard_port  *port;
+    int32_t                     report[DCISIM_INPUT_USAGES];
+    u_int                       i;
+
+    if (dev == NULL) return -1;
+    pthread_mutex_lock(&dev->lock);
+    if (dev->unplugged) {
+        pthread_mutex_unlock(&dev->lock);
+        errno = ENODEV;
+        return -1;
+    }
+    dcisim_transfer();
+    dcisim_stimulate(dev);
+
+    /* The input report: ports come inverted, the ADC fields do not */
+    report[eCard_ID] = dev->card->card_type;
+    report[eCard_Num] = dev->card_id;
+    for (i = 0; i < DCISIM_PORTS; i++) {
+        port = dcisim_port_of(dev, i);
+        report[eport1 + i] = (port && !port->inverted) ? dcisim_read_port(dev, i) : ~dcisim_read_port(dev, i) & 0xFF;
+    }
+    if (dev->card->adc) {
+        report[eadc_index] = dev->adc_index;
+        report[elower_adc_result] = dev->adc_result & 0xFF;
+        report[eupper_adc_result] = dev->adc_result >> 8;
+    }
+    pthread_mutex_unlock(&dev->lock);
+
+    memcpy(values, report, (count < DCISIM_INPUT_USAGES ? count : DCISIM_INPUT_USAGES) * sizeof(int32_t));
+    return 0;
+}
+
+int
+dcisim_set_report(const int sim, const int32_t *values, const u_int32_t count) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    const struct dciboard_port  *port;
+    u_int8_t                    addr, data;
+
+    if (dev == NULL) return -1;
+    if (count <= eDIO_data) {
+        errno = EINVAL;
+        return -1;
+    }
+    addr = values[eDIO_address] & 0xFF;
+    data = values[eDIO_data] & 0xFF;
+
+    pthread_mutex_lock(&dev->lock);
+    if (dev->unplugged) {
+        pthread_mutex_unlock(&dev->lock);
+        errno = ENODEV;
+        return -1;
+    }
+    dcisim_transfer();
+    port = dcisim_port_of(dev, addr);
+    if (port && (port->access & DCIBOARD_WRITE)) dev->latch[addr] = data & dcisim_mask(port);
+    if (dcisim_report_callback) dcisim_report_callback(sim, addr, data, dcisim_report_arg);
+    pthread_mutex_unlock(&dev->lock);
+    return 0;
+}
+
+/*
+ * Eventfd signalled on every dcisim_unplug() and dcisim_plug()
+ */
+int
+dcisim_plug_fd(void) {
+    pthread_mutex_lock(&dcisim_lock);
+    if (dcisim_plug_efd < 0 && (dcisim_plug_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) perror("dcisim eventfd");
+    pthread_mutex_unlock(&dcisim_lock);
+    return dcisim_plug_efd;
+}
+
+static int
+dcisim_set_plugged(const int sim, const int plugged) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    u_int64_t                   one = 1;
+
+    if (dev == NULL) return -1;
+    pthread_mutex_lock(&dev->lock);
+    if (plugged && dev->unplugged) {
+        /* Outputs power up off, inputs are driven from outside */
+        memset(dev->latch, 0, sizeof(dev->latch));
+    }
+    dev->unplugged = !plugged;
+    pthread_mutex_unlock(&dev->lock);
+
+    if (dcisim_plug_efd >= 0 && write(dcisim_plug_efd, &one, sizeof(one)) != sizeof(one)) perror("dcisim eventfd");
+    return 0;
+}
+
+int
+dcisim_unplug(const int sim) {
+    return dcisim_set_plugged(sim, 0);
+}
+
+int
+dcisim_plug(const int sim) {
+    return dcisim_set_plugged(sim, 1);
+}
+
+int
+dcisim_plugged(const int sim) {
+    struct dcisim_dev           *dev = dcisim_dev_of(sim);
+    int                         plugged;
+
+    if (dev == NULL) return 0;
+    pthread_mutex_lock(&dev->lock);
+    plugged = !dev->unplugged;
+    pthread_mutex_unlock(&dev->lock);
+    return plugged;
+}
@@ -0,0 +1,65 @@
+#ifndef _DCISIM_H_
+#define _DCISIM_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * simulated boards are opened with the DCIHID_TRANSPORT_SIM transport, or
+ * by path like a real hiddev or hidraw node when linked with dcisim_wrap.c
+ */
+#define DCISIM_PATH         "/dev/dcisim%d"
+#define DCISIM_RAW_PATH     "/dev/dcisimraw%d"
+#define DCISIM_DEVICES_MAX  16
+
+/*
+ * report layout, same as the boards
+ */
+#define DCISIM_INPUT_USAGES     32
+#define DCISIM_OUTPUT_USAGES    5
+#define DCISIM_VID              0x10C4
+#define DCISIM_PID              0x81B9
+
+/*
+ * defaults taken from the environment by dcisim_create()
+ */
+#define DCISIM_LATENCY_ENV  "DCISIM_LATENCY_US"     // Microseconds per USB transfer
+#define DCISIM_STIMULI_ENV  "DCISIM_STIMULI"        // Stimuli script loaded on every new board
+
+/*
+ * called for every output report the simulated board receives
+ */
+typedef void (*dcisim_report_cb)(const int sim, const u_int8_t addr, const u_int8_t data, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+int         dcisim_create(const u_int card_type, const u_int card_id, char *dev_name, const size_t len);
+int         dcisim_find(const char *dev_name);
+int         dcisim_find_card(const u_int card_type, const u_int card_id);
+int         dcisim_count(void);
+void        dcisim_set_latency(const u_int32_t latency_us);
+void        dcisim_set_report_cb(dcisim_report_cb callback, void *arg);
+int         dcisim_set_input(const int sim, const u_int8_t addr, const u_int8_t value);
+int         dcisim_set_adc(const int sim, const u_int8_t channel, const u_int16_t result);
+int         dcisim_get_output(const int sim, const u_int8_t addr, u_int8_t *value);
+int         dcisim_load_stimuli(const int sim, FILE *script);
+int         dcisim_get_report(const int sim, int32_t *values, const u_int32_t count);
+int         dcisim_set_report(const int sim, const int32_t *values, const u_int32_t count);
+int         dcisim_unplug(const int sim);
+int         dcisim_plug(const int sim);
+int         dcisim_plugged(const int sim);
+int         dcisim_plug_fd(void);
+
+/* Defined in dcisim_wrap.c, for programs linked with its --wrap flags */
+u_int64_t   dcisim_syscalls(void);
+void        dcisim_set_usages_multi(const int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+/*
+ * File:
+ *      dcisim_wrap.c
+ *
+ * Description:
+ *      Simulated hiddev and hidraw nodes for the boards of dcisim.c, so
+ *      that the hiddev and hidraw transports of dcihid.c can be measured
+ *      without hardware. Programs linked with
+ *          -Wl,--wrap=open,--wrap=close,--wrap=ioctl,--wrap=read,--wrap=write
+ *      get these calls on DCISIM_PATH and DCISIM_RAW_PATH answered here,
+ *      and every other path goes to the real system calls.
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <linux/hiddev.h>
+#include <linux/hidraw.h>
+
+#include "dcisim.h"
+
+
+/*
+ * kernel side configuration
+ */
+#define DCISIM_BUSNUM           99
+#define DCISIM_USAGE_CODE       0xFF000001
+#define DCISIM_FDS_MAX          1024
+
+
+/*
+ * type declarations
+ */
+
+/* Report buffers of one board, as kept by the kernel */
+struct dcisim_node {
+    pthread_mutex_t             lock;
+    int32_t                     input[DCISIM_INPUT_USAGES];
+    int32_t                     output[DCISIM_OUTPUT_USAGES];
+};
+
+static struct dcisim_node       dcisim_nodes[DCISIM_DEVICES_MAX];
+static signed char              dcisim_fds[DCISIM_FDS_MAX];     // Simulated board of every fd + 1, 0 if none
+static char                     dcisim_fds_raw[DCISIM_FDS_MAX]; // Opened as hidraw node
+static pthread_once_t           dcisim_once = PTHREAD_ONCE_INIT;
+static atomic_uint_fast64_t     dcisim_calls;
+static atomic_int               dcisim_multi = 1;               // HIDIOCSUSAGES accepted on output fields
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long request, ...);
+ssize_t __real_read(int fd, void *buf, size_t count);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+
+
+/*
+ * functions
+ */
+
+u_int64_t
+dcisim_syscalls(void) {
+    return atomic_load(&dcisim_calls);
+}
+
+/*
+ * Without HIDIOCSUSAGES on the output field, like older kernels, handles
+ * write the address and the data one HIDIOCSUSAGE each, and every
+ * HIDIOCSUSAGE yields the CPU to widen the gap between the two
+ */
+void
+dcisim_set_usages_multi(const int enable) {
+    atomic_store(&dcisim_multi, enable);
+}
+
+static void
+dcisim_nodes_init(void) {
+    int                         sim;
+
+    for (sim = 0; sim < DCISIM_DEVICES_MAX; sim++) pthread_mutex_init(&dcisim_nodes[sim].lock, NULL);
+}
+
+static int
+dcisim_of(const int fd) {
+    if (fd < 0 || fd >= DCISIM_FDS_MAX) return -1;
+    return dcisim_fds[fd] - 1;
+}
+
+static int32_t *
+dcisim_usages(struct dcisim_node *node, const u_int report_type, const u_int field_index, u_int *max) {
+    if (field_index != 0) return NULL;
+    switch (report_type) {
+        case HID_REPORT_TYPE_INPUT:
+            *max = DCISIM_INPUT_USAGES;
+            return node->input;
+        case HID_REPORT_TYPE_OUTPUT:
+            *max = DCISIM_OUTPUT_USAGES;
+            return node->output;
+    }
+    return NULL;
+}
+
+static int
+dcisim_ioctl(const int sim, const unsigned long request, void *arg) {
+    struct dcisim_node              *node = &dcisim_nodes[sim];
+    struct hiddev_devinfo           *device_info;
+    struct hiddev_report_info       *report_info;
+    struct hiddev_field_info        *field_info;
+    struct hiddev_usage_ref         *usage_ref;
+    struct hiddev_usage_ref_multi   *usage_multi;
+    int32_t                         *usages;
+    u_int                           max;
+
+    /* HIDIOCGNAME carries its buffer length */
+    if (_IOC_TYPE(request) == 'H' && _IOC_NR(request) == _IOC_NR(HIDIOCGNAME(0))) {
+        snprintf((char *)arg, _IOC_SIZE(request), "Decision-Computer DCI USB HID (simulated)");
+        return 0;
+    }
+
+    switch (request) {
+        case HIDIOCGDEVINFO:
+            device_info = (struct hiddev_devinfo *)arg;
+            memset(device_info, 0, sizeof(struct hiddev_devinfo));
+            device_info->bustype = 3;
+            device_info->busnum = DCISIM_BUSNUM;
+            device_info->devnum = sim + 1;
+            device_info->vendor = (short)DCISIM_VID;
+            device_info->product = (short)DCISIM_PID;
+            device_info->num_applications = 1;
+            return 0;
+        case HIDIOCINITREPORT:
+        case HIDIOCSFLAG:
+            return 0;
+        case HIDIOCGREPORTINFO:
+            /* One report with one field per type, all with ID 0 */
+            report_info = (struct hiddev_report_info *)arg;
+            if ((report_info->report_type != HID_REPORT_TYPE_INPUT && report_info->report_type != HID_REPORT_TYPE_OUTPUT) ||
+                (report_info->report_id & HID_REPORT_ID_NEXT) || (report_info->report_id & HID_REPORT_ID_MASK) != 0) {
+                errno = EINVAL;
+                return -1;
+            }
+            report_info->report_id = 0;
+            report_info->num_fields = 1;
+            return 0;
+        case HIDIOCGFIELDINFO:
+            field_info = (struct hiddev_field_info *)arg;
+            if (dcisim_usages(node, field_info->report_type, field_info->field_index, &max) == NULL) break;
+            field_info->maxusage = max;
+            field_info->flags = HID_FIELD_VARIABLE;
+            field_info->application = DCISIM_USAGE_CODE;
+            field_info->logical_minimum = 0;
+            field_info->logical_maximum = 255;
+            return 0;
+        case HIDIOCGUCODE:
+            usage_ref = (struct hiddev_usage_ref *)arg;
+            usage_ref->usage_code = DCISIM_USAGE_CODE;
+            return 0;
+        case HIDIOCGUSAGE:
+        case HIDIOCSUSAGE:
+            usage_ref = (struct hiddev_usage_ref *)arg;
+            usages = dcisim_usages(node, usage_ref->report_type, usage_ref->field_index, &max);
+            if (usages == NULL || usage_ref->usage_index >= max) break;
+            if (request == HIDIOCGUSAGE) {
+                usage_ref->value = usages[usage_ref->usage_index];
+            } else {
+                usages[usage_ref->usage_index] = usage_ref->value;
+            }
+            return 0;
+        case HIDIOCGUSAGES:
+        case HIDIOCSUSAGES:
+            usage_multi = (struct hiddev_usage_ref_multi *)arg;
+            usages = dcisim_usages(node, usage_multi->uref.report_type, usage_multi->uref.field_index, &max);
+            if (usages == NULL || usage_multi->num_values > HID_MAX_MULTI_USAGES ||
+                usage_multi->uref.usage_index + usage_multi->num_values > max) break;
+            if (request == HIDIOCSUSAGES && !atomic_load(&dcisim_multi)) break;
+            if (request == HIDIOCGUSAGES) {
+                memcpy(usage_multi->values, &usages[usage_multi->uref.usage_index], usage_multi->num_values * sizeof(int32_t));
+            } else {
+                memcpy(&usages[usage_multi->uref.usage_index], usage_multi->values, usage_multi->num_values * sizeof(int32_t));
+            }
+            return 0;
+        case HIDIOCGREPORT:
+            report_info = (struct hiddev_report_info *)arg;
+            if (report_info->report_type != HID_REPORT_TYPE_INPUT) return 0;
+            return dcisim_get_report(sim, node->input, DCISIM_INPUT_USAGES);
+        case HIDIOCSREPORT:
+            report_info = (struct hiddev_report_info *)arg;
+            if (report_info->report_type != HID_REPORT_TYPE_OUTPUT) break;
+            return dcisim_set_report(sim, node->output, DCISIM_OUTPUT_USAGES);
+        default:
+            errno = ENOTTY;
+            return -1;
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/*
+ * hidraw: reports go whole, prefixed by their ID
+ */
+static int
+dcisim_ioctl_raw(const int sim, const unsigned long request, void *arg) {
+    struct dcisim_node              *node = &dcisim_nodes[sim];
+    struct hidraw_devinfo           *raw_info;
+    u_int8_t                        *buf = (u_int8_t *)arg;
+    u_int                           len, i;
+
+    if (_IOC_TYPE(request) == 'H' && _IOC_NR(request) == _IOC_NR(HIDIOCGRAWNAME(0))) {
+        snprintf((char *)arg, _IOC_SIZE(request), "Decision-Computer DCI USB HID (simulated)");
+        return 0;
+    }
+    if (_IOC_TYPE(request) == 'H' && _IOC_NR(request) == _IOC_NR(HIDIOCGINPUT(0))) {
+        if (buf[0] != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (dcisim_get_report(sim, node->input, DCISIM_INPUT_USAGES) != 0) return -1;
+        len = _IOC_SIZE(request) - 1;
+        if (len > DCISIM_INPUT_USAGES) len = DCISIM_INPUT_USAGES;
+        for (i = 0; i < len; i++) buf[1 + i] = node->input[i] & 0xFF;
+        return len + 1;
+    }
+    if (request == HIDIOCGRAWINFO) {
+        raw_info = (struct hidraw_devinfo *)arg;
+        raw_info->bustype = 3;
+        raw_info->vendor = (short)DCISIM_VID;
+        raw_info->product = (short)DCISIM_PID;
+        return 0;
+    }
+    errno = ENOTTY;
+    return -1;
+}
+
+static ssize_t
+dcisim_write_raw(const int sim, const u_int8_t *buf, const size_t count) {
+    struct dcisim_node              *node = &dcisim_nodes[sim];
+    size_t                          i;
+
+    if (count < 1 + DCISIM_OUTPUT_USAGES || buf[0] != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < DCISIM_OUTPUT_USAGES; i++) node->output[i] = buf[1 + i];
+    if (dcisim_set_report(sim, node->output, DCISIM_OUTPUT_USAGES) != 0) return -1;
+    return count;
+}
+
+
+/*
+ * system call wrappers
+ */
+
+int
+__wrap_open(const char *path, int flags, ...) {
+    char                        rawname[64];
+    mode_t                      mode = 0;
+    va_list                     args;
+    int                         fd, sim;
+
+    if (flags & O_CREAT) {
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+
+    if ((sim = dcisim_find(path)) < 0) return __real_open(path, flags, mode);
+    pthread_once(&dcisim_once, dcisim_nodes_init);
+
+    /* The node of an unplugged board does not exist */
+    if (!dcisim_plugged(sim)) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    /* A real descriptor keeps the number unique and fcntl() working */
+    atomic_fetch_add(&dcisim_calls, 1);
+    if ((fd = __real_open("/dev/null", O_RDONLY | (flags & O_CLOEXEC))) < 0) return -1;
+    if (fd >= DCISIM_FDS_MAX) {
+        __real_close(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    snprintf(rawname, sizeof(rawname), DCISIM_RAW_PATH, sim);
+    dcisim_fds[fd] = sim + 1;
+    dcisim_fds_raw[fd] = (strcmp(path, rawname) == 0);
+    return fd;
+}
+
+int
+__wrap_close(int fd) {
+    if (dcisim_of(fd) >= 0) {
+        atomic_fetch_add(&dcisim_calls, 1);
+        dcisim_fds[fd] = 0;
+    }
+    return __real_close(fd);
+}
+
+int
+__wrap_ioctl(int fd, unsigned long request, ...) {
+    void                        *arg;
+    va_list                     args;
+    int                         sim, ret;
+
+    va_start(args, request);
+    arg = va_arg(args, void *);
+    va_end(args);
+
+    if ((sim = dcisim_of(fd)) < 0) return __real_ioctl(fd, request, arg);
+
+    atomic_fetch_add(&dcisim_calls, 1);
+    pthread_mutex_lock(&dcisim_nodes[sim].lock);
+    if (dcisim_fds_raw[fd]) {
+        ret = dcisim_ioctl_raw(sim, request, arg);
+    } else {
+        ret = dcisim_ioctl(sim, request, arg);
+    }
+    pthread_mutex_unlock(&dcisim_nodes[sim].lock);
+    /* Let other threads run between the calls of one report, a single CPU would seldom switch there */
+    if (request == HIDIOCSUSAGE && !atomic_load(&dcisim_multi)) sched_yield();
+    return ret;
+}
+
+ssize_t
+__wrap_read(int fd, void *buf, size_t count) {
+    if (dcisim_of(fd) < 0) return __real_read(fd, buf, count);
+
+    /* No event stream, as if no report came in */
+    atomic_fetch_add(&dcisim_calls, 1);
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t
+__wrap_write(int fd, const void *buf, size_t count) {
+    ssize_t                     ret;
+    int                         sim;
+
+    if ((sim = dcisim_of(fd)) < 0 || !dcisim_fds_raw[fd]) return __real_write(fd, buf, count);
+
+    atomic_fetch_add(&dcisim_calls, 1);
+    pthread_mutex_lock(&dcisim_nodes[sim].lock);
+    ret = dcisim_write_raw(sim, (const u_int8_t *)buf, count);
+    pthread_mutex_unlock(&dcisim_nodes[sim].lock);
+    return ret;
+}
@@ -0,0 +1,344 @@
+/*
+ * File:
+ *      dciwave.c
+ *
+ * Description:
+ *      Pulse and waveform generator for DCI USB HID devices from
+ *      Decision-Computer. A timeline of output changes is run on a
+ *      dedicated thread that sleeps until the absolute deadline of every
+ *      event, optionally with SCHED_FIFO priority and pinned to a CPU,
+ *      and records how late each write was issued.
+ *
+ *      Timelines can be loaded from a script, one event per line, '#'
+ *      starts a comment, times in ms from the start of the timeline:
+ *          <ms> <port> <value> [<mask>]                        write the bits of mask, all bits by default
+ *          pulse <ms> <port> <mask> <period_ms> <duty%> <count> pulse train on the bits of mask
+ *
+ * History:
+ *      2026/10/17: Initial version
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#include "dcihid.h"
+#include "dciwave.h"
+#include "dcirt.h"
+
+
+/*
+ * configuration
+ */
+#define DCIWAVE_LEAD_US         1000    // Default start of the timeline after dciwave_start()
+#define DCIWAVE_SLICE_NS        100000000ULL // Longest sleep before checking for dciwave_stop()
+#define DCIWAVE_ERROR_MAX       10000   // Edge error histogram range, in us
+#define DCIWAVE_LOAD_CHUNK      256     // Events allocated at once by dciwave_load()
+#define DCIWAVE_PORTS           256
+
+
+/*
+ * type declarations
+ */
+struct dciwave_generator {
+    u_int64_t                   dcihid_handle;
+    struct dciwave_config       config;
+    pthread_t                   thread;
+    int                         realtime;
+    u_int64_t                   start_ns;
+    atomic_int                  stop;
+    atomic_int                  done;
+
+    /* Generator statistics */
+    u_int64_t                   events;
+    u_int64_t                   errors;
+    u_int32_t                   write_max;
+    u_int32_t                   error[DCIWAVE_ERROR_MAX + 1];
+};
+typedef struct dciwave_generator *dciwave_generator_t;
+
+
+/*
+ * functions
+ */
+
+/*
+ * Appends a pulse train: mask goes high at offset + i * period, and low
+ * again high ns later. Returns the number of events written.
+ */
+int32_t
+dciwave_pulse(struct dciwave_event *events, const u_int32_t max, const u_int64_t offset, const u_int8_t port,
+              const u_int8_t mask, const u_int64_t period, const u_int64_t high, const u_int32_t count) {
+    u_int32_t                   i;
+
+    if (high == 0 || high >= period || mask == 0 || count > max / 2) {
+        errno = EINVAL;
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        events[2 * i].offset = offset + i * period;
+        events[2 * i].port = port;
+        events[2 * i].value = mask;
+        events[2 * i].mask = mask;
+        events[2 * i].reserved = 0;
+        events[2 * i + 1].offset = offset + i * period + high;
+        events[2 * i + 1].port = port;
+        events[2 * i + 1].value = 0;
+        events[2 * i + 1].mask = mask;
+        events[2 * i + 1].reserved = 0;
+    }
+    return 2 * count;
+}
+
+/*
+ * Sorts by offset, events due at the same time keep their order
+ */
+int32_t
+dciwave_sort(struct dciwave_event *events, const u_int32_t count) {
+    struct dciwave_event        *tmp, *src = events, *dst, *swap;
+    u_int32_t                   width, lo, mid, hi, i, j, k;
+
+    if (count < 2) return 0;
+    if ((tmp = (struct dciwave_event *)malloc(count * sizeof(struct dciwave_event))) == NULL) return -1;
+    dst = tmp;
+
+    /* Bottom-up merge sort, stable unlike qsort() */
+    for (width = 1; width < count; width *= 2) {
+        for (lo = 0; lo < count; lo += 2 * width) {
+            mid = lo + width < count ? lo + width : count;
+            hi = lo + 2 * width < count ? lo + 2 * width : count;
+            for (i = lo, j = mid, k = lo; k < hi; k++) {
+                if (i < mid && (j >= hi || src[i].offset <= src[j].offset)) {
+                    dst[k] = src[i++];
+                } else {
+                    dst[k] = src[j++];
+                }
+            }
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != events) memcpy(events, src, count * sizeof(struct dciwave_event));
+
+    free(tmp);
+    return 0;
+}
+
+static int
+dciwave_grow(struct dciwave_event **events, u_int32_t *size, const u_int32_t needed) {
+    struct dciwave_event        *grown;
+    u_int32_t                   new_size = *size;
+
+    if (needed <= *size) return 0;
+    while (new_size < needed) new_size += new_size ? new_size : DCIWAVE_LOAD_CHUNK;
+    if ((grown = (struct dciwave_event *)realloc(*events, new_size * sizeof(struct dciwave_event))) == NULL) return -1;
+    *events = grown;
+    *size = new_size;
+    return 0;
+}
+
+/*
+ * Reads a timeline script, returns the events sorted by offset, to be
+ * freed by the caller, or NULL on error
+ */
+struct dciwave_event *
+dciwave_load(FILE *script, u_int32_t *count) {
+    struct dciwave_event        *events = NULL;
+    char                        line[256], *hash;
+    double                      at, period, duty;
+    u_int32_t                   size = 0, num = 0, lineno = 0, pulses;
+    int                         port, value, mask, fields, ret;
+
+    while (fgets(line, sizeof(line), script)) {
+        lineno++;
+        if ((hash = strchr(line, '#'))) *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        if (sscanf(line, " pulse %lf %i %i %lf %lf %u", &at, &port, &mask, &period, &duty, &pulses) == 6) {
+            if (at < 0 || port < 0 || port > 0xFF || mask < 0 || mask > 0xFF || period <= 0 || duty <= 0 || duty >= 100 ||
+                dciwave_grow(&events, &size, num + 2 * pulses) != 0) goto error;
+            ret = dciwave_pulse(&events[num], size - num, (u_int64_t)(at * NSEC_PER_MSEC), port, mask,
+                                (u_int64_t)(period * NSEC_PER_MSEC), (u_int64_t)(period * duty / 100 * NSEC_PER_MSEC), pulses);
+            if (ret < 0) goto error;
+            num += ret;
+            continue;
+        }
+
+        mask = 0xFF;
+        fields = sscanf(line, " %lf %i %i %i", &at, &port, &value, &mask);
+        if (fields < 3 || at < 0 || port < 0 || port > 0xFF || value < 0 || value > 0xFF || mask < 0 || mask > 0xFF ||
+            dciwave_grow(&events, &size, num + 1) != 0) goto error;
+        events[num].offset = (u_int64_t)(at * NSEC_PER_MSEC);
+        events[num].port = port;
+        events[num].value = value;
+        events[num].mask = mask;
+        events[num].reserved = 0;
+        num++;
+    }
+
+    if (num == 0 || dciwave_sort(events, num) != 0) {
+        fprintf(stderr, "dciwave: empty timeline\n");
+        free(events);
+        return NULL;
+    }
+    *count = num;
+    return events;
+
+error:
+    fprintf(stderr, "dciwave: invalid event on line %u\n", lineno);
+    free(events);
+    return NULL;
+}
+
+/*
+ * Sleeps until deadline, waking every DCIWAVE_SLICE_NS to honour
+ * dciwave_stop(). Returns -1 when stopped.
+ */
+static int
+dciwave_sleep(dciwave_generator_t generator, const u_int64_t deadline) {
+    struct timespec             wake;
+    u_int64_t                   now;
+
+    for (;;) {
+        if (atomic_load_explicit(&generator->stop, memory_order_relaxed)) return -1;
+        now = dcirt_now_ns();
+        if (now + DCIWAVE_SLICE_NS >= deadline) break;
+        dcirt_ns_timespec(now + DCIWAVE_SLICE_NS, &wake);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+    }
+
+    /* The last sleep is on the absolute deadline, no drift from the loop */
+    dcirt_sleep_until(deadline);
+    return 0;
+}
+
+static void *
+dciwave_run(void *arg) {
+    dciwave_generator_t         generator = (dciwave_generator_t)arg;
+    const struct dciwave_event  *event;
+    struct dciwave_edge         edge;
+    u_int64_t                   issued, late;
+    u_int32_t                   i;
+
+    for (i = 0; i < generator->config.count; i++) {
+        event = &generator->config.events[i];
+        edge.deadline = generator->start_ns + event->offset;
+        if (dciwave_sleep(generator, edge.deadline) != 0) break;
+
+        issued = dcirt_now_ns();
+        if (event->mask == 0xFF) {
+            edge.status = dcihid_write(generator->dcihid_handle, event->port, event->value);
+        } else {
+            edge.status = dcihid_write_masked(generator->dcihid_handle, event->port, event->mask, event->value, NULL);
+        }
+        edge.write_ns = dcirt_now_ns() - issued;
+        edge.error = issued - edge.deadline;
+
+        late = edge.error / 1000;
+        generator->error[late < DCIWAVE_ERROR_MAX ? late : DCIWAVE_ERROR_MAX]++;
+        if (edge.write_ns / 1000 > generator->write_max) generator->write_max = edge.write_ns / 1000;
+        if (edge.status != 0) generator->errors++;
+        generator->events++;
+        if (generator->config.edges) generator->config.edges[i] = edge;
+    }
+
+    atomic_store_explicit(&generator->done, 1, memory_order_release);
+    return NULL;
+}
+
+u_int64_t
+dciwave_start(const u_int64_t dcihid_handle, const struct dciwave_config *config) {
+    dciwave_generator_t         generator;
+    u_int8_t                    primed[DCIWAVE_PORTS / 8];
+    u_int32_t                   i, port;
+
+    if (config->events == NULL || config->count == 0) {
+        fprintf(stderr, "dciwave: empty timeline\n");
+        return 0;
+    }
+    for (i = 1; i < config->count; i++) {
+        if (config->events[i].offset < config->events[i - 1].offset) {
+            fprintf(stderr, "dciwave: timeline not sorted by offset\n");
+            return 0;
+        }
+    }
+
+    generator = (dciwave_generator_t)calloc(1, sizeof(struct dciwave_generator));
+    if (generator == NULL) return 0;
+    generator->dcihid_handle = dcihid_handle;
+    memcpy(&generator->config, config, sizeof(struct dciwave_config));
+    atomic_init(&generator->stop, 0);
+    atomic_init(&generator->done, 0);
+
+    /* Masked writes need the current value of the port, read it now rather than on the first edge */
+    memset(primed, 0, sizeof(primed));
+    for (i = 0; i < config->count; i++) {
+        port = config->events[i].port;
+        if (config->events[i].mask == 0xFF || (primed[port / 8] & (1 << (port % 8)))) continue;
+        primed[port / 8] |= 1 << (port % 8);
+        if (dcihid_resync(dcihid_handle, port) != 0) fprintf(stderr, "dciwave: could not read port 0x%02X\n", port);
+    }
+
+    generator->start_ns = dcirt_now_ns() + (u_int64_t)(config->lead_us ? config->lead_us : DCIWAVE_LEAD_US) * 1000;
+    if (dcirt_spawn("dciwave", &generator->thread, dciwave_run, generator,
+                    generator->config.priority, generator->config.cpu, &generator->realtime) != 0) {
+        free(generator);
+        return 0;
+    }
+    return (u_int64_t)generator;
+}
+
+int32_t
+dciwave_done(const u_int64_t wave_handle) {
+    dciwave_generator_t         generator = (dciwave_generator_t)wave_handle;
+
+    return atomic_load_explicit(&generator->done, memory_order_acquire);
+}
+
+/*
+ * Edge error percentile from the histogram, in us
+ */
+static u_int32_t
+dciwave_percentile(const dciwave_generator_t generator, const double fraction) {
+    u_int64_t                   seen = 0, rank = (u_int64_t)(generator->events * fraction);
+    u_int32_t                   i;
+
+    for (i = 0; i <= DCIWAVE_ERROR_MAX; i++) {
+        seen += generator->error[i];
+        if (seen > rank) return i;
+    }
+    return DCIWAVE_ERROR_MAX;
+}
+
+int32_t
+dciwave_stop(const u_int64_t wave_handle, struct dciwave_stats *stats) {
+    dciwave_generator_t         generator = (dciwave_generator_t)wave_handle;
+    int32_t                     i;
+
+    atomic_store(&generator->stop, 1);
+    pthread_join(generator->thread, NULL);
+
+    if (stats) {
+        memset(stats, 0, sizeof(struct dciwave_stats));
+        stats->events = generator->events;
+        stats->errors = generator->errors;
+        stats->write_max = generator->write_max;
+        stats->realtime = generator->realtime;
+        if (generator->events) {
+            stats->error_p50 = dciwave_percentile(generator, 0.50);
+            stats->error_p99 = dciwave_percentile(generator, 0.99);
+            for (i = DCIWAVE_ERROR_MAX; i > 0 && !generator->error[i]; i--);
+            stats->error_max = i;
+        }
+    }
+
+    free(generator);
+    return 0;
+}
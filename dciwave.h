@@ -0,0 +1,71 @@
+#ifndef _DCIWAVE_H_
+#define _DCIWAVE_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * one output change of a timeline, events are run in order of offset
+ */
+struct dciwave_event {
+    u_int64_t   offset;                     // From the start of the timeline, in ns
+    u_int8_t    port;                       // Port address
+    u_int8_t    value;                      // Value of the bits in mask
+    u_int8_t    mask;                       // Bits changed, 0xFF writes the whole port
+    u_int8_t    reserved;
+};
+
+/*
+ * achieved timing of one event, as filled by the generator
+ */
+struct dciwave_edge {
+    u_int64_t   deadline;                   // CLOCK_MONOTONIC time the event was due, in ns
+    int64_t     error;                      // Write issued after the deadline, in ns
+    u_int32_t   write_ns;                   // Time taken by the write, the edge happens within it
+    int32_t     status;                     // 0 when written, -1 on error
+};
+
+/*
+ * generator configuration
+ */
+struct dciwave_config {
+    const struct dciwave_event *events;     // Timeline, sorted by offset
+    u_int32_t   count;                      // Events in the timeline
+    struct dciwave_edge *edges;             // Filled with the timing of every event, NULL if not needed
+    u_int32_t   lead_us;                    // Start of the timeline after dciwave_start(), 0 for default
+    int         priority;                   // SCHED_FIFO priority of the thread, 0 for the default policy
+    int         cpu;                        // CPU the thread is pinned to, -1 for any
+};
+
+/*
+ * generator results, as returned by dciwave_stop()
+ */
+struct dciwave_stats {
+    u_int64_t   events;                     // Events run
+    u_int64_t   errors;                     // Failed writes
+    u_int32_t   error_p50;                  // Write issued after its deadline, in us
+    u_int32_t   error_p99;
+    u_int32_t   error_max;
+    u_int32_t   write_max;                  // Longest write, in us
+    int         realtime;                   // Thread ran with SCHED_FIFO
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*
+ * function prototypes
+ */
+int32_t     dciwave_pulse(struct dciwave_event *events, const u_int32_t max, const u_int64_t offset, const u_int8_t port,
+                          const u_int8_t mask, const u_int64_t period, const u_int64_t high, const u_int32_t count);
+int32_t     dciwave_sort(struct dciwave_event *events, const u_int32_t count);
+struct dciwave_event *dciwave_load(FILE *script, u_int32_t *count);
+u_int64_t   dciwave_start(const u_int64_t dcihid_handle, const struct dciwave_config *config);
+int32_t     dciwave_done(const u_int64_t wave_handle);
+int32_t     dciwave_stop(const u_int64_t wave_handle, struct dciwave_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
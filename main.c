@@ -15,16 +15,190 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h> 
+#include <getopt.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 #include "dcihid.h"
+#include "dciboard.h"
+#include "dcisim.h"
+#include "dcisample.h"
+#include "batch.h"
+#include "dciwave.h"
+#include "dcicount.h"
+#include "dcipub.h"
+#include "dcirule.h"
 
 #define READ            0
 #define WRITE_BYTE      1
 #define WRITE_SET_BIT   2
 #define WRITE_CLEAR_BIT 3
+#define READ_ALL        4
+#define LIST_DEVICES    5
+#define WATCH           6
+#define SAMPLE          7
+#define BATCH           8
+#define WAVE            9
+#define COUNTERS        10
+#define ADC             11
+#define PUBLISH         12
+#define PUBLISHED       13
+#define INTERLOCK       14
 #define UNDEFINED 0xFF
 
+#define OPT_SAMPLE      0x100
+#define OPT_COUNT       0x101
+#define OPT_OUTPUT      0x102
+#define OPT_SHADOW      0x103
+#define OPT_BATCH       0x104
+#define OPT_TIMING      0x105
+#define OPT_STATS       0x106
+#define OPT_TRANSPORT   0x107
+#define OPT_WAVE        0x108
+#define OPT_FIFO        0x109
+#define OPT_CPU         0x10A
+#define OPT_COUNTERS    0x10B
+#define OPT_DEBOUNCE    0x10C
+#define OPT_ADC         0x10D
+#define OPT_PUBLISH     0x10E
+#define OPT_PUBLISHED   0x10F
+#define OPT_INTERLOCK   0x110
+#define OPT_EVENTS      0x111
+#define OPT_HOTPLUG     0x112
+#define OPT_RATE        0x113
+
+static const struct option long_options[] = {
+    {"watch",   no_argument,        NULL,   'W'},
+    {"sample",  required_argument,  NULL,   OPT_SAMPLE},
+    {"count",   required_argument,  NULL,   OPT_COUNT},
+    {"output",  required_argument,  NULL,   OPT_OUTPUT},
+    {"shadow",  no_argument,        NULL,   OPT_SHADOW},
+    {"batch",   required_argument,  NULL,   OPT_BATCH},
+    {"timing",  no_argument,        NULL,   OPT_TIMING},
+    {"stats",   no_argument,        NULL,   OPT_STATS},
+    {"transport", required_argument, NULL,  OPT_TRANSPORT},
+    {"wave",    required_argument,  NULL,   OPT_WAVE},
+    {"fifo",    required_argument,  NULL,   OPT_FIFO},
+    {"cpu",     required_argument,  NULL,   OPT_CPU},
+    {"counters", required_argument, NULL,   OPT_COUNTERS},
+    {"debounce", required_argument, NULL,   OPT_DEBOUNCE},
+    {"adc",     required_argument,  NULL,   OPT_ADC},
+    {"publish", required_argument,  NULL,   OPT_PUBLISH},
+    {"published", no_argument,      NULL,   OPT_PUBLISHED},
+    {"interlock", required_argument, NULL,  OPT_INTERLOCK},
+    {"events",  no_argument,        NULL,   OPT_EVENTS},
+    {"hotplug", no_argument,        NULL,   OPT_HOTPLUG},
+    {"rate",    required_argument,  NULL,   OPT_RATE},
+    {NULL,      0,                  NULL,   0}
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void
+on_signal(int sig) {
+    running = 0;
+}
+
+/*
+ * Prints one input change while watching
+ */
+static void
+print_event(const struct dcihid_event *event, void *arg) {
+    printf("%ld.%06ld [0x%02X]=0x%02X (was 0x%02X)\n", (long)event->timestamp.tv_sec, event->timestamp.tv_nsec / 1000,
+           event->addr, event->value, event->previous);
+    fflush(stdout);
+}
+
+/*
+ * Prints a board going away or coming back
+ */
+static void
+print_hotplug(const struct dcihid_hotplug_event *event, void *arg) {
+    if (event->type == DCIHID_HOTPLUG_REMOVED) {
+        fprintf(stderr, "%ld.%06ld %s removed\n", (long)event->timestamp.tv_sec, event->timestamp.tv_nsec / 1000, event->devname);
+    } else {
+        fprintf(stderr, "%ld.%06ld %s recovered after %.1f ms, reopened in %.1f ms, %u outputs written back%s\n",
+                (long)event->timestamp.tv_sec, event->timestamp.tv_nsec / 1000, event->devname, event->down_ns / 1e6,
+                event->reopen_ns / 1e6, event->replayed, event->status ? ", some failed" : "");
+    }
+}
+
+/*
+ * Follows the board while the action runs
+ */
+static void *
+run_hotplug(void *arg) {
+    u_int64_t hotplug = *(u_int64_t *)arg;
+
+    while (running && dcihid_hotplug_run(hotplug, 100, print_hotplug, NULL) >= 0);
+    return NULL;
+}
+
+/*
+ * Prints the card types of the board descriptors
+ */
+static void
+print_card_types(void) {
+    u_int type;
+
+    printf("      TYPE: DESCRIPTION\n");
+    for (type = 0; type <= DCIBOARD_TYPE_MAX; type++) {
+        if (dciboard_card(type)) printf("      0x%02X: %s\n", type, dciboard_card(type)->description);
+    }
+}
+
+/*
+ * Prints the ports with the given access of every card type
+ */
+static void
+print_card_ports(const u_int access) {
+    const struct dciboard_port *ports;
+    u_int32_t count, i;
+    int last = -1;
+
+    ports = dciboard_ports(&count);
+    printf("      TYPE PORT: DESCRIPTION\n");
+    for (i = 0; i < count; i++) {
+        if (!(ports[i].access & access)) continue;
+        if (ports[i].card_type != last) {
+            printf("      0x%02X 0x%02X: %s\n", ports[i].card_type, ports[i].addr, ports[i].description);
+        } else {
+            printf("           0x%02X: %s\n", ports[i].addr, ports[i].description);
+        }
+        last = ports[i].card_type;
+    }
+}
+
+/*
+ * Prints the ioctl statistics of a handle
+ */
+static void
+print_stats(FILE *out, const u_int64_t dcihid_handle) {
+    static const char *names[DCIHID_STAT_MAX] = { "GREPORT", "GUSAGE", "SUSAGE", "SREPORT", "OPEN" };
+    struct dcihid_stats stats;
+    int i;
+
+    if (dcihid_get_stats(dcihid_handle, &stats) != 0) {
+        fprintf(out, "Statistics are not compiled in, build with 'make STATS=1'\n");
+        return;
+    }
+    fprintf(out, "IOCTL      COUNT ERRORS    P50(us)    P99(us)    MAX(us)\n");
+    for (i = 0; i < DCIHID_STAT_MAX; i++) {
+        const struct dcihid_stat *stat = &stats.op[i];
+        if (stat->count == 0) continue;
+        fprintf(out, "%-7s %8llu %6llu %10.1f %10.1f %10.1f\n", names[i], (unsigned long long)stat->count,
+                (unsigned long long)stat->errors, dcihid_stat_percentile(stat, 0.50) / 1e3,
+                dcihid_stat_percentile(stat, 0.99) / 1e3, stat->max_ns / 1e3);
+    }
+    for (i = 0; i < DCIHID_STAT_ERRNOS; i++) {
+        if (stats.errnos[i]) fprintf(out, "errno %d (%s): %llu\n", i, i ? strerror(i) : "other", (unsigned long long)stats.errnos[i]);
+    }
+}
+
 /*
  * Main
  */
@@ -37,6 +211,23 @@ main(int argc, char *argv[])
     u_int8_t port_address = UNDEFINED;
     u_int8_t access_mode = READ;
     u_int8_t data = 0x00;
+    u_int32_t sample_rate = 0;
+    u_int64_t sample_count = 0;
+    char sample_output[256] = "";
+    int shadow = 0;
+    char batch_script[256] = "";
+    int timing = 0;
+    int stats = 0;
+    int transport = DCIHID_TRANSPORT_HIDDEV;
+    char wave_script[256] = "";
+    int wave_priority = 0;
+    int wave_cpu = -1;
+    u_int32_t debounce_us = 0;
+    char rule_script[256] = "";
+    int rule_events = 0;
+    u_int32_t rule_rate = 0;
+    int hotplug = 0;
+    int status = 0;
     
     int opt;
     
@@ -47,7 +238,7 @@ main(int argc, char *argv[])
     }
     
     // Loop through all arguments:
-    while ((opt = getopt(argc, argv, "d:t:i:r:w:f:b:s:c:hv")) != -1) {  
+    while ((opt = getopt_long(argc, argv, "d:t:i:r:w:f:b:s:c:alWhv", long_options, NULL)) != -1) {  
         switch (opt) {
             case 'd':
                 // Set the device to use:
@@ -74,6 +265,134 @@ main(int argc, char *argv[])
                 access_mode = READ;
                 port_address = (u_int8_t)strtol(optarg, NULL, 0);
                 break; 
+            case 'a':
+                // Read all ports from a single input report:
+                access_mode = READ_ALL;
+                break;
+            case 'l':
+                // List all boards plugged:
+                access_mode = LIST_DEVICES;
+                break;
+            case 'W':
+                // Print input changes until interrupted:
+                access_mode = WATCH;
+                break;
+            case OPT_SAMPLE:
+                // Sample all ports at this rate:
+                access_mode = SAMPLE;
+                sample_rate = (u_int32_t)strtoul(optarg, NULL, 0);
+                if (sample_rate == 0) {
+                    fprintf(stderr, "Invalid sample rate. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_COUNT:
+                // Number of samples to take:
+                sample_count = strtoull(optarg, NULL, 0);
+                break;
+            case OPT_OUTPUT:
+                // File to stream samples to:
+                snprintf(sample_output, sizeof(sample_output), "%s", optarg);
+                break;
+            case OPT_SHADOW:
+                // Share the last written values with other runs:
+                shadow = 1;
+                break;
+            case OPT_BATCH:
+                // Run a script of commands:
+                access_mode = BATCH;
+                snprintf(batch_script, sizeof(batch_script), "%s", optarg);
+                break;
+            case OPT_TIMING:
+                // Report the time taken by every batch command:
+                timing = 1;
+                break;
+            case OPT_STATS:
+                // Print ioctl statistics before exiting:
+                stats = 1;
+                break;
+            case OPT_TRANSPORT:
+                // Talk to the board through hiddev, hidraw or the simulator:
+                if (strcmp(optarg, "hiddev") == 0) {
+                    transport = DCIHID_TRANSPORT_HIDDEV;
+                } else if (strcmp(optarg, "hidraw") == 0) {
+                    transport = DCIHID_TRANSPORT_HIDRAW;
+                } else if (strcmp(optarg, "sim") == 0) {
+                    transport = DCIHID_TRANSPORT_SIM;
+                } else {
+                    fprintf(stderr, "Unknown transport. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_WAVE:
+                // Run a timeline of output changes:
+                access_mode = WAVE;
+                snprintf(wave_script, sizeof(wave_script), "%s", optarg);
+                break;
+            case OPT_FIFO:
+                // Run the waveform thread with SCHED_FIFO at this priority:
+                wave_priority = atoi(optarg);
+                break;
+            case OPT_CPU:
+                // Pin the waveform thread to this CPU:
+                wave_cpu = atoi(optarg);
+                break;
+            case OPT_COUNTERS:
+                // Count input edges, sampling at this rate:
+                access_mode = COUNTERS;
+                sample_rate = (u_int32_t)strtoul(optarg, NULL, 0);
+                if (sample_rate == 0) {
+                    fprintf(stderr, "Invalid sample rate. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_ADC:
+                // Stream ADC samples at this rate:
+                access_mode = ADC;
+                sample_rate = (u_int32_t)strtoul(optarg, NULL, 0);
+                if (sample_rate == 0) {
+                    fprintf(stderr, "Invalid sample rate. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_PUBLISH:
+                // Publish the inputs to shared memory at this rate:
+                access_mode = PUBLISH;
+                sample_rate = (u_int32_t)strtoul(optarg, NULL, 0);
+                if (sample_rate == 0) {
+                    fprintf(stderr, "Invalid sample rate. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_PUBLISHED:
+                // Read the inputs published by another run:
+                access_mode = PUBLISHED;
+                break;
+            case OPT_INTERLOCK:
+                // Drive outputs from the rules of a script:
+                access_mode = INTERLOCK;
+                snprintf(rule_script, sizeof(rule_script), "%s", optarg);
+                break;
+            case OPT_EVENTS:
+                // Evaluate the interlocks on input events instead of reading:
+                rule_events = 1;
+                break;
+            case OPT_RATE:
+                // Read the inputs of the interlocks at this rate instead of back to back:
+                rule_rate = (u_int32_t)strtoul(optarg, NULL, 0);
+                if (rule_rate == 0) {
+                    fprintf(stderr, "Invalid rate. Try '%s -h' for more information.\n", argv[0]);
+                    return 1;
+                }
+                break;
+            case OPT_HOTPLUG:
+                // Reopen the board when it comes back after a USB reset or replug:
+                hotplug = 1;
+                break;
+            case OPT_DEBOUNCE:
+                // Time an input has to hold a new level to be counted:
+                debounce_us = (u_int32_t)strtoul(optarg, NULL, 0);
+                break;
             case 'w':
                 // Set the address to write to:
                 access_mode = WRITE_BYTE;
@@ -98,24 +417,17 @@ main(int argc, char *argv[])
                 // Print help:
                 printf("%s: Application to control DCI USB HID devices from Decision-Computer\n", argv[0]);
                 printf("Usage: %s -d <device> -t <type> -i <id> -r/w <port> [-b <byte> / -s/c <bit>]\n", argv[0]);
+                printf("       %s -d <device> -t <type> -i <id> -a\n", argv[0]);
+                printf("       %s -d <device> -t <type> -i <id> -W/--watch\n", argv[0]);
+                printf("       %s -d <device> -t <type> -i <id> --sample <rate> [--count <n>] [--output <file>]\n", argv[0]);
+                printf("       %s [-d <device> -t <type> -i <id>] --batch <script> [--timing]\n", argv[0]);
+                printf("       %s --interlock <rules> [--events | --rate <rate>]\n", argv[0]);
+                printf("       %s -l\n", argv[0]);
                 printf("Where:\n");
                 printf("  <device> is the linux HID device to use, for example: /dev/usb/hiddev0\n");
+                printf("      if not given it is looked up from <type> and <id>, see -l\n");
                 printf("  <type> is the card  type as 0x??:\n");
-                printf("      TYPE: DESCRIPTION\n");
-                printf("      0x01: USB 16 Channel Photo Input / 16 Channel Photo Output\n");
-                printf("      0x02: USB LABKIT\n");
-                printf("      0x03: USB 16 Channel Photo Input / 16 Channel Relay Output\n");
-                printf("      0x04: USB STARTER\n");
-                printf("      0x06: USB 8 Channel Photo Input / 8 Channel Relay Output\n");
-                printf("      0x07: USB 4 Channel Photo Input / 4 Channel Relay Output\n");
-                printf("      0x08: USB 8 Channel Photo Input\n");
-                printf("      0x09: USB 8 Channel Relay Output\n");
-                printf("      0x0A: USB 16 Channel Photo Input\n");
-                printf("      0x0B: USB 16 Channel Relay Output\n");
-                printf("      0x0C: USB 32 Channel Photo Input\n");
-                printf("      0x0D: USB 32 Channel Relay Output\n");
-                printf("      0x0E: USB Industry\n");
-                printf("      0x10: USB Mini 4 I/O\n");
+                print_card_types();
                 printf("  <id> is the card ID set on the DIP switch from 0 to 14:\n");
                 printf("      ID:  1   2   3   4 \n");
                 printf("      0:  OFF OFF OFF OFF\n");
@@ -134,80 +446,53 @@ main(int argc, char *argv[])
                 printf("      13: ON  OFF ON  ON \n");
                 printf("      14: OFF ON  ON  ON \n");
                 printf("  -w <port> is the port address to write to, depending on the card type:\n");
-                printf("      TYPE PORT: DESCRIPTION\n");
-                printf("      0x01 0x02: OUT07 to OUT00\n");
-                printf("           0x03: OUT15 to OUT08\n");
-                printf("      0x02 0x03: P1D07 to P1D00\n");
-                printf("      0x04 0x03: P1D07 to P1D00\n");
-                printf("      0x03 0x02: OUT07 to OUT00\n");
-                printf("           0x03: OUT15 to OUT08\n");
-                printf("      0x06 0x01: OUT07 to OUT00\n");
-                printf("           0x02: DIO7 to DIO0\n");
-                printf("           0x03: DIO15 to DIO8\n");
-                printf("      0x07 0x02: OUT03 to OUT00\n");
-                printf("      0x09 0x02: OUT07 to OUT00\n");
-                printf("      0x0B 0x02: OUT07 to OUT00\n");
-                printf("           0x03: OUT15 to OUT08\n");
-                printf("      0x0D 0x00: OUT07 to OUT00\n");
-                printf("           0x01: OUT15 to OUT08\n");
-                printf("           0x02: OUT23 to OUT16\n");
-                printf("           0x03: OUT31 to OUT24\n");
-                printf("      0x0E 0x00: Port 0\n");
-                printf("           0x01: Port 1\n");
-                printf("           0x02: Port 2\n");
-                printf("           0x03: Port 3\n");
-                printf("           0x04: Port 4\n");
-                printf("           0x05: Port 5\n");
-                printf("           0x06: Port 6\n");
-                printf("           0x07: Port 7\n");
-                printf("           0x08: DIO\n");
-                printf("           0x0D: IOCONFIG\n");
-                printf("      0x10 0x02: OUT03 to OUT00\n");
+                print_card_ports(DCIBOARD_WRITE);
                 printf("  -r <port> is the port address to read from, depending on the card type:\n");
-                printf("      TYPE PORT: DESCRIPTION\n");
-                printf("      0x01 0x00: IN07 to IN00\n");
-                printf("           0x01: IN15 to IN08\n");
-                printf("      0x02 0x02: P0D07 to P0D00\n");
-                printf("      0x04 0x02: P0D07 to P0D00\n");
-                printf("      0x03 0x00: IN07 to IN00\n");
-                printf("           0x01: IN15 to IN08\n");
-                printf("      0x06 0x00: IN07 to IN00\n");
-                printf("           0x02: DIO7 to DIO0\n");
-                printf("           0x03: DIO15 to DIO8\n");
-                printf("           0x10: JP9/JP10 Settings\n");
-                printf("      0x07 0x00: IN03 to IN00\n");
-                printf("      0x08 0x00: IN07 to IN00\n");
-                printf("      0x0A 0x00: IN07 to IN00\n");
-                printf("           0x01: IN15 to IN08\n");
-                printf("      0x0C 0x00: IN07 to IN00\n");
-                printf("           0x01: IN15 to IN08\n");
-                printf("           0x02: IN23 to IN16\n");
-                printf("           0x03: IN31 to IN24\n");
-                printf("      0x0E 0x00: Port 0\n");
-                printf("           0x01: Port 1\n");
-                printf("           0x02: Port 2\n");
-                printf("           0x03: Port 3\n");
-                printf("           0x04: Port 4\n");
-                printf("           0x05: Port 5\n");
-                printf("           0x06: Port 6\n");
-                printf("           0x07: Port 7\n");
-                printf("           0x08: DIO\n");
-                printf("           0x0D: IOCONFIG\n");
-                printf("           0x10: Port 0 default value\n");
-                printf("           0x11: Port 1 default value\n");
-                printf("           0x12: Port 2 default value\n");
-                printf("           0x13: Port 3 default value\n");
-                printf("           0x14: Port 4 default value\n");
-                printf("           0x15: Port 5 default value\n");
-                printf("           0x16: Port 6 default value\n");
-                printf("           0x17: Port 7 default value\n");
-                printf("           0x18: Port DIO default value\n");
-                printf("           0x19: Input/output default setting\n");
-                printf("      0x10 0x00: IN03 to IN00\n");
+                print_card_ports(DCIBOARD_READ);
+                printf("  -l lists the boards plugged and refreshes the device index\n");
+                printf("  -a reads ports 0x00 to 0x03 and the ADC result from a single input report\n");
+                printf("  -W/--watch prints a timestamped line for every change of ports 0x00 to 0x03 until interrupted\n");
+                printf("  --sample <rate> streams timestamped samples of ports 0x00 to 0x03 taken <rate> times per second\n");
+                printf("      as binary records (see dcisample.h) to <file> or stdout, until <n> samples or Ctrl+C\n");
+                printf("  --shadow keeps the last written values in shared memory, so -s/c do not read the port back\n");
+                printf("  --batch <script> runs the commands of <script> ('-' for stdin) on boards opened once, and prints\n");
+                printf("      one JSON line per command, with the time taken when --timing is given. Commands:\n");
+                printf("      board <name> [<type> <id> [<device>]], read <port>, readall, write <port> <byte>,\n");
+                printf("      set <port> <bit>, clear <port> <bit>, sleep <ms>, until <ms>, loop <count>, end\n");
+                printf("  --stats prints the count, errors and p50/p99/max latency of every ioctl class before exiting\n");
+                printf("      (needs the driver built with 'make STATS=1')\n");
+                printf("  --transport <hiddev|hidraw|sim> talks to the board through hiddev ioctls (default) or whole reports\n");
+                printf("      on /dev/hidrawN, <device> may be either node of the board. 'sim' runs against a simulated\n");
+                printf("      board of type -t, driven by the script in $%s (see README)\n", DCISIM_STIMULI_ENV);
+                printf("  --wave <script> writes the outputs of a timeline ('-' for stdin) on absolute deadlines, and prints\n");
+                printf("      how late every event was issued. Lines, times in ms from the start of the timeline:\n");
+                printf("      <ms> <port> <value> [<mask>], pulse <ms> <port> <mask> <period_ms> <duty%%> <count>\n");
+                printf("  --fifo <priority> runs the --wave or --interlock thread with SCHED_FIFO (needs CAP_SYS_NICE or\n");
+                printf("      RLIMIT_RTPRIO)\n");
+                printf("  --cpu <n> pins the --wave or --interlock thread to CPU <n>\n");
+                printf("  --counters <rate> samples ports 0x00 to 0x03 <rate> times per second and prints, every second until\n");
+                printf("      Ctrl+C, the rising and falling edges and the frequency of every input that changed\n");
+                printf("  --adc <rate> takes <rate> ADC samples per second of a LABKIT or STARTER board, and prints one line\n");
+                printf("      per sample (timestamp, channel, result and ports 0x00 to 0x03) until <n> samples or Ctrl+C\n");
+                printf("  --publish <rate> reads the input report <rate> times per second and publishes ports 0x00 to 0x03 and\n");
+                printf("      the ADC to %s until Ctrl+C, for any number of --published readers\n", DCIPUB_FILE);
+                printf("  --published prints the inputs published by --publish for <type> and <id>, without opening the device\n");
+                printf("  --interlock <rules> drives outputs from the inputs of any boards by the rules of a script ('-' for\n");
+                printf("      stdin) until Ctrl+C, and prints the firings and reaction latency of every rule. Lines:\n");
+                printf("      <type>:<id> <bit> <level> [<bit> <level> ...] -> <type>:<id> <bit> <level>\n");
+                printf("      where <bit> is a channel as IN03 or <port>.<bit>, and <level> is low/high, off/on or 0/1\n");
+                printf("  --events evaluates --interlock on input changes (see -W) instead of reading the inputs back to back\n");
+                printf("  --rate <rate> reads the inputs of every --interlock board <rate> times per second instead of back to\n");
+                printf("      back\n");
+                printf("  --hotplug reopens the board when it comes back after a USB reset or replug, and writes its last\n");
+                printf("      output values back. Reads and writes fail with ENODEV meanwhile, -W goes on once it is back\n");
+                printf("  --debounce <us> is the time an input has to hold a new level to be counted by --counters\n");
                 printf("  -b <byte> is the byte to be written while using -w <port>: 0x00 to 0xFF\n");
                 printf("  -s/c <bit> is the bit to be set/clear while using -w <port>: 0 to 7\n");
                 printf("Examples:\n");
                 printf("  %s -d /dev/usb/hiddev0 -t 0x06 -i 0 -r 0x02\n", argv[0]);
+                printf("  %s -d /dev/usb/hiddev0 -t 0x0C -i 0 -a\n", argv[0]);
+                printf("  %s -t 0x06 -i 0 -r 0x02\n", argv[0]);
                 printf("  %s -d /dev/usb/hiddev0 -t 0x06 -i 0 -w 0x02 -b 0x88\n", argv[0]);
                 printf("  %s -d /dev/usb/hiddev0 -t 0x06 -i 0 -w 0x02 -s 5\n", argv[0]);
                 printf("  %s -d /dev/usb/hiddev0 -t 0x06 -i 0 -w 0x02 -c 2\n", argv[0]);
@@ -229,11 +514,95 @@ main(int argc, char *argv[])
         }
     }
     
-    // Verify if we have all needed values:
-    if (linux_hiddev[0] == '\0') {
-        fprintf(stderr, "No Linux HID device specified. Try '%s -h' for more information.\n", argv[0]);
-        return 1;
+    // List boards and exit:
+    if (access_mode == LIST_DEVICES) {
+        struct dcihid_devent list[64];
+        int32_t count = dcihid_enumerate(list, 64);
+        int i;
+
+        if (count < 0) {
+            fprintf(stderr, "Could not scan for devices\n");
+            return 1;
+        }
+        printf("DEVICE               TYPE ID BUS DEV\n");
+        for (i = 0; i < count; i++) {
+            printf("%-20s 0x%02X %2u %3u %3u\n", list[i].devname, list[i].card_type, list[i].card_id, list[i].busnum, list[i].devnum);
+        }
+        return 0;
     }
+
+    // Run a script and exit:
+    if (access_mode == BATCH) {
+        FILE *script = stdin;
+        int ret;
+
+        if (strcmp(batch_script, "-") != 0 && (script = fopen(batch_script, "r")) == NULL) {
+            perror(batch_script);
+            return 1;
+        }
+        ret = batch_run(script, linux_hiddev, dcihid_card_type, dcihid_card_id, transport, timing);
+        if (script != stdin) fclose(script);
+        return ret;
+    }
+
+    // Run interlocks until interrupted, the rules name their boards:
+    if (access_mode == INTERLOCK) {
+        struct dcirule_config rule_config;
+        struct dcirule_stats rule_stats;
+        struct dcirule_result *results;
+        struct dcirule *rules;
+        struct timespec idle = { 0, 100000000 };
+        u_int32_t count, i;
+        u_int64_t engine;
+        FILE *script = stdin;
+
+        if (strcmp(rule_script, "-") != 0 && (script = fopen(rule_script, "r")) == NULL) {
+            perror(rule_script);
+            return 1;
+        }
+        rules = dcirule_load(script, &count);
+        if (script != stdin) fclose(script);
+        if (rules == NULL) return 1;
+        if ((results = (struct dcirule_result *)calloc(count, sizeof(struct dcirule_result))) == NULL) {
+            free(rules);
+            return 1;
+        }
+
+        memset(&rule_config, 0, sizeof(rule_config));
+        rule_config.rules = rules;
+        rule_config.count = count;
+        rule_config.transport = transport;
+        rule_config.events = rule_events;
+        rule_config.rate = rule_rate;
+        rule_config.priority = wave_priority;
+        rule_config.cpu = wave_cpu;
+        if ((engine = dcirule_start(&rule_config)) == 0) {
+            free(results);
+            free(rules);
+            return 1;
+        }
+        printf("Running %u interlocks, Ctrl+C to stop\n", count);
+        signal(SIGINT, on_signal);
+        signal(SIGTERM, on_signal);
+        while (running) nanosleep(&idle, NULL);
+        dcirule_stop(engine, &rule_stats, results);
+
+        printf("%llu %s, %llu errors, %llu missed on %u boards%s\n", (unsigned long long)rule_stats.reads,
+               rule_events ? "events" : "reads", (unsigned long long)rule_stats.errors,
+               (unsigned long long)rule_stats.missed, rule_stats.boards, rule_stats.realtime ? ", SCHED_FIFO" : "");
+        printf("LINE    FIRED ERRORS    P50(us)    P99(us)    MAX(us) RULE\n");
+        for (i = 0; i < count; i++) {
+            const struct dcihid_stat *latency = &results[i].latency;
+            printf("%4u %8llu %6llu %10u %10u %10.1f %s\n", rules[i].line, (unsigned long long)results[i].firings,
+                   (unsigned long long)results[i].errors, results[i].latency_p50, results[i].latency_p99,
+                   latency->max_ns / 1e3, rules[i].text);
+        }
+        free(results);
+        free(rules);
+        return 0;
+    }
+
+    // Verify if we have all needed values:
     if (dcihid_card_type == UNDEFINED) {
         fprintf(stderr, "No card type specified. Try '%s -h' for more information.\n", argv[0]);
         return 1;
@@ -242,29 +611,268 @@ main(int argc, char *argv[])
         fprintf(stderr, "No card ID specified. Try '%s -h' for more information.\n", argv[0]);
         return 1;
     }
-    if (port_address == UNDEFINED) {
+    if (port_address == UNDEFINED && access_mode != READ_ALL && access_mode != WATCH && access_mode != SAMPLE &&
+        access_mode != WAVE && access_mode != COUNTERS && access_mode != ADC &&
+        access_mode != PUBLISH && access_mode != PUBLISHED) {
         fprintf(stderr, "No port address specified. Try '%s -h' for more information.\n", argv[0]);
         return 1;
     }
     
-    printf("Using HID device %s to connect with card of type 0x%02X and ID %u\n", linux_hiddev, dcihid_card_type, dcihid_card_id);
+    // Check the port against the descriptors of the card, outputs can be read back:
+    if (access_mode == READ && dciboard_access(dcihid_card_type, port_address) == 0) {
+        fprintf(stderr, "Port 0x%02X is not available on card type 0x%02X. Try '%s -h' for more information.\n",
+                port_address, dcihid_card_type, argv[0]);
+        return 1;
+    }
+    if ((access_mode == WRITE_BYTE || access_mode == WRITE_SET_BIT || access_mode == WRITE_CLEAR_BIT) &&
+        !(dciboard_access(dcihid_card_type, port_address) & DCIBOARD_WRITE)) {
+        fprintf(stderr, "Port 0x%02X is not writable on card type 0x%02X. Try '%s -h' for more information.\n",
+                port_address, dcihid_card_type, argv[0]);
+        return 1;
+    }
+
+    // Read the published inputs and exit, the board belongs to the publisher:
+    if (access_mode == PUBLISHED) {
+        struct dcipub_snapshot snapshot;
+        struct timespec now;
+        u_int64_t pub;
+        int i;
+
+        if ((pub = dcipub_attach(dcihid_card_type, dcihid_card_id, NULL)) == 0) return 1;
+        if (dcipub_read(pub, &snapshot) != 0) {
+            if (errno == ENODATA) {
+                fprintf(stderr, "Nothing published yet for card of type 0x%02X and ID %u\n", dcihid_card_type, dcihid_card_id);
+            } else {
+                fprintf(stderr, "Could not read the inputs published for card of type 0x%02X and ID %u: %s\n", dcihid_card_type,
+                        dcihid_card_id, strerror(errno));
+            }
+            dcipub_detach(pub);
+            return 1;
+        }
+        dcipub_detach(pub);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        printf("Published by process %u at %u Hz, %.3f ms ago%s\n", snapshot.publisher, snapshot.rate,
+               ((now.tv_sec * 1000000000ULL + now.tv_nsec) - snapshot.timestamp) / 1e6, snapshot.publisher ? "" : " (stopped)");
+        for (i = 0; i < DCIHID_INPUT_PORTS; i++) {
+            printf("[0x%02X]=0x%02X\n", i, snapshot.port[i]);
+        }
+        printf("ADC[0x%02X]=0x%04X\n", snapshot.adc_index, snapshot.adc_result);
+        return 0;
+    }
+
+    if (linux_hiddev[0] == '\0' && transport != DCIHID_TRANSPORT_SIM && dcihid_lookup(dcihid_card_type, dcihid_card_id, linux_hiddev, sizeof(linux_hiddev)) != 0) {
+        fprintf(stderr, "There is no Decision-Computer DCI HID USB device (CardID, CardNO) = (%d, %d) plugged\n", dcihid_card_type, dcihid_card_id);
+        return 1;
+    }
+
+    // Samples may go to stdout, keep messages out of the way:
+    FILE *info = (access_mode == SAMPLE || access_mode == ADC) ? stderr : stdout;
+
+    fprintf(info, "Using HID device %s to connect with card of type 0x%02X and ID %u\n", linux_hiddev[0] ? linux_hiddev : "simulator", dcihid_card_type, dcihid_card_id);
     
     // Open handle:
     u_int64_t dcihid_handle = 0;
-    dcihid_handle = dcihid_open(linux_hiddev, dcihid_card_type, dcihid_card_id);
+    dcihid_handle = dcihid_open_transport(linux_hiddev, dcihid_card_type, dcihid_card_id, transport);
     if (dcihid_handle == 0) {
         fprintf(stderr, "There is no Decision-Computer DCI HID USB device (CardID, CardNO) = (%d, %d) plugged\n", dcihid_card_type, dcihid_card_id);
         return 1;
     }
 
+    if (shadow && dcihid_shadow_attach(dcihid_handle, NULL) != 0) {
+        fprintf(stderr, "Could not attach the shared output shadow\n");
+    }
+
+    // Follow the board from a thread of its own, whatever the action:
+    u_int64_t monitor = 0;
+    pthread_t monitor_thread;
+    if (hotplug) {
+        if ((monitor = dcihid_hotplug_create()) != 0 && dcihid_hotplug_add(monitor, dcihid_handle) == 0 &&
+            pthread_create(&monitor_thread, NULL, run_hotplug, &monitor) == 0) {
+            signal(SIGINT, on_signal);
+            signal(SIGTERM, on_signal);
+        } else {
+            fprintf(stderr, "The board will not be reopened if it goes away\n");
+            if (monitor) dcihid_hotplug_destroy(monitor);
+            monitor = 0;
+        }
+    }
+
     // Perform actions:
-    u_int8_t tmp;
+    struct dcihid_input input;
+    u_int64_t watch;
+    u_int64_t sampler;
+    struct dcisample_config sample_config;
+    struct dcisample_stats sample_stats;
+    struct dciwave_config wave_config;
+    struct dciwave_stats wave_stats;
+    struct dciwave_event *wave_events;
+    u_int64_t wave;
+    FILE *wave_file;
+    struct dcicount_config count_config;
+    struct dcicount_counters counters;
+    struct timespec tick = { 1, 0 };
+    u_int64_t counter;
+    u_int64_t pub;
+    struct dcipub_snapshot snapshot;
+    struct dcisample *block;
+    u_int64_t acquirer;
+    u_int64_t streamed = 0;
+    u_int32_t block_size;
+    int32_t taken;
+    int j;
+    struct timespec idle = { 0, 10000000 };
+    int i;
     switch (access_mode) {
         case READ:
             printf("Reading value on port address: 0x%02X\n", port_address);
             dcihid_read(dcihid_handle, port_address, &data);
             printf("[0x%02X]=0x%02X\n", port_address, data);
             break;
+        case READ_ALL:
+            printf("Reading all ports\n");
+            if (dcihid_read_all(dcihid_handle, &input) == 0) {
+                for (i = 0; i < DCIHID_INPUT_PORTS; i++) {
+                    printf("[0x%02X]=0x%02X\n", i, input.port[i]);
+                }
+                printf("ADC[0x%02X]=0x%04X\n", input.adc_index, input.adc_result);
+            }
+            break;
+        case WATCH:
+            printf("Watching ports for changes, press Ctrl+C to stop\n");
+            if ((watch = dcihid_watch_create()) == 0) break;
+            if (dcihid_watch_add(watch, dcihid_handle) == 0) {
+                signal(SIGINT, on_signal);
+                signal(SIGTERM, on_signal);
+                fflush(stdout);
+                while (running && dcihid_watch_run(watch, 1000, print_event, NULL) >= 0);
+            }
+            dcihid_watch_destroy(watch);
+            break;
+        case SAMPLE:
+            memset(&sample_config, 0, sizeof(sample_config));
+            sample_config.rate = sample_rate;
+            sample_config.count = sample_count;
+            sample_config.out_fd = STDOUT_FILENO;
+            if (sample_output[0] != '\0' && (sample_config.out_fd = open(sample_output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+                perror(sample_output);
+                break;
+            }
+            fprintf(info, "Sampling ports at %u Hz, press Ctrl+C to stop\n", sample_rate);
+            if ((sampler = dcisample_start(dcihid_handle, &sample_config)) != 0) {
+                signal(SIGINT, on_signal);
+                signal(SIGTERM, on_signal);
+                while (running && !dcisample_done(sampler)) nanosleep(&idle, NULL);
+                dcisample_stop(sampler, &sample_stats);
+                fprintf(info, "samples=%llu written=%llu rate=%.1fHz missed=%llu dropped=%llu errors=%llu jitter p50=%uus p99=%uus max=%uus\n",
+                        (unsigned long long)sample_stats.samples, (unsigned long long)sample_stats.written, sample_stats.rate,
+                        (unsigned long long)sample_stats.missed, (unsigned long long)sample_stats.dropped,
+                        (unsigned long long)sample_stats.errors, sample_stats.jitter_p50, sample_stats.jitter_p99, sample_stats.jitter_max);
+            }
+            if (sample_config.out_fd != STDOUT_FILENO) close(sample_config.out_fd);
+            break;
+        case WAVE:
+            wave_file = stdin;
+            if (strcmp(wave_script, "-") != 0 && (wave_file = fopen(wave_script, "r")) == NULL) {
+                perror(wave_script);
+                break;
+            }
+            memset(&wave_config, 0, sizeof(wave_config));
+            wave_events = dciwave_load(wave_file, &wave_config.count);
+            if (wave_file != stdin) fclose(wave_file);
+            if (wave_events == NULL) break;
+            wave_config.events = wave_events;
+            wave_config.edges = (struct dciwave_edge *)calloc(wave_config.count, sizeof(struct dciwave_edge));
+            wave_config.priority = wave_priority;
+            wave_config.cpu = wave_cpu;
+            printf("Running %u events, press Ctrl+C to stop\n", wave_config.count);
+            fflush(stdout);
+            if (wave_config.edges && (wave = dciwave_start(dcihid_handle, &wave_config)) != 0) {
+                signal(SIGINT, on_signal);
+                signal(SIGTERM, on_signal);
+                while (running && !dciwave_done(wave)) nanosleep(&idle, NULL);
+                dciwave_stop(wave, &wave_stats);
+                for (i = 0; i < (int)wave_stats.events; i++) {
+                    printf("%10.3fms [0x%02X]=0x%02X/0x%02X error=%.1fus write=%.1fus%s\n", wave_events[i].offset / 1e6,
+                           wave_events[i].port, wave_events[i].value, wave_events[i].mask, wave_config.edges[i].error / 1e3,
+                           wave_config.edges[i].write_ns / 1e3, wave_config.edges[i].status ? " failed" : "");
+                }
+                printf("events=%llu errors=%llu realtime=%s error p50=%uus p99=%uus max=%uus write max=%uus\n",
+                       (unsigned long long)wave_stats.events, (unsigned long long)wave_stats.errors, wave_stats.realtime ? "yes" : "no",
+                       wave_stats.error_p50, wave_stats.error_p99, wave_stats.error_max, wave_stats.write_max);
+            }
+            free(wave_config.edges);
+            free(wave_events);
+            break;
+        case COUNTERS:
+            memset(&count_config, 0, sizeof(count_config));
+            count_config.rate = sample_rate;
+            for (i = 0; i < DCICOUNT_CHANNELS; i++) count_config.debounce_us[i] = debounce_us;
+            printf("Counting input edges at %u Hz, press Ctrl+C to stop\n", sample_rate);
+            if ((counter = dcicount_start(dcihid_handle, &count_config)) == 0) break;
+            signal(SIGINT, on_signal);
+            signal(SIGTERM, on_signal);
+            while (running) {
+                nanosleep(&tick, NULL);
+                dcicount_read(counter, &counters);
+                printf("samples=%llu missed=%llu errors=%llu state=0x%08X\n", (unsigned long long)counters.samples,
+                       (unsigned long long)counters.missed, (unsigned long long)counters.errors, counters.state);
+                for (i = 0; i < DCICOUNT_CHANNELS; i++) {
+                    if (counters.rising[i] == 0 && counters.falling[i] == 0) continue;
+                    printf("  IN%02d rising=%llu falling=%llu frequency=%.3fHz\n", i, (unsigned long long)counters.rising[i],
+                           (unsigned long long)counters.falling[i], counters.frequency[i]);
+                }
+                fflush(stdout);
+            }
+            dcicount_stop(counter);
+            break;
+        case PUBLISH:
+            if ((pub = dcipub_start(dcihid_handle, NULL, sample_rate)) == 0) break;
+            printf("Publishing inputs at %u Hz to " DCIPUB_FILE ", press Ctrl+C to stop\n", sample_rate, dcihid_card_type,
+                   dcihid_card_id);
+            signal(SIGINT, on_signal);
+            signal(SIGTERM, on_signal);
+            while (running) {
+                nanosleep(&tick, NULL);
+                dcipub_read(pub, &snapshot);
+                printf("samples=%llu missed=%llu errors=%llu\n", (unsigned long long)snapshot.samples,
+                       (unsigned long long)snapshot.missed, (unsigned long long)snapshot.errors);
+                fflush(stdout);
+            }
+            dcipub_stop(pub);
+            break;
+        case ADC:
+            if (!dcihid_card_has_adc(dcihid_card_type)) {
+                fprintf(stderr, "Card type 0x%02X has no ADC\n", dcihid_card_type);
+                break;
+            }
+            // Acquire blocks of about 100 ms on one schedule, so Ctrl+C is seen quickly:
+            block_size = sample_rate / 10 ? sample_rate / 10 : 1;
+            if ((block = (struct dcisample *)malloc(block_size * sizeof(struct dcisample))) == NULL) break;
+            if ((acquirer = dcisample_acquire_start(dcihid_handle, sample_rate)) == 0) {
+                free(block);
+                break;
+            }
+            fprintf(info, "Taking ADC samples at %u Hz, press Ctrl+C to stop\n", sample_rate);
+            signal(SIGINT, on_signal);
+            signal(SIGTERM, on_signal);
+            printf("timestamp,channel,result,port0,port1,port2,port3\n");
+            while (running && (sample_count == 0 || streamed < sample_count)) {
+                if (sample_count && sample_count - streamed < block_size) block_size = sample_count - streamed;
+                if ((taken = dcisample_acquire_next(acquirer, block, block_size)) < 0) break;
+                for (j = 0; j < taken; j++) {
+                    printf("%llu.%09llu,%u,%u,0x%02X,0x%02X,0x%02X,0x%02X\n", (unsigned long long)(block[j].timestamp / 1000000000ULL),
+                           (unsigned long long)(block[j].timestamp % 1000000000ULL), block[j].adc_index, block[j].adc_result,
+                           block[j].port[0], block[j].port[1], block[j].port[2], block[j].port[3]);
+                }
+                fflush(stdout);
+                streamed += taken;
+            }
+            dcisample_acquire_stop(acquirer, &sample_stats);
+            fprintf(info, "samples=%llu rate=%.1fHz missed=%llu errors=%llu jitter p50=%uus p99=%uus max=%uus\n",
+                    (unsigned long long)sample_stats.samples, sample_stats.rate, (unsigned long long)sample_stats.missed,
+                    (unsigned long long)sample_stats.errors, sample_stats.jitter_p50, sample_stats.jitter_p99, sample_stats.jitter_max);
+            free(block);
+            break;
         case WRITE_BYTE:
             printf("Writing value 0x%02X on port address: 0x%02X\n", data, port_address);
             dcihid_write(dcihid_handle, port_address, data);
@@ -272,16 +880,20 @@ main(int argc, char *argv[])
             break;
         case WRITE_SET_BIT:
             printf("Setting bit %u on port address: 0x%02X\n", data, port_address);
-            dcihid_read(dcihid_handle, port_address, &tmp);
-            data = tmp | (1 << data);
-            dcihid_write(dcihid_handle, port_address, data);
+            if (dcihid_set_bits(dcihid_handle, port_address, 1 << data, &data) != 0) {
+                fprintf(stderr, "Could not set bit %u on port address: 0x%02X\n", data, port_address);
+                status = 1;
+                break;
+            }
             printf("[0x%02X]=0x%02X\n", port_address, data);
             break;
         case WRITE_CLEAR_BIT:
             printf("Clearing bit %u on port address: 0x%02X\n", data, port_address);
-            dcihid_read(dcihid_handle, port_address, &tmp);
-            data = tmp & ~(1 << data);
-            dcihid_write(dcihid_handle, port_address, data);
+            if (dcihid_clear_bits(dcihid_handle, port_address, 1 << data, &data) != 0) {
+                fprintf(stderr, "Could not clear bit %u on port address: 0x%02X\n", data, port_address);
+                status = 1;
+                break;
+            }
             printf("[0x%02X]=0x%02X\n", port_address, data);
             break;
         default:
@@ -289,7 +901,22 @@ main(int argc, char *argv[])
             break;
     }
     
+    if (monitor) {
+        struct dcihid_hotplug_stats hotplug_stats;
+
+        running = 0;
+        pthread_join(monitor_thread, NULL);
+        dcihid_hotplug_get_stats(monitor, &hotplug_stats);
+        dcihid_hotplug_destroy(monitor);
+        if (hotplug_stats.removals) {
+            fprintf(info, "removals=%llu recoveries=%llu reopen p50=%.1fms max=%.1fms\n", (unsigned long long)hotplug_stats.removals,
+                    (unsigned long long)hotplug_stats.recoveries, dcihid_stat_percentile(&hotplug_stats.reopen, 0.50) / 1e6,
+                    hotplug_stats.reopen.max_ns / 1e6);
+        }
+    }
+    if (stats) print_stats(info, dcihid_handle);
+
     // Close handle and exit:
     dcihid_close(dcihid_handle);
-    return 0;
+    return status;
 }
@@ -0,0 +1,10 @@
+#!/usr/bin/python
+from setuptools import setup, Extension
+
+setup(
+    name='dcihid',
+    version='1.0',
+    description='Driver for DCI USB HID devices from Decision-Computer',
+    ext_modules=[Extension('dcihid', sources=['dcihidmodule.c', 'dcihid.c', 'dciboard.c', 'dcisim.c'])],
+    py_modules=['DecisionUsbdio'],
+)